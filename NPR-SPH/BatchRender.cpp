@@ -0,0 +1,373 @@
+// Batch render driver
+// Runs the headless renderer (NPR-SPH built with NPR_HEADLESS) once per job in a job file, several
+// jobs at a time, and reports per-job and total throughput.
+//
+// usage: NPR-SPH-Batch jobs.txt [--renderer path] [--jobs N] [--job-memory MB] [--width w] [--height h] [--force]
+// Run it from the NPR-SPH directory so the renderer finds the shaders and meshes.
+//
+// Job file: one job per line, whitespace separated key=value pairs, # starts a comment.
+//   out=purdue_toon.mp4 frames=300 mesh=0 style=toon camera=orbit.txt midtone=0.6,0.4,0.4
+//   out=fluid/frame%04d.png frames=600 sph=1 style=paint brush-scale=1.5
+// Every key but out and sph is passed on as --key value (see the renderer's usage line), sph=1 adds --sph.
+// scene=file.txt is passed first, so the job's other keys override the scene file.
+// The renderer is started through the shell, so values may only hold letters, digits and ._-+,/:
+// (paths take forward slashes on Windows too), plus the frame pattern of out, e.g. %04d.
+// Jobs whose output already exists are skipped unless --force is given. Videos are written under a
+// temporary name and renamed when the renderer succeeds, so an interrupted job is redone next time.
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FramePattern.h"
+#include "ThreadPool.h"
+
+struct Job
+{
+	int line;
+	std::string out;
+	int frames;
+	std::vector<std::pair<std::string, std::string>> options; // renderer arguments without the leading --
+	bool skipped;
+	bool failed;
+	double seconds;
+};
+
+// keys the headless renderer understands, besides out
+static const char* const job_keys[] =
+{
+	"frames", "width", "height", "scene", "mesh", "style", "angle", "camera", "sph",
+	"dark", "midtone", "highlight", "outline", "shininess", "brush-scale", "brush-density"
+};
+
+static double now_seconds()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool file_exists(const std::string& filename)
+{
+	std::ifstream f(filename.c_str());
+	return f.good();
+}
+
+// physical memory that is free right now, 0 if unknown
+static size_t available_memory()
+{
+#ifdef _WIN32
+	MEMORYSTATUSEX status;
+	status.dwLength = sizeof(status);
+	return GlobalMemoryStatusEx(&status) ? (size_t)status.ullAvailPhys : 0;
+#else
+	const long pages = sysconf(_SC_AVPHYS_PAGES);
+	const long page_size = sysconf(_SC_PAGE_SIZE);
+	return pages > 0 && page_size > 0 ? (size_t)pages * page_size : 0;
+#endif
+}
+
+static bool is_image_sequence(const std::string& out)
+{
+	return out.find('%') != std::string::npos;
+}
+
+// the file whose presence means the job finished: the video, or the last image of a sequence
+static std::string final_output(const Job& job)
+{
+	if (!is_image_sequence(job.out))
+	{
+		return job.out;
+	}
+	return FrameFilename(job.out, job.frames - 1);
+}
+
+// a.mp4 -> a.part.mp4, keeping the extension ffmpeg picks the container from
+static std::string partial_name(const std::string& out)
+{
+	const size_t dot = out.find_last_of('.');
+	const size_t slash = out.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+	{
+		return out + ".part";
+	}
+	return out.substr(0, dot) + ".part" + out.substr(dot);
+}
+
+// characters that mean nothing to sh or cmd.exe, even inside the quotes build_command() adds
+static bool is_plain_value(const std::string& value, bool allow_percent)
+{
+	for (size_t i = 0; i < value.size(); i++)
+	{
+		const char c = value[i];
+		const bool plain = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || strchr("._-+,/:", c) != NULL;
+		if (!plain && !(allow_percent && c == '%'))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool parse_jobs(const char* filename, std::vector<Job>& jobs)
+{
+	std::ifstream in(filename);
+	if (!in)
+	{
+		fprintf(stderr, "Could not open job file %s\n", filename);
+		return false;
+	}
+
+	std::string line;
+	int line_number = 0;
+	while (std::getline(in, line))
+	{
+		line_number++;
+		const size_t first = line.find_first_not_of(" \t\r");
+		if (first == std::string::npos || line[first] == '#')
+		{
+			continue;
+		}
+
+		Job job = { line_number, "", 1, {}, false, false, 0.0 };
+		std::istringstream fields(line);
+		std::string field;
+		while (fields >> field)
+		{
+			const size_t eq = field.find('=');
+			if (eq == std::string::npos || eq == 0 || eq + 1 == field.size())
+			{
+				fprintf(stderr, "%s:%d: expected key=value, got %s\n", filename, line_number, field.c_str());
+				return false;
+			}
+			const std::string key = field.substr(0, eq);
+			const std::string value = field.substr(eq + 1);
+			if (!is_plain_value(value, key == "out"))
+			{
+				fprintf(stderr, "%s:%d: %s may only contain letters, digits and ._-+,/: (and %% in out)\n", filename, line_number, field.c_str());
+				return false;
+			}
+			if (key == "out")
+			{
+				if (is_image_sequence(value) && !IsFramePattern(value))
+				{
+					fprintf(stderr, "%s:%d: %s needs exactly one frame number like %%04d, and no other %% but %%%%\n", filename, line_number, field.c_str());
+					return false;
+				}
+				job.out = value;
+				continue;
+			}
+			if (std::find(std::begin(job_keys), std::end(job_keys), key) == std::end(job_keys))
+			{
+				fprintf(stderr, "%s:%d: unknown key %s\n", filename, line_number, key.c_str());
+				return false;
+			}
+			if (key == "frames")
+			{
+				job.frames = atoi(value.c_str());
+			}
+			job.options.push_back(std::make_pair(key, value));
+		}
+
+		if (job.out.empty() || job.frames <= 0)
+		{
+			fprintf(stderr, "%s:%d: every job needs out= and a positive frames=\n", filename, line_number);
+			return false;
+		}
+		jobs.push_back(job);
+	}
+	return true;
+}
+
+static std::string quote(const std::string& arg)
+{
+	return "\"" + arg + "\"";
+}
+
+static std::string build_command(const std::string& renderer, const Job& job, const std::string& out, int width, int height, const std::string& log)
+{
+	std::string cmd = quote(renderer) + " --out " + quote(out);
+	for (size_t i = 0; i < job.options.size(); i++)
+	{
+		if (job.options[i].first == "scene")
+		{
+			cmd += " --scene " + quote(job.options[i].second);
+		}
+	}
+	bool has_width = false, has_height = false;
+	for (size_t i = 0; i < job.options.size(); i++)
+	{
+		const std::string& key = job.options[i].first;
+		const std::string& value = job.options[i].second;
+		if (key == "sph")
+		{
+			if (value != "0") cmd += " --sph";
+			continue;
+		}
+		if (key == "scene")
+		{
+			continue;
+		}
+		has_width |= key == "width";
+		has_height |= key == "height";
+		cmd += " --" + key + " " + quote(value);
+	}
+	if (!has_width) cmd += " --width " + std::to_string(width);
+	if (!has_height) cmd += " --height " + std::to_string(height);
+	cmd += " > " + quote(log) + " 2>&1";
+#ifdef _WIN32
+	cmd = "\"" + cmd + "\""; // cmd.exe strips the outer quotes when the renderer path is quoted too
+#endif
+	return cmd;
+}
+
+int main(int argc, char** argv)
+{
+	const char* job_filename = NULL;
+#ifdef _WIN32
+	std::string renderer = "NPR-SPH.exe";
+#else
+	std::string renderer = "./NPR-SPH";
+#endif
+	int max_jobs = 0; // 0: one per core
+	int job_memory_mb = 768; // llvmpipe, encoder and particle buffers of one renderer process
+	int width = 720, height = 720;
+	bool force = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--renderer") == 0 && i + 1 < argc) renderer = argv[++i];
+		else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) max_jobs = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--job-memory") == 0 && i + 1 < argc) job_memory_mb = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc) width = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--height") == 0 && i + 1 < argc) height = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--force") == 0) force = true;
+		else if (argv[i][0] != '-' && job_filename == NULL) job_filename = argv[i];
+		else
+		{
+			fprintf(stderr, "unknown argument %s\n", argv[i]);
+			return 1;
+		}
+	}
+	if (job_filename == NULL)
+	{
+		fprintf(stderr, "usage: NPR-SPH-Batch jobs.txt [--renderer path] [--jobs N] [--job-memory MB] [--width w] [--height h] [--force]\n");
+		return 1;
+	}
+
+	std::vector<Job> jobs;
+	if (!parse_jobs(job_filename, jobs))
+	{
+		return 1;
+	}
+
+	int pending = 0;
+	for (size_t j = 0; j < jobs.size(); j++)
+	{
+		jobs[j].skipped = !force && file_exists(final_output(jobs[j]));
+		pending += jobs[j].skipped ? 0 : 1;
+	}
+
+	// bounded by cores, by free memory and by how much work there is
+	const int cores = std::max(1, (int)std::thread::hardware_concurrency());
+	int workers = max_jobs > 0 ? max_jobs : cores;
+	const size_t memory = available_memory();
+	if (memory > 0 && job_memory_mb > 0)
+	{
+		workers = std::min(workers, std::max(1, (int)(memory / ((size_t)job_memory_mb << 20))));
+	}
+	workers = std::max(1, std::min(workers, pending));
+
+	// every renderer would otherwise start one llvmpipe thread per core
+	if (getenv("LP_NUM_THREADS") == NULL)
+	{
+		const std::string threads = std::to_string(std::max(1, cores / workers));
+#ifdef _WIN32
+		_putenv_s("LP_NUM_THREADS", threads.c_str());
+#else
+		setenv("LP_NUM_THREADS", threads.c_str(), 0);
+#endif
+	}
+
+	fprintf(stderr, "%d jobs, %d already rendered, %d workers (%d cores, %zu MB free)\n",
+		(int)jobs.size(), (int)jobs.size() - pending, workers, cores, memory >> 20);
+
+	std::mutex print_mutex;
+	const double start = now_seconds();
+	{
+		ThreadPool pool(workers);
+		for (size_t j = 0; j < jobs.size(); j++)
+		{
+			if (jobs[j].skipped)
+			{
+				continue;
+			}
+			Job* job = &jobs[j];
+			pool.Submit([job, &renderer, width, height, &print_mutex]()
+			{
+				const bool sequence = is_image_sequence(job->out);
+				const std::string out = sequence ? job->out : partial_name(job->out);
+				const std::string log = (sequence ? partial_name(final_output(*job)) : out) + ".log";
+				const std::string cmd = build_command(renderer, *job, out, width, height, log);
+
+				const double job_start = now_seconds();
+				const int status = system(cmd.c_str());
+				job->seconds = now_seconds() - job_start;
+
+				job->failed = status != 0;
+				if (!job->failed && !sequence)
+				{
+					remove(job->out.c_str()); // left over when rendering with --force; rename won't replace it on Windows
+					job->failed = rename(out.c_str(), job->out.c_str()) != 0;
+				}
+				if (!job->failed)
+				{
+					remove(log.c_str());
+				}
+
+				std::lock_guard<std::mutex> lock(print_mutex);
+				if (job->failed)
+				{
+					fprintf(stderr, "FAILED %s (line %d), see %s\n", job->out.c_str(), job->line, log.c_str());
+				}
+				else
+				{
+					fprintf(stderr, "done %s: %d frames in %.1f s, %.2f fps\n", job->out.c_str(), job->frames, job->seconds, job->frames / job->seconds);
+				}
+			});
+		}
+		pool.Wait();
+	}
+	const double wall = now_seconds() - start;
+
+	printf("%-40s %8s %10s %8s  %s\n", "output", "frames", "seconds", "fps", "status");
+	int rendered_frames = 0, failed = 0;
+	for (size_t j = 0; j < jobs.size(); j++)
+	{
+		const Job& job = jobs[j];
+		const char* status = job.skipped ? "skipped" : (job.failed ? "FAILED" : "ok");
+		if (job.skipped || job.failed)
+		{
+			printf("%-40s %8d %10s %8s  %s\n", job.out.c_str(), job.frames, "-", "-", status);
+			failed += job.failed ? 1 : 0;
+			continue;
+		}
+		printf("%-40s %8d %10.2f %8.2f  %s\n", job.out.c_str(), job.frames, job.seconds, job.frames / job.seconds, status);
+		rendered_frames += job.frames;
+	}
+	printf("total: %d frames in %.2f s, %.2f fps over %d workers, %d failed\n", rendered_frames, wall, wall > 0.0 ? rendered_frames / wall : 0.0, workers, failed);
+
+	return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,302 @@
+// Headless SPH throughput benchmark
+// Runs a fixed number of steps for a range of particle counts on the GL compute path and the CPU
+// engine and prints the results as JSON. Scenes come from make_particles(), the same setup
+// init_particles() uses in the interactive app.
+//
+// usage: NPR-SPH-Bench [--steps N] [--counts 10000,100000,...] [--max-brute N] [--threads N]
+//                      [--no-gl] [--no-cpu] [--scene scene.txt] [--out results.json]
+// --scene takes the solver constants, boundary and time step from a scene file.
+// Run it from the NPR-SPH directory so the compute shaders can be found.
+// On Windows the GL context comes from a hidden GLFW window. Elsewhere it is the surfaceless EGL
+// (or OSMesa) context of Headless.cpp, so it runs on machines without a display server.
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/glew.h>
+#ifdef _WIN32
+#include <GLFW/glfw3.h>
+#else
+#include "Headless.h"
+#endif
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "GpuMemory.h"
+#include "InitShader.h"
+#include "SceneFile.h"
+#include "Simulation.h"
+#include "SphCpu.h"
+#include "ThreadPool.h"
+
+static const std::string rho_pres_com_shader("rho_pres_comp.glsl");
+static const std::string force_comp_shader("force_comp.glsl");
+static const std::string integrate_comp_shader("integrate_comp.glsl");
+
+// solver settings, the interactive app's defaults unless --scene is given
+static ConstantsUniform constants;
+static BoundaryUniform boundary;
+static float time_step = 1.0f / NUM_PARTICLES;
+
+struct BenchResult
+{
+	std::string engine;
+	std::string search;
+	int particles;
+	int steps;
+	double seconds;
+	size_t memory_bytes;
+	bool skipped;
+};
+
+static double now_seconds()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::string json_escape(const std::string& s)
+{
+	std::string out;
+	for (size_t i = 0; i < s.size(); i++)
+	{
+		if (s[i] == '"' || s[i] == '\\') out += '\\';
+		out += s[i];
+	}
+	return out;
+}
+
+static void bench_gl(const GLuint programs[3], int num_particles, int steps, BenchResult& result)
+{
+	std::vector<Particle> particles = make_particles(num_particles, boundary);
+	GLuint ssbo = -1, vao = -1;
+	init_particle_buffers(particles, &ssbo, &vao);
+
+	GLuint ubos[2];
+	glGenBuffers(2, ubos);
+	glBindBuffer(GL_UNIFORM_BUFFER, ubos[0]);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(ConstantsUniform), &constants, GL_STATIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, 1, ubos[0]);
+	glBindBuffer(GL_UNIFORM_BUFFER, ubos[1]);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(BoundaryUniform), &boundary, GL_STATIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, 2, ubos[1]);
+
+	// warm up: shader compilation on first dispatch, buffer residency
+	step_simulation(programs, num_particles, time_step);
+	glFinish();
+
+	double start = now_seconds();
+	for (int s = 0; s < steps; s++)
+	{
+		step_simulation(programs, num_particles, time_step);
+	}
+	glFinish();
+	result.seconds = now_seconds() - start;
+	result.memory_bytes = sizeof(Particle) * num_particles + sizeof(ConstantsUniform) + sizeof(BoundaryUniform);
+
+	glDeleteBuffers(2, ubos);
+	free_particle_buffers(&ssbo, &vao);
+}
+
+static void bench_cpu(ThreadPool& pool, int search, int num_particles, int steps, BenchResult& result)
+{
+	SphCpu sph;
+	sph.mSearch = search;
+	sph.mPool = &pool;
+	sph.mConstants = constants;
+	sph.mBoundary = boundary;
+	sph.mTimeStep = time_step;
+	sph.Init(num_particles);
+	sph.Step(); // warm up, allocates the grid
+
+	double start = now_seconds();
+	for (int s = 0; s < steps; s++)
+	{
+		sph.Step();
+	}
+	result.seconds = now_seconds() - start;
+	result.memory_bytes = sph.MemoryBytes();
+}
+
+static std::vector<int> parse_counts(const char* list)
+{
+	std::vector<int> counts;
+	std::stringstream ss(list);
+	std::string item;
+	while (std::getline(ss, item, ','))
+	{
+		counts.push_back(atoi(item.c_str()));
+	}
+	return counts;
+}
+
+int main(int argc, char** argv)
+{
+	int steps = 10;
+	int max_brute = 50000; // all-pairs cost grows with the square of the particle count
+	int threads = 0;
+	bool run_gl = true;
+	bool run_cpu = true;
+	const char* out_filename = NULL;
+	std::vector<int> counts = { 10000, 50000, 100000, 500000, 1000000, 2000000, 4000000 };
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc) steps = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--counts") == 0 && i + 1 < argc) counts = parse_counts(argv[++i]);
+		else if (strcmp(argv[i], "--max-brute") == 0 && i + 1 < argc) max_brute = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--no-gl") == 0) run_gl = false;
+		else if (strcmp(argv[i], "--no-cpu") == 0) run_cpu = false;
+		else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) out_filename = argv[++i];
+		else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc)
+		{
+			SceneFile scene;
+			BindSimulationSettings(scene, &constants, &boundary, &time_step);
+			if (!scene.Load(argv[++i], false))
+			{
+				return 1;
+			}
+		}
+		else
+		{
+			fprintf(stderr, "unknown argument %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	std::vector<BenchResult> results;
+	std::string renderer = "none";
+
+	if (run_gl)
+	{
+#ifdef _WIN32
+		// WGL needs a window, an invisible one is enough for compute
+		if (!glfwInit())
+		{
+			fprintf(stderr, "Could not initialize GLFW\n");
+			return 1;
+		}
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
+		GLFWwindow* window = glfwCreateWindow(64, 64, "NPR-SPH benchmark", NULL, NULL);
+		if (!window)
+		{
+			fprintf(stderr, "Could not create an OpenGL 4.4 context\n");
+			glfwTerminate();
+			return 1;
+		}
+		glfwMakeContextCurrent(window);
+#else
+		// no window or display server, works with Mesa's llvmpipe
+		if (!create_headless_context())
+		{
+			return 1;
+		}
+#endif
+		glewInit();
+		renderer = (const char*)glGetString(GL_RENDERER);
+
+		GLuint programs[3] =
+		{
+			InitShader(rho_pres_com_shader.c_str()),
+			InitShader(force_comp_shader.c_str()),
+			InitShader(integrate_comp_shader.c_str())
+		};
+		if (programs[0] == -1 || programs[1] == -1 || programs[2] == -1)
+		{
+			fprintf(stderr, "Could not build the compute shaders, run from the NPR-SPH directory\n");
+			return 1;
+		}
+
+		// the compute shaders only implement the all-pairs search
+		for (size_t c = 0; c < counts.size(); c++)
+		{
+			BenchResult r = { "gl", NeighborSearchName(NEIGHBOR_BRUTE_FORCE), counts[c], steps, 0.0, 0, counts[c] > max_brute };
+			if (!r.skipped)
+			{
+				bench_gl(programs, counts[c], steps, r);
+			}
+			fprintf(stderr, "gl %s %d: %s\n", r.search.c_str(), r.particles, r.skipped ? "skipped" : "done");
+			results.push_back(r);
+		}
+
+		for (int p = 0; p < 3; p++)
+		{
+			glDeleteProgram(programs[p]);
+		}
+#ifdef _WIN32
+		glfwDestroyWindow(window);
+		glfwTerminate();
+#else
+		destroy_headless_context();
+#endif
+	}
+
+	ThreadPool pool(threads);
+	if (run_cpu)
+	{
+		for (int search = 0; search < NEIGHBOR_SEARCH_COUNT; search++)
+		{
+			for (size_t c = 0; c < counts.size(); c++)
+			{
+				BenchResult r = { "cpu", NeighborSearchName(search), counts[c], steps, 0.0, 0, search == NEIGHBOR_BRUTE_FORCE && counts[c] > max_brute };
+				if (!r.skipped)
+				{
+					bench_cpu(pool, search, counts[c], steps, r);
+				}
+				fprintf(stderr, "cpu %s %d: %s\n", r.search.c_str(), r.particles, r.skipped ? "skipped" : "done");
+				results.push_back(r);
+			}
+		}
+	}
+
+	// report
+	std::stringstream json;
+	json << "{\n  \"renderer\": \"" << json_escape(renderer) << "\",\n";
+	json << "  \"cpu_threads\": " << pool.NumThreads() << ",\n";
+	json << "  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchResult& r = results[i];
+		json << "    { \"engine\": \"" << r.engine << "\", \"neighbor_search\": \"" << r.search << "\", \"particles\": " << r.particles;
+		if (r.skipped)
+		{
+			// the GL compute path has no other search, so its large counts end up here
+			json << ", \"skipped\": true, \"reason\": \"brute-force neighbour search above --max-brute " << max_brute << " particles\" }";
+		}
+		else
+		{
+			const double particle_steps = (double)r.particles * r.steps;
+			json << ", \"steps\": " << r.steps << ", \"seconds\": " << r.seconds
+				<< ", \"steps_per_second\": " << r.steps / r.seconds
+				<< ", \"ns_per_particle_step\": " << r.seconds * 1e9 / particle_steps
+				<< ", \"memory_bytes\": " << r.memory_bytes << " }";
+		}
+		json << (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	json << "  ]\n}\n";
+
+	if (out_filename != NULL)
+	{
+		FILE* fp = fopen(out_filename, "w");
+		if (fp == NULL)
+		{
+			fprintf(stderr, "Could not open %s\n", out_filename);
+			return 1;
+		}
+		fputs(json.str().c_str(), fp);
+		fclose(fp);
+	}
+	else
+	{
+		fputs(json.str().c_str(), stdout);
+	}
+	return 0;
+}
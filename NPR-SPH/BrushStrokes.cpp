@@ -0,0 +1,254 @@
+#include "BrushStrokes.h"
+#include "GpuMemory.h"
+#include "LoadMesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+void BrushStrokes::Reserve(int count)
+{
+	if (mDrawCommand == -1)
+	{
+		const DrawArraysIndirectCommand command = { 4, 0, 0, 0 };
+		mDrawCommand = GpuCreateBuffer(GL_DRAW_INDIRECT_BUFFER, sizeof(command), &command, GL_DYNAMIC_DRAW, "brush draw command");
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		mStatsBuffer = GpuCreateBuffer(GL_SHADER_STORAGE_BUFFER, sizeof(BrushStats), nullptr, GL_DYNAMIC_COPY, "brush stats");
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		mStatsReadback.Init(sizeof(BrushStats), "brush stats readback");
+	}
+	if (count <= mCapacity)
+	{
+		return;
+	}
+	GpuDeleteBuffer(&mStrokes);
+	GpuDeleteBuffer(&mGroups);
+	mStrokes = GpuCreateBuffer(GL_SHADER_STORAGE_BUFFER, sizeof(BrushStroke) * count, nullptr, GL_DYNAMIC_COPY, "brush strokes");
+	const int groups = (count + BRUSH_WORK_GROUP_SIZE - 1) / BRUSH_WORK_GROUP_SIZE;
+	mGroups = GpuCreateBuffer(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * groups, nullptr, GL_DYNAMIC_COPY, "brush stroke groups");
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	mCapacity = count;
+}
+
+void BrushStrokes::Destroy()
+{
+	GpuDeleteBuffer(&mStrokes);
+	GpuDeleteBuffer(&mDrawCommand);
+	GpuDeleteBuffer(&mGroups);
+	GpuDeleteBuffer(&mSeeds);
+	GpuDeleteBuffer(&mStatsBuffer);
+	GpuDeleteBuffer(&mOrder);
+	mStatsReadback.Destroy();
+	mCapacity = 0;
+	mOrderSlots = 0;
+	mSortedSlots = 0;
+	mSourceCount = 0;
+	mSeedCount = 0;
+	mSeedDensity = 0.0f;
+}
+
+static glm::vec3 to_vec3(const aiVector3D& v)
+{
+	return glm::vec3(v.x, v.y, v.z);
+}
+
+void BrushStrokes::SeedMesh(const MeshData& mesh, float density)
+{
+	GpuDeleteBuffer(&mSeeds);
+	mSeedCount = 0;
+	mSeedDensity = density;
+	mSurfaceArea = 0.0f;
+	if (mesh.mScene == NULL || mesh.mScene->mNumMeshes == 0)
+	{
+		return;
+	}
+	const aiMesh* submesh = mesh.mScene->mMeshes[0]; // the submesh display() draws
+
+	// running sum of triangle areas, the distribution the seeds are drawn from. Points and lines
+	// have no area and are left out, so every face picked below is a triangle.
+	std::vector<unsigned int> triangles;
+	std::vector<float> area_sum;
+	triangles.reserve(submesh->mNumFaces);
+	area_sum.reserve(submesh->mNumFaces);
+	float area = 0.0f;
+	for (unsigned int f = 0; f < submesh->mNumFaces; f++)
+	{
+		if (submesh->mFaces[f].mNumIndices != 3)
+		{
+			continue;
+		}
+		const unsigned int* v = submesh->mFaces[f].mIndices;
+		const glm::vec3 a = to_vec3(submesh->mVertices[v[0]]);
+		const glm::vec3 e1 = to_vec3(submesh->mVertices[v[1]]) - a;
+		const glm::vec3 e2 = to_vec3(submesh->mVertices[v[2]]) - a;
+		area += 0.5f * glm::length(glm::cross(e1, e2)) * mesh.mScaleFactor * mesh.mScaleFactor;
+		triangles.push_back(f);
+		area_sum.push_back(area);
+	}
+	mSurfaceArea = area;
+	const int count = std::min((int)(density * area + 0.5f), BRUSH_MAX_SEEDS);
+	if (count <= 0)
+	{
+		return;
+	}
+
+	// one sample per stratum of the area distribution: every triangle gets its share of strokes
+	// with less clumping than independent samples
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	std::vector<StrokeSeed> seeds(count);
+	for (int i = 0; i < count; i++)
+	{
+		const float target = (i + uniform(rng)) / count * area;
+		const size_t t = std::min<size_t>(std::upper_bound(area_sum.begin(), area_sum.end(), target) - area_sum.begin(), triangles.size() - 1);
+		const unsigned int* v = submesh->mFaces[triangles[t]].mIndices;
+
+		// uniform point in the triangle
+		const float r1 = std::sqrt(uniform(rng));
+		const float r2 = uniform(rng);
+		const float b[3] = { 1.0f - r1, r1 * (1.0f - r2), r1 * r2 };
+
+		StrokeSeed& seed = seeds[i];
+		seed.position = glm::vec3(0.0f);
+		glm::vec3 normal(0.0f);
+		glm::vec2 tex_coord(0.0f);
+		for (int k = 0; k < 3; k++)
+		{
+			seed.position += b[k] * to_vec3(submesh->mVertices[v[k]]);
+			if (submesh->HasNormals()) normal += b[k] * to_vec3(submesh->mNormals[v[k]]);
+			if (submesh->HasTextureCoords(0)) tex_coord += b[k] * glm::vec2(submesh->mTextureCoords[0][v[k]].x, submesh->mTextureCoords[0][v[k]].y);
+		}
+		seed.normal = glm::length(normal) > 0.0f ? glm::normalize(normal) : normal;
+		seed.s = tex_coord.x;
+		seed.t = tex_coord.y;
+	}
+
+	mSeeds = GpuCreateBuffer(GL_SHADER_STORAGE_BUFFER, sizeof(StrokeSeed) * count, seeds.data(), GL_STATIC_DRAW, "brush stroke seeds");
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	mSeedCount = count;
+}
+
+BrushSources BrushStrokes::MeshSources() const
+{
+	BrushSources sources = { mSeeds, sizeof(StrokeSeed) / sizeof(float), mSeedCount };
+	return sources;
+}
+
+void BrushStrokes::Generate(const BrushSources& sources, const BrushCulling& culling)
+{
+	Reserve(sources.count);
+	mSourceCount = sources.count;
+
+	const ReadbackConsumer consume_stats = [this](const void* data, unsigned int, int)
+	{
+		mStats = *(const BrushStats*)data;
+	};
+	mStatsReadback.Poll(false, consume_stats);
+
+	// brush_comp.glsl counts what it culls from zero
+	BrushStats stats = BrushStats();
+	stats.total = sources.count;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mStatsBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(stats), &stats);
+	if (sources.count == 0)
+	{
+		const GLuint no_instances = 0;
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mDrawCommand);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, offsetof(DrawArraysIndirectCommand, instance_count), sizeof(no_instances), &no_instances);
+		mStatsReadback.Capture(mStatsBuffer, 0, 0, consume_stats);
+		return; // e.g. a mesh with no triangles, nothing to draw
+	}
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BRUSH_BINDING_SOURCES, sources.buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BRUSH_BINDING_STROKES, mStrokes);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BRUSH_BINDING_DRAW_COMMAND, mDrawCommand);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BRUSH_BINDING_STATS, mStatsBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BRUSH_BINDING_GROUPS, mGroups);
+
+	glUniform1i(BRUSH_SOURCE_COUNT_LOCATION, sources.count);
+	glUniform1i(BRUSH_SOURCE_STRIDE_LOCATION, sources.stride);
+	glUniform1i(BRUSH_CULLING_LOCATION, culling.enabled);
+	glUniform1f(BRUSH_CULL_PIXELS_LOCATION, culling.cull_pixels);
+	glUniform1f(BRUSH_LOD_PIXELS_LOCATION, glm::max(culling.lod_pixels, culling.cull_pixels));
+	glUniform1f(BRUSH_GUARD_BAND_LOCATION, culling.guard_band);
+
+	// count the strokes every work group keeps, turn the counts into offsets, then write the strokes
+	// there (see brush_comp.glsl)
+	const GLuint groups = (sources.count + BRUSH_WORK_GROUP_SIZE - 1) / BRUSH_WORK_GROUP_SIZE;
+	glUniform1i(BRUSH_COMPACT_PASS_LOCATION, 0);
+	glDispatchCompute(groups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	glUniform1i(BRUSH_COMPACT_PASS_LOCATION, 1);
+	glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	glUniform1i(BRUSH_COMPACT_PASS_LOCATION, 2);
+	glDispatchCompute(groups, 1, 1);
+
+	// strokes are read by brush_vs, the count by the indirect draw
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+	mStatsReadback.Capture(mStatsBuffer, 0, 0, consume_stats);
+}
+
+void BrushStrokes::Sort()
+{
+	if (mStrokes == -1)
+	{
+		return;
+	}
+
+	// the instance count is on the GPU; the stats of the same sources tell how many strokes survived
+	// culling a few frames ago, without culling exactly. Until they are back, all sources could be.
+	const int strokes = (mStats.total == (GLuint)mSourceCount) ? (int)(mStats.total - mStats.Culled()) : mSourceCount;
+	int slots = 1;
+	while (slots < strokes)
+	{
+		slots <<= 1;
+	}
+	if (slots > mOrderSlots)
+	{
+		GpuDeleteBuffer(&mOrder);
+		mOrder = GpuCreateBuffer(GL_SHADER_STORAGE_BUFFER, 2 * sizeof(GLuint) * slots, nullptr, GL_DYNAMIC_COPY, "brush stroke order");
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		mOrderSlots = slots;
+	}
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BRUSH_BINDING_STROKES, mStrokes);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BRUSH_BINDING_DRAW_COMMAND, mDrawCommand);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BRUSH_BINDING_ORDER, mOrder);
+	glUniform1i(BRUSH_SORT_SLOTS_LOCATION, slots);
+	mSortedSlots = slots;
+	const GLuint groups = (slots + BRUSH_WORK_GROUP_SIZE - 1) / BRUSH_WORK_GROUP_SIZE;
+
+	// keys, then the bitonic merges
+	glUniform2i(BRUSH_SORT_STEP_LOCATION, 0, 0);
+	glDispatchCompute(groups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	for (int size = 2; size <= slots; size <<= 1)
+	{
+		for (int distance = size / 2; distance > 0; distance /= 2)
+		{
+			glUniform2i(BRUSH_SORT_STEP_LOCATION, size, distance);
+			glDispatchCompute(groups, 1, 1);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		}
+	}
+}
+
+void BrushStrokes::Draw()
+{
+	if (mStrokes == -1)
+	{
+		return;
+	}
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BRUSH_BINDING_STROKES, mStrokes);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BRUSH_BINDING_DRAW_COMMAND, mDrawCommand); // the instance count, for STROKE_ORDER_FRONT_TO_BACK
+	if (mOrder != -1)
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BRUSH_BINDING_ORDER, mOrder);
+	}
+	glUniform1i(BRUSH_SORT_SLOTS_LOCATION, mSortedSlots);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mDrawCommand);
+	glDrawArraysIndirect(GL_TRIANGLE_STRIP, nullptr); // one triangle strip instance per stroke
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "ParticleReadback.h"
+
+/*
+Paint strokes generated on the GPU.
+
+Generate() runs brush_comp.glsl over the stroke sources (mesh seeds or particles). It writes the
+BrushStroke of source i to slot i of an SSBO, so strokes blend over each other in source order like
+the geometry shader drew them, and sets the instance count of an indirect draw command to the
+number of sources. Draw() then expands every stroke into a quad in brush_vs.glsl with a single
+glDrawArraysIndirect.
+
+Meshes are seeded once per mesh and density by SeedMesh(): stratified, area-weighted samples over
+the triangles, so stroke density follows the surface instead of the tessellation and the number of
+strokes, and with it their cost, is set by the density.
+
+With BrushCulling enabled brush_comp.glsl skips strokes outside the frustum, on back faces or below a
+pixel size, and thins strokes that are small on screen (see the comment at the top of the shader).
+The strokes that are kept are packed to the front of the buffer in source order by a prefix sum over
+the work groups, and their number becomes the instance count. What was culled is counted in
+BrushStats, which reaches the CPU through a ParticleReadback ring a few frames late instead of
+stalling on the dispatch.
+
+Source order is stable but not back to front, so overlapping strokes still blend in an order that
+has nothing to do with depth. Sort() orders them back to front with a bitonic sort in
+stroke_sort_comp.glsl, the reference for StrokeBlend.
+*/
+
+// mirrors struct Stroke in brush_comp.glsl and brush_vs.glsl (std430)
+struct BrushStroke
+{
+	glm::vec4 center; // xyz: world-space center, w: depth compared against fbo_tex
+	glm::vec4 axis_u; // xyz: half the width along the stroke, w: opacity at the faded end
+	glm::vec4 axis_w; // xyz: half the height across the stroke, w: opacity at the opaque end
+	glm::vec4 normal; // xyz: world-space normal
+	glm::vec2 seed; // texture coordinate the color noise is hashed from
+	glm::vec2 padding;
+};
+
+// a point on the mesh surface a stroke is painted at, read as 8 floats by brush_comp.glsl
+struct StrokeSeed
+{
+	glm::vec3 position; // model space
+	float s; // texture coordinate
+	glm::vec3 normal; // model space, unit length
+	float t;
+};
+
+struct DrawArraysIndirectCommand
+{
+	GLuint count;
+	GLuint instance_count;
+	GLuint first;
+	GLuint base_instance;
+};
+
+// mirrors buffer STATS in brush_comp.glsl (std430)
+struct BrushStats
+{
+	GLuint total; // sources, written by Generate()
+	GLuint frustum_culled;
+	GLuint backface_culled;
+	GLuint small_culled;
+	GLuint thinned;
+	GLuint drawn_fill; // BRUSH_FILL_UNIT pixels covered by the drawn strokes, counting overlaps
+	GLuint saved_fill; // BRUSH_FILL_UNIT pixels the back-facing and small strokes would have covered
+
+	GLuint Culled() const { return frustum_culled + backface_culled + small_culled + thinned; }
+};
+
+struct BrushCulling
+{
+	bool enabled;
+	float cull_pixels; // strokes narrower than this on screen are skipped
+	float lod_pixels; // strokes narrower than this are thinned, the survivors grow to this width
+	float guard_band; // fraction of the view kept beyond every side, for strokes reused under a moved camera
+};
+
+// How overlapping strokes combine, see render_paint() in Main.cpp
+enum StrokeBlend
+{
+	STROKE_BLEND_OVER, // alpha blended in source order, the order brush_comp.glsl wrote them
+	STROKE_BLEND_WEIGHTED, // weighted blended order-independent transparency, unsorted
+	STROKE_BLEND_SORTED, // alpha blended after Sort(), the reference
+	STROKE_BLEND_COUNT
+};
+
+// layout(location = 23) uniform int stroke_order in brush_vs.glsl
+enum StrokeOrder
+{
+	STROKE_ORDER_GENERATED,
+	STROKE_ORDER_BACK_TO_FRONT, // as left by the last Sort()
+	STROKE_ORDER_FRONT_TO_BACK,
+};
+
+// shader storage bindings of brush_comp.glsl; 0 is the particle buffer of the simulation
+enum BrushBinding
+{
+	BRUSH_BINDING_SOURCES = 1,
+	BRUSH_BINDING_STROKES = 5,
+	BRUSH_BINDING_DRAW_COMMAND = 6,
+	BRUSH_BINDING_STATS = 7,
+	BRUSH_BINDING_GROUPS = 8,
+	BRUSH_BINDING_ORDER = 9, // stroke_sort_comp.glsl and brush_vs.glsl
+};
+
+#define BRUSH_SOURCE_COUNT_LOCATION 13 // layout(location = 13) uniform int source_count in brush_comp.glsl
+#define BRUSH_SOURCE_STRIDE_LOCATION 14 // layout(location = 14) uniform int source_stride
+#define BRUSH_CULLING_LOCATION 15
+#define BRUSH_CULL_PIXELS_LOCATION 16
+#define BRUSH_LOD_PIXELS_LOCATION 17
+#define BRUSH_GUARD_BAND_LOCATION 22
+#define BRUSH_SORT_STEP_LOCATION 25 // layout(location = 25) uniform ivec2 step in stroke_sort_comp.glsl
+#define BRUSH_SORT_SLOTS_LOCATION 26
+#define BRUSH_COMPACT_PASS_LOCATION 27
+#define BRUSH_WORK_GROUP_SIZE 256
+#define BRUSH_FILL_UNIT 256 // pixels per count of BrushStats::drawn_fill and saved_fill
+#define BRUSH_MAX_SEEDS (1 << 20) // caps SeedMesh() at 80 MB of strokes
+
+// Where the strokes come from: StrokeSeeds for a mesh, the particle buffer for the simulation
+struct BrushSources
+{
+	GLuint buffer;
+	int stride; // floats from one source to the next
+	int count;
+};
+
+struct MeshData;
+
+struct BrushStrokes
+{
+	GLuint mStrokes; // BrushStroke SSBO
+	GLuint mDrawCommand; // DrawArraysIndirectCommand, instance count written by brush_comp.glsl
+	GLuint mGroups; // strokes kept per work group, then where each group writes them
+	int mCapacity; // strokes mStrokes has room for
+	GLuint mSeeds; // StrokeSeeds of the current mesh
+	int mSeedCount;
+	float mSeedDensity; // density mSeeds was sampled with, 0 before the first mesh
+	float mSurfaceArea; // of the seeded mesh, after MeshData::mScaleFactor
+	GLuint mStatsBuffer; // BrushStats of the current dispatch
+	ParticleReadback mStatsReadback;
+	BrushStats mStats; // latest that came back, a few frames old
+	int mSourceCount; // sources of the last Generate(), the most strokes it can have written
+	GLuint mOrder; // (key, stroke index) pairs written by Sort()
+	int mOrderSlots; // pairs mOrder has room for
+	int mSortedSlots; // slots the last Sort() ordered, a power of two
+
+	BrushStrokes() : mStrokes(-1), mDrawCommand(-1), mGroups(-1), mCapacity(0), mSeeds(-1), mSeedCount(0), mSeedDensity(0.0f), mSurfaceArea(0.0f), mStatsBuffer(-1), mStats(), mSourceCount(0), mOrder(-1), mOrderSlots(0), mSortedSlots(0) {}
+
+	void Reserve(int count); // grows the stroke buffer, keeping it if it is big enough
+	void Destroy();
+
+	// Sample density strokes per unit area of the first submesh, scaled to unit size by mScaleFactor.
+	// The samples only depend on the mesh and density, so reseeding gives the same strokes.
+	void SeedMesh(const MeshData& mesh, float density);
+	BrushSources MeshSources() const;
+
+	// brush_comp.glsl must be current with its M, mode, mesh_d, mesh_range, scale and viewport uniforms
+	// set, and the scene uniform block up to date
+	void Generate(const BrushSources& sources, const BrushCulling& culling);
+
+	// Back to front order of the last generated strokes for the current eye, drawn with
+	// STROKE_ORDER_BACK_TO_FRONT. stroke_sort_comp.glsl must be current and the scene uniform block
+	// up to date. The slots are the strokes drawn according to mStats, rounded up to a power of two;
+	// log2(slots)^2 / 2 dispatches over every slot, so meant for the reference only. While the stats
+	// lag behind a growing stroke count, the strokes past the slots are drawn last, unsorted.
+	void Sort();
+
+	// brush_vs.glsl and brush_fs.glsl must be current; binds GL_DRAW_INDIRECT_BUFFER
+	void Draw();
+};
@@ -0,0 +1,70 @@
+#include "CameraPath.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+bool LoadCameraPath(const std::string& filename, std::vector<CameraKey>& keys)
+{
+	std::ifstream in(filename.c_str());
+	if (!in)
+	{
+		std::cout << "Could not open camera path " << filename << std::endl;
+		return false;
+	}
+
+	keys.clear();
+	std::string line;
+	int line_number = 0;
+	while (std::getline(in, line))
+	{
+		line_number++;
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+		std::istringstream fields(line);
+		CameraKey key;
+		if (!(fields >> key.frame >> key.eye.x >> key.eye.y >> key.eye.z >> key.angle))
+		{
+			std::cout << filename << ":" << line_number << ": expected frame eye_x eye_y eye_z angle" << std::endl;
+			return false;
+		}
+		if (!keys.empty() && key.frame <= keys.back().frame)
+		{
+			std::cout << filename << ":" << line_number << ": keys must be in increasing frame order" << std::endl;
+			return false;
+		}
+		keys.push_back(key);
+	}
+
+	if (keys.empty())
+	{
+		std::cout << filename << " has no camera keys" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+CameraKey SampleCameraPath(const std::vector<CameraKey>& keys, float frame)
+{
+	if (frame <= keys.front().frame)
+	{
+		return keys.front();
+	}
+	for (size_t i = 1; i < keys.size(); i++)
+	{
+		if (frame < keys[i].frame)
+		{
+			const CameraKey& a = keys[i - 1];
+			const CameraKey& b = keys[i];
+			const float t = (frame - a.frame) / (b.frame - a.frame);
+			CameraKey key;
+			key.frame = frame;
+			key.eye = glm::mix(a.eye, b.eye, t);
+			key.angle = glm::mix(a.angle, b.angle, t);
+			return key;
+		}
+	}
+	return keys.back();
+}
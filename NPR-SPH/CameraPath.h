@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+/*
+Keyframed camera for offscreen renders.
+
+A camera path file has one key per line: frame eye_x eye_y eye_z angle
+where angle is the model rotation about y that the interactive app puts on a slider. Lines starting
+with # are comments. Keys must be in increasing frame order; frames between keys are interpolated
+linearly and frames outside the path hold the first or last key.
+*/
+
+struct CameraKey
+{
+	float frame;
+	glm::vec3 eye;
+	float angle;
+};
+
+bool LoadCameraPath(const std::string& filename, std::vector<CameraKey>& keys);
+CameraKey SampleCameraPath(const std::vector<CameraKey>& keys, float frame); // keys must not be empty
@@ -0,0 +1,208 @@
+#include "Checkpoint.h"
+#include "Profiler.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char checkpoint_magic[8] = { 'N', 'P', 'R', 'S', 'P', 'H', 'C', 'K' };
+
+static std::thread save_thread;
+static std::atomic<bool> save_in_progress(false);
+
+static uint64_t align_up(uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+static bool write_checkpoint(const std::string& filename, const CheckpointState& state)
+{
+	CheckpointHeader header = {};
+	memcpy(header.magic, checkpoint_magic, sizeof(header.magic));
+	header.version = CHECKPOINT_VERSION;
+	header.header_size = sizeof(CheckpointHeader);
+	header.particle_size = sizeof(Particle);
+	header.num_particles = (uint32_t)state.particles.size();
+	header.payload_offset = align_up(sizeof(CheckpointHeader), CHECKPOINT_ALIGNMENT);
+	header.payload_size = (uint64_t)state.particles.size() * sizeof(Particle);
+	header.constants = state.constants;
+	header.boundary = state.boundary;
+	header.time_step = state.time_step;
+	header.frame = state.frame;
+
+	// write to a temporary file first so a crash never leaves a truncated checkpoint behind
+	const std::string tmp_filename = filename + ".tmp";
+	FILE* fp = fopen(tmp_filename.c_str(), "wb");
+	if (fp == NULL)
+	{
+		fprintf(stderr, "Could not open checkpoint file %s\n", tmp_filename.c_str());
+		return false;
+	}
+
+	std::vector<char> padding(header.payload_offset - sizeof(CheckpointHeader), 0);
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	ok = ok && (padding.empty() || fwrite(padding.data(), padding.size(), 1, fp) == 1);
+	ok = ok && (header.payload_size == 0 || fwrite(state.particles.data(), header.payload_size, 1, fp) == 1);
+	ok = (fclose(fp) == 0) && ok;
+
+	if (!ok)
+	{
+		fprintf(stderr, "Error while writing checkpoint %s\n", tmp_filename.c_str());
+		remove(tmp_filename.c_str());
+		return false;
+	}
+
+	remove(filename.c_str()); // rename does not overwrite on Windows
+	if (rename(tmp_filename.c_str(), filename.c_str()) != 0)
+	{
+		fprintf(stderr, "Could not rename %s to %s\n", tmp_filename.c_str(), filename.c_str());
+		return false;
+	}
+
+	printf("Saved checkpoint %s (frame %u, %u particles)\n", filename.c_str(), header.frame, header.num_particles);
+	return true;
+}
+
+bool SaveCheckpointAsync(const std::string& filename, CheckpointState&& state)
+{
+	if (save_in_progress.load())
+	{
+		return false;
+	}
+
+	if (save_thread.joinable())
+	{
+		save_thread.join(); // previous save already finished, just reclaim the thread
+	}
+
+	save_in_progress.store(true);
+	save_thread = std::thread([filename, state = std::move(state)]()
+	{
+		ProfilerSetThreadName("checkpoint save");
+		PROFILE_SCOPE("write_checkpoint");
+		write_checkpoint(filename, state);
+		save_in_progress.store(false);
+	});
+	return true;
+}
+
+bool CheckpointSaveInProgress()
+{
+	return save_in_progress.load();
+}
+
+void WaitForCheckpoint()
+{
+	if (save_thread.joinable())
+	{
+		save_thread.join();
+	}
+}
+
+static bool validate_header(const std::string& filename, const CheckpointView* view)
+{
+	const CheckpointHeader* header = view->header;
+	if (view->mapping_size < sizeof(CheckpointHeader) || memcmp(header->magic, checkpoint_magic, sizeof(header->magic)) != 0)
+	{
+		fprintf(stderr, "%s is not a checkpoint file\n", filename.c_str());
+		return false;
+	}
+	if (header->version != CHECKPOINT_VERSION || header->header_size != sizeof(CheckpointHeader) || header->particle_size != sizeof(Particle))
+	{
+		fprintf(stderr, "%s has unsupported checkpoint version %u\n", filename.c_str(), header->version);
+		return false;
+	}
+	if (header->payload_offset % CHECKPOINT_ALIGNMENT != 0 ||
+		header->payload_size != (uint64_t)header->num_particles * sizeof(Particle) ||
+		header->payload_offset + header->payload_size > view->mapping_size)
+	{
+		fprintf(stderr, "%s is truncated or corrupt\n", filename.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool MapCheckpoint(const std::string& filename, CheckpointView* view)
+{
+	*view = CheckpointView();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		fprintf(stderr, "Couldn't open checkpoint %s\n", filename.c_str());
+		return false;
+	}
+	LARGE_INTEGER size;
+	GetFileSizeEx(file, &size);
+	HANDLE map = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	void* base = map != NULL ? MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if (base == NULL)
+	{
+		fprintf(stderr, "Couldn't map checkpoint %s\n", filename.c_str());
+		if (map != NULL) CloseHandle(map);
+		CloseHandle(file);
+		return false;
+	}
+	view->file_handle = file;
+	view->map_handle = map;
+	view->mapping_size = (size_t)size.QuadPart;
+#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		fprintf(stderr, "Couldn't open checkpoint %s\n", filename.c_str());
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		fprintf(stderr, "Couldn't stat checkpoint %s\n", filename.c_str());
+		close(fd);
+		return false;
+	}
+	void* base = st.st_size > 0 ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd); // the mapping keeps its own reference to the file
+	if (base == MAP_FAILED)
+	{
+		fprintf(stderr, "Couldn't map checkpoint %s\n", filename.c_str());
+		return false;
+	}
+	view->mapping_size = (size_t)st.st_size;
+#endif
+
+	view->mapping = base;
+	view->header = (const CheckpointHeader*)base;
+	if (!validate_header(filename, view))
+	{
+		UnmapCheckpoint(view);
+		return false;
+	}
+	view->particles = (const Particle*)((const char*)base + view->header->payload_offset);
+	return true;
+}
+
+void UnmapCheckpoint(CheckpointView* view)
+{
+	if (view->mapping != nullptr)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(view->mapping);
+		CloseHandle((HANDLE)view->map_handle);
+		CloseHandle((HANDLE)view->file_handle);
+#else
+		munmap(view->mapping, view->mapping_size);
+#endif
+	}
+	*view = CheckpointView();
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Simulation.h"
+
+/*
+Binary checkpoints of the simulation state.
+
+File layout (version 1):
+	CheckpointHeader       at offset 0
+	zero padding           up to payload_offset
+	Particle[num_particles] at payload_offset (multiple of CHECKPOINT_ALIGNMENT)
+
+Because the payload is page aligned and stored exactly as it lives in particles_ssbo,
+restoring is a single file mapping followed by one buffer upload.
+*/
+
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_ALIGNMENT 4096
+
+struct CheckpointHeader
+{
+	char magic[8]; // "NPRSPHCK"
+	uint32_t version;
+	uint32_t header_size; // sizeof(CheckpointHeader), catches layout changes
+	uint32_t particle_size; // sizeof(Particle)
+	uint32_t num_particles;
+	uint64_t payload_offset; // byte offset of the particle array, page aligned
+	uint64_t payload_size; // num_particles * particle_size
+	ConstantsUniform constants;
+	BoundaryUniform boundary;
+	float time_step;
+	uint32_t frame;
+};
+
+// Everything needed to resume a simulation
+struct CheckpointState
+{
+	std::vector<Particle> particles;
+	ConstantsUniform constants;
+	BoundaryUniform boundary;
+	float time_step = 0.0f;
+	uint32_t frame = 0;
+};
+
+// Read-only view of a mapped checkpoint file. The pointers stay valid until UnmapCheckpoint().
+struct CheckpointView
+{
+	const CheckpointHeader* header = nullptr;
+	const Particle* particles = nullptr;
+
+	void* mapping = nullptr; // base address of the mapped file
+	size_t mapping_size = 0;
+#ifdef _WIN32
+	void* file_handle = nullptr;
+	void* map_handle = nullptr;
+#endif
+};
+
+// Writes the checkpoint on a background thread. Returns false if a save is already running.
+bool SaveCheckpointAsync(const std::string& filename, CheckpointState&& state);
+bool CheckpointSaveInProgress();
+void WaitForCheckpoint(); // blocks until a pending save has finished
+
+bool MapCheckpoint(const std::string& filename, CheckpointView* view);
+void UnmapCheckpoint(CheckpointView* view);
@@ -1,6 +1,106 @@
 #include "DebugCallback.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <iostream>
+#include <map>
+#ifndef _WIN32
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#endif
+
+bool debug_break_on_error = true;
+
+// Messages waiting for FlushDebugMessages(). Multi-producer ring with a sequence number per slot,
+// so the callback never takes a lock even if the driver calls it from several threads.
+#define DEBUG_QUEUE_SIZE 1024 // power of two
+#define DEBUG_MESSAGE_LENGTH 256 // longer messages are truncated
+
+struct QueuedMessage
+{
+    std::atomic<unsigned int> sequence;
+    GLenum source, type, severity;
+    GLuint id;
+    char text[DEBUG_MESSAGE_LENGTH];
+};
+
+static QueuedMessage queue[DEBUG_QUEUE_SIZE];
+static std::atomic<unsigned int> queue_head(0); // next slot to write
+static unsigned int queue_tail = 0; // next slot to read, only touched by the flushing thread
+static std::atomic<unsigned int> dropped(0);
+static std::atomic<bool> queue_ready(false);
+
+// ids already reported, so the first occurrence of an error can break into the debugger
+#define SEEN_IDS_SIZE 4096 // power of two
+static std::atomic<unsigned long long> seen_ids[SEEN_IDS_SIZE];
+
+// aggregated by the flushing thread
+static std::map<unsigned long long, DebugMessageEntry> messages; // keyed by source, type and id
+static std::map<GLenum, unsigned int> source_counts, type_counts, severity_counts;
+static unsigned int total_messages = 0;
+static std::chrono::steady_clock::time_point last_summary;
+
+static unsigned long long message_key(GLenum source, GLenum type, GLuint id)
+{
+    // GL_DEBUG_SOURCE_* and GL_DEBUG_TYPE_* fit in 16 bits above their common base
+    return ((unsigned long long)(source & 0xffff) << 48) | ((unsigned long long)(type & 0xffff) << 32) | id;
+}
+
+// Returns true the first time key is seen. Lock free; once the table is full everything counts as seen.
+static bool first_occurrence(unsigned long long key)
+{
+    const unsigned long long stored = key + 1; // 0 marks an empty slot
+    unsigned int slot = (unsigned int)(key ^ (key >> 29)) & (SEEN_IDS_SIZE - 1);
+    for (int probe = 0; probe < SEEN_IDS_SIZE; probe++)
+    {
+        unsigned long long expected = 0;
+        if (seen_ids[slot].compare_exchange_strong(expected, stored))
+        {
+            return true;
+        }
+        if (expected == stored)
+        {
+            return false;
+        }
+        slot = (slot + 1) & (SEEN_IDS_SIZE - 1);
+    }
+    return false;
+}
+
+#ifndef _WIN32
+// a tracer's pid in /proc/self/status, 0 when nothing is attached
+static bool debugger_attached()
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.compare(0, 10, "TracerPid:") == 0)
+        {
+            return atoi(line.c_str() + 10) != 0;
+        }
+    }
+    return false;
+}
+#endif
 
+static void debug_break()
+{
+#ifdef _WIN32
+    if (IsDebuggerPresent())
+    {
+        __debugbreak();
+    }
+#else
+    // without a debugger to catch it SIGTRAP would end the process
+    if (debugger_attached())
+    {
+        raise(SIGTRAP);
+    }
+#endif
+}
 
 void RegisterCallback()
 {
@@ -8,6 +108,14 @@ void RegisterCallback()
     if (glDebugMessageCallback)
     {
         std::cout << "Register OpenGL debug callback " << std::endl;
+        for (unsigned int i = 0; i < DEBUG_QUEUE_SIZE; i++)
+        {
+            queue[i].sequence.store(i);
+        }
+        queue_ready.store(true);
+        last_summary = std::chrono::steady_clock::now();
+
+        // synchronous output puts the offending GL call on the stack when we break on an error
         glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
         glDebugMessageCallback(openglCallbackFunction, nullptr);
         GLuint unusedIds = 0;
@@ -31,49 +139,212 @@ void APIENTRY openglCallbackFunction(GLenum source,
     GLenum severity,
     GLsizei length,
     const GLchar* message,
-    const void* userParam)
+    const void* /*userParam*/)
+{
+    if (!queue_ready.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    if ((type == GL_DEBUG_TYPE_ERROR || severity == GL_DEBUG_SEVERITY_HIGH) && debug_break_on_error && first_occurrence(message_key(source, type, id)))
+    {
+        debug_break(); // look one frame up the stack for the call that caused it
+    }
+
+    // claim a slot; give up instead of waiting if the flusher is a full queue behind
+    unsigned int pos = queue_head.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        QueuedMessage& slot = queue[pos & (DEBUG_QUEUE_SIZE - 1)];
+        const unsigned int seq = slot.sequence.load(std::memory_order_acquire);
+        const int diff = (int)(seq - pos);
+        if (diff == 0)
+        {
+            if (queue_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            pos = queue_head.load(std::memory_order_relaxed);
+        }
+    }
+
+    QueuedMessage& slot = queue[pos & (DEBUG_QUEUE_SIZE - 1)];
+    slot.source = source;
+    slot.type = type;
+    slot.severity = severity;
+    slot.id = id;
+    const size_t n = length >= 0 ? (size_t)length : strlen(message);
+    const size_t copy = n < DEBUG_MESSAGE_LENGTH - 1 ? n : DEBUG_MESSAGE_LENGTH - 1;
+    memcpy(slot.text, message, copy);
+    slot.text[copy] = '\0';
+    slot.sequence.store(pos + 1, std::memory_order_release);
+}
+
+void FlushDebugMessages()
 {
+    if (!queue_ready.load())
+    {
+        return;
+    }
+
+    int printed = 0;
+    for (;;)
+    {
+        QueuedMessage& slot = queue[queue_tail & (DEBUG_QUEUE_SIZE - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != queue_tail + 1)
+        {
+            break; // empty, or the next message is still being written
+        }
+
+        const unsigned long long key = message_key(slot.source, slot.type, slot.id);
+        std::map<unsigned long long, DebugMessageEntry>::iterator it = messages.find(key);
+        if (it == messages.end())
+        {
+            DebugMessageEntry entry;
+            entry.source = slot.source;
+            entry.type = slot.type;
+            entry.severity = slot.severity;
+            entry.id = slot.id;
+            entry.count = 0;
+            entry.text = slot.text;
+            it = messages.insert(std::make_pair(key, entry)).first;
+
+            // only the first occurrence is printed, and only a few per flush
+            if (printed++ < 8)
+            {
+                std::cout << "GL " << DebugSeverityName(slot.severity) << " " << DebugTypeName(slot.type) << " (" << DebugSourceName(slot.source) << ", id " << slot.id << "): " << slot.text << std::endl;
+            }
+        }
+        it->second.count++;
+        source_counts[slot.source]++;
+        type_counts[slot.type]++;
+        severity_counts[slot.severity]++;
+        total_messages++;
+
+        slot.sequence.store(queue_tail + DEBUG_QUEUE_SIZE, std::memory_order_release); // hand the slot back to producers
+        queue_tail++;
+    }
+
+    // repeated messages only show up in the periodic summary
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (total_messages > 0 && now - last_summary > std::chrono::seconds(10))
+    {
+        last_summary = now;
+        std::cout << "GL debug: " << total_messages << " messages, " << messages.size() << " distinct, "
+            << type_counts[GL_DEBUG_TYPE_ERROR] << " errors, " << type_counts[GL_DEBUG_TYPE_PERFORMANCE] << " performance warnings";
+        if (dropped.load() > 0)
+        {
+            std::cout << ", " << dropped.load() << " dropped";
+        }
+        std::cout << std::endl;
+    }
+}
+
+std::vector<DebugMessageEntry> DebugMessageList()
+{
+    std::vector<DebugMessageEntry> list;
+    for (std::map<unsigned long long, DebugMessageEntry>::const_iterator it = messages.begin(); it != messages.end(); ++it)
+    {
+        list.push_back(it->second);
+    }
+    return list;
+}
+
+unsigned int DebugMessageCount()
+{
+    return total_messages;
+}
+
+unsigned int DebugSourceCount(GLenum source)
+{
+    std::map<GLenum, unsigned int>::const_iterator it = source_counts.find(source);
+    return it != source_counts.end() ? it->second : 0;
+}
 
-    using namespace std;
+unsigned int DebugTypeCount(GLenum type)
+{
+    std::map<GLenum, unsigned int>::const_iterator it = type_counts.find(type);
+    return it != type_counts.end() ? it->second : 0;
+}
 
-    cout << "---------------------opengl-callback-start------------" << endl;
-    cout << "message: " << message << endl;
-    cout << "type: ";
+unsigned int DebugSeverityCount(GLenum severity)
+{
+    std::map<GLenum, unsigned int>::const_iterator it = severity_counts.find(severity);
+    return it != severity_counts.end() ? it->second : 0;
+}
+
+unsigned int DebugMessagesDropped()
+{
+    return dropped.load();
+}
+
+void ClearDebugMessages()
+{
+    messages.clear();
+    source_counts.clear();
+    type_counts.clear();
+    severity_counts.clear();
+    total_messages = 0;
+    dropped.store(0);
+}
+
+const char* DebugSourceName(GLenum source)
+{
+    switch (source) {
+    case GL_DEBUG_SOURCE_API:
+        return "API";
+    case GL_DEBUG_SOURCE_WINDOW_SYSTEM:
+        return "WINDOW_SYSTEM";
+    case GL_DEBUG_SOURCE_SHADER_COMPILER:
+        return "SHADER_COMPILER";
+    case GL_DEBUG_SOURCE_THIRD_PARTY:
+        return "THIRD_PARTY";
+    case GL_DEBUG_SOURCE_APPLICATION:
+        return "APPLICATION";
+    case GL_DEBUG_SOURCE_OTHER:
+        return "OTHER";
+    }
+    return "UNKNOWN";
+}
+
+const char* DebugTypeName(GLenum type)
+{
     switch (type) {
     case GL_DEBUG_TYPE_ERROR:
-        cout << "ERROR";
-        break;
+        return "ERROR";
     case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:
-        cout << "DEPRECATED_BEHAVIOR";
-        break;
+        return "DEPRECATED_BEHAVIOR";
     case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:
-        cout << "UNDEFINED_BEHAVIOR";
-        break;
+        return "UNDEFINED_BEHAVIOR";
     case GL_DEBUG_TYPE_PORTABILITY:
-        cout << "PORTABILITY";
-        break;
+        return "PORTABILITY";
     case GL_DEBUG_TYPE_PERFORMANCE:
-        cout << "PERFORMANCE";
-        break;
+        return "PERFORMANCE";
     case GL_DEBUG_TYPE_OTHER:
-        cout << "OTHER";
-        break;
+        return "OTHER";
     }
-    cout << endl;
+    return "UNKNOWN";
+}
 
-    cout << "id: " << id << endl;
-    cout << "severity: ";
+const char* DebugSeverityName(GLenum severity)
+{
     switch (severity) {
     case GL_DEBUG_SEVERITY_LOW:
-        cout << "LOW";
-        break;
+        return "LOW";
     case GL_DEBUG_SEVERITY_MEDIUM:
-        cout << "MEDIUM";
-        break;
+        return "MEDIUM";
     case GL_DEBUG_SEVERITY_HIGH:
-        cout << "HIGH";
-        break;
+        return "HIGH";
+    case GL_DEBUG_SEVERITY_NOTIFICATION:
+        return "NOTIFICATION";
     }
-    cout << endl;
-    cout << "---------------------opengl-callback-end--------------" << endl;
-}
\ No newline at end of file
+    return "UNKNOWN";
+}
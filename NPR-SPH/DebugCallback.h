@@ -1,7 +1,12 @@
 #pragma once
 
+#ifdef _WIN32
 #include <windows.h>
+#endif
 #include <GL/glew.h>
+#ifndef APIENTRY
+#define APIENTRY // comes from windows.h; glew.h undefines its own copy at the end
+#endif
 
 
 /*
@@ -28,9 +33,40 @@ You can do this by calling RegisterCallback(); after glewInit(). Be sure to incl
 
 */
 
-/* 3. You will see a lot of output on the text console when it is working. Not only errors are reported
-by default. You will also see a lot of performance warnings and other messages (specifics depend on driver).
+/* 3. Call FlushDebugMessages(); once per frame. The callback itself only copies each message into a
+lock-free queue. Flushing deduplicates them by source, type and id, keeps counts per source, type and
+severity, and prints the first occurrence of each distinct message plus a summary every few seconds.
+Use DebugMessageList(); to show them in a GUI, performance warnings included.
+
+The first occurrence of an error or high severity message breaks into the debugger while
+debug_break_on_error is set.
 */
+#include <string>
+#include <vector>
+
+struct DebugMessageEntry
+{
+    GLenum source, type, severity;
+    GLuint id;
+    unsigned int count;
+    std::string text; // text of the first occurrence
+};
+
+extern bool debug_break_on_error;
+
 void RegisterCallback();
+void FlushDebugMessages();
+void ClearDebugMessages();
+
+std::vector<DebugMessageEntry> DebugMessageList();
+unsigned int DebugMessageCount();
+unsigned int DebugSourceCount(GLenum source);
+unsigned int DebugTypeCount(GLenum type);
+unsigned int DebugSeverityCount(GLenum severity);
+unsigned int DebugMessagesDropped(); // lost because the queue was full
+
+const char* DebugSourceName(GLenum source);
+const char* DebugTypeName(GLenum type);
+const char* DebugSeverityName(GLenum severity);
 
 void APIENTRY openglCallbackFunction(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam);
\ No newline at end of file
@@ -0,0 +1,107 @@
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+bool GpuPassScalesWithResolution(int pass)
+{
+	switch (pass)
+	{
+	case GPU_PASS_FLUID_DEPTH:
+	case GPU_PASS_FLUID_SMOOTH:
+	case GPU_PASS_FBO:
+	case GPU_PASS_SCREEN:
+	case GPU_PASS_EDGES:
+	case GPU_PASS_BRUSH:
+		return true;
+	}
+	return false;
+}
+
+void DynamicResolution::Update(const GpuTimers& timers)
+{
+	mScale = std::min(std::max(mScale, mMinScale), mMaxScale);
+	if (!mEnabled || timers.mHistoryCount == 0)
+	{
+		return;
+	}
+
+	// newest collected frame, skipped if it was seen already or drawn before the last change
+	const unsigned int frame = timers.LastFrame();
+	if (frame == mLastFrame || frame < mChangeFrame)
+	{
+		return;
+	}
+	mLastFrame = frame;
+
+	float scaled_ms = 0.0f, fixed_ms = 0.0f;
+	for (int p = 0; p < GPU_PASS_COUNT; p++)
+	{
+		const float ms = timers.LastMs(p);
+		if (ms > 0.0f)
+		{
+			(GpuPassScalesWithResolution(p) ? scaled_ms : fixed_ms) += ms;
+		}
+	}
+	const float smoothing = mSamples == 0 ? 1.0f : 0.3f;
+	mScaledMs += smoothing * (scaled_ms - mScaledMs);
+	mFixedMs += smoothing * (fixed_ms - mFixedMs);
+	mSamples++;
+	if (mSamples < DYNRES_SETTLE_SAMPLES || mScaledMs <= 0.0f)
+	{
+		return;
+	}
+
+	// scale whose pixel count fits the time left after the fixed passes
+	const float budget_ms = mTargetMs - mFixedMs;
+	const char* reason;
+	float wanted;
+	if (budget_ms <= 0.0f)
+	{
+		wanted = mMinScale;
+		reason = "fixed passes alone exceed the target";
+	}
+	else
+	{
+		wanted = mScale * std::sqrt(budget_ms / mScaledMs);
+		reason = wanted < mScale ? "over budget" : "under budget";
+	}
+	wanted = std::min(std::max(wanted, mMinScale), mMaxScale);
+	if (std::fabs(wanted - mScale) < 0.05f * mScale)
+	{
+		return; // close enough, changing would only make the image shimmer
+	}
+
+	// half way, in steps of 1/64 so small corrections don't resize every frame
+	float next = std::round((mScale + 0.5f * (wanted - mScale)) * 64.0f) / 64.0f;
+	next = std::min(std::max(next, mMinScale), mMaxScale);
+	if (next == mScale)
+	{
+		return;
+	}
+
+	DynamicResolutionDecision& decision = mDecisions[mDecisionHead];
+	decision.frame = timers.mFrame;
+	decision.scaled_ms = mScaledMs;
+	decision.fixed_ms = mFixedMs;
+	decision.old_scale = mScale;
+	decision.new_scale = next;
+	decision.reason = reason;
+	mDecisionHead = (mDecisionHead + 1) % DYNRES_DECISIONS;
+	mDecisionCount = std::min(mDecisionCount + 1, DYNRES_DECISIONS);
+
+	mScale = next;
+	mChangeFrame = timers.mFrame; // Update() runs before the frame's passes, so this frame uses the new scale
+	mSamples = 0;
+}
+
+void DynamicResolution::RenderSize(int width, int height, int* render_width, int* render_height) const
+{
+	*render_width = std::max(1, std::min(width, (int)std::lround(width * mScale)));
+	*render_height = std::max(1, std::min(height, (int)std::lround(height * mScale)));
+}
+
+const DynamicResolutionDecision& DynamicResolution::Decision(int i) const
+{
+	return mDecisions[(mDecisionHead + DYNRES_DECISIONS - 1 - i) % DYNRES_DECISIONS];
+}
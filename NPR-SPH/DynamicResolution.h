@@ -0,0 +1,65 @@
+#pragma once
+
+#include "GpuTimer.h"
+
+/*
+Dynamic resolution.
+
+Everything up to the brush strokes (fluid surface, G-buffer, outline composite, edge map and
+strokes) is drawn into internal targets at mScale times the window size, then upscaled to the
+window by upscale_fs.glsl. Update() runs once per frame after GpuTimers::BeginFrame() and steers
+the scale to hold the GPU frame time at mTargetMs:
+
+- the passes are split into those that scale with the pixel count and the rest (simulation,
+  stroke generation, upscale, capture, GUI), each smoothed over a few frames;
+- the pixel budget is the target minus the fixed passes, and the scale that meets it assumes the
+  scaled passes cost in proportion to the pixel count, i.e. the square of the scale;
+- the scale moves half way there per decision and only when it is off by more than 5%. After a
+  change the controller waits for timings of frames drawn at the new scale.
+
+The last few decisions are kept for the GUI.
+*/
+
+#define DYNRES_DECISIONS 8
+#define DYNRES_SETTLE_SAMPLES 4 // timings at a new scale to collect before deciding again
+
+struct DynamicResolutionDecision
+{
+	unsigned int frame;
+	float scaled_ms; // smoothed time of the passes that scale with the resolution
+	float fixed_ms;
+	float old_scale;
+	float new_scale;
+	const char* reason;
+};
+
+struct DynamicResolution
+{
+	bool mEnabled;
+	float mTargetMs;
+	float mMinScale;
+	float mMaxScale;
+	float mScale; // current, also the manual scale when disabled
+
+	float mScaledMs; // smoothed over the samples since the last change
+	float mFixedMs;
+	int mSamples;
+	unsigned int mLastFrame; // GpuTimers frame of the newest sample used
+	unsigned int mChangeFrame; // first frame drawn at mScale
+
+	DynamicResolutionDecision mDecisions[DYNRES_DECISIONS]; // ring, newest at mDecisionHead - 1
+	int mDecisionHead;
+	int mDecisionCount;
+
+	DynamicResolution() : mEnabled(true), mTargetMs(1000.0f / 60.0f), mMinScale(0.5f), mMaxScale(1.0f), mScale(1.0f),
+		mScaledMs(0.0f), mFixedMs(0.0f), mSamples(0), mLastFrame(0), mChangeFrame(0), mDecisionHead(0), mDecisionCount(0) {}
+
+	void Update(const GpuTimers& timers);
+
+	// size of the internal targets for a window of width x height
+	void RenderSize(int width, int height, int* render_width, int* render_height) const;
+
+	const DynamicResolutionDecision& Decision(int i) const; // 0 is the newest, i < mDecisionCount
+};
+
+bool GpuPassScalesWithResolution(int pass);
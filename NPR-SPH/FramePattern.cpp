@@ -0,0 +1,42 @@
+#include "FramePattern.h"
+
+#include <cstdio>
+#include <cstring>
+
+bool IsFramePattern(const std::string& pattern)
+{
+	int conversions = 0;
+	for (size_t i = 0; i < pattern.size(); i++)
+	{
+		if (pattern[i] != '%')
+		{
+			continue;
+		}
+		i++;
+		if (i < pattern.size() && pattern[i] == '%')
+		{
+			continue;
+		}
+		while (i < pattern.size() && strchr("-+ #0", pattern[i]) != NULL)
+		{
+			i++;
+		}
+		while (i < pattern.size() && pattern[i] >= '0' && pattern[i] <= '9')
+		{
+			i++;
+		}
+		if (i == pattern.size() || strchr("diu", pattern[i]) == NULL)
+		{
+			return false;
+		}
+		conversions++;
+	}
+	return conversions == 1;
+}
+
+std::string FrameFilename(const std::string& pattern, int frame)
+{
+	char filename[512];
+	snprintf(filename, sizeof(filename), pattern.c_str(), frame);
+	return filename;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+
+/*
+Output names of image sequences, e.g. frame%04d.png.
+
+The name is a printf format with the frame number as its only argument. It comes from the command
+line or a job file, so it is checked before it reaches snprintf: exactly one integer conversion
+(%d, %i or %u with flags and a width, e.g. %04d) and no other % but %%.
+*/
+
+bool IsFramePattern(const std::string& pattern);
+
+// pattern with frame filled in; pattern must pass IsFramePattern()
+std::string FrameFilename(const std::string& pattern, int frame);
@@ -0,0 +1,276 @@
+#include "GpuMemory.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+
+// All GL calls happen on the render thread, so the registry needs no locking
+static std::map<std::pair<int, GLuint>, GpuResource> resources;
+
+const char* GpuResourceKindName(int kind)
+{
+	switch (kind)
+	{
+	case GPU_RESOURCE_BUFFER:
+		return "buffer";
+	case GPU_RESOURCE_TEXTURE:
+		return "texture";
+	case GPU_RESOURCE_RENDERBUFFER:
+		return "renderbuffer";
+	case GPU_RESOURCE_PROGRAM:
+		return "program";
+	}
+	return "unknown";
+}
+
+size_t GpuBytesPerTexel(GLenum internal_format)
+{
+	switch (internal_format)
+	{
+	case GL_R8:
+	case GL_RED:
+		return 1;
+	case GL_RG8:
+	case GL_R16F:
+	case GL_DEPTH_COMPONENT16:
+		return 2;
+	case GL_DEPTH_COMPONENT24: // stored in 32 bits
+	case GL_DEPTH_COMPONENT:
+	case GL_DEPTH_COMPONENT32F:
+	case GL_DEPTH24_STENCIL8:
+	case GL_R32F:
+	case GL_RG16F:
+	case GL_RG16I:
+	case GL_RGB: // padded to 4 bytes by most drivers
+	case GL_RGB8:
+	case GL_RGBA:
+	case GL_RGBA8:
+		return 4;
+	case GL_RG32F:
+	case GL_RGB16F: // padded like GL_RGB
+	case GL_RGBA16F:
+		return 8;
+	case GL_RGB32F:
+		return 12;
+	case GL_RGBA32F:
+		return 16;
+	}
+	return 4;
+}
+
+static void track(int kind, GLuint name, GLenum target, GLenum usage, size_t bytes, const char* owner)
+{
+	GpuResource& r = resources[std::make_pair(kind, name)];
+	r.kind = kind;
+	r.name = name;
+	r.target = target;
+	r.usage = usage;
+	r.bytes = bytes;
+	r.owner = owner;
+}
+
+static void untrack(int kind, GLuint name)
+{
+	resources.erase(std::make_pair(kind, name));
+}
+
+GLuint GpuCreateBuffer(GLenum target, GLsizeiptr size, const void* data, GLenum usage, const char* owner, GLbitfield flags)
+{
+	GLuint buffer = -1;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(target, buffer);
+	if (usage == 0)
+	{
+		glBufferStorage(target, size, data, flags);
+	}
+	else
+	{
+		glBufferData(target, size, data, usage);
+	}
+	track(GPU_RESOURCE_BUFFER, buffer, target, usage, size, owner);
+	return buffer;
+}
+
+void GpuDeleteBuffer(GLuint* buffer)
+{
+	if (*buffer == -1)
+	{
+		return;
+	}
+	glDeleteBuffers(1, buffer);
+	untrack(GPU_RESOURCE_BUFFER, *buffer);
+	*buffer = -1;
+}
+
+void GpuResizeBuffer(GLuint buffer, GLsizeiptr size)
+{
+	std::map<std::pair<int, GLuint>, GpuResource>::iterator it = resources.find(std::make_pair((int)GPU_RESOURCE_BUFFER, buffer));
+	if (it != resources.end())
+	{
+		it->second.bytes = size;
+	}
+}
+
+GLuint GpuCreateTexture2D(GLint internal_format, int width, int height, GLenum format, GLenum type, const void* data, const char* owner)
+{
+	GLuint texture = -1;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, type, data);
+	track(GPU_RESOURCE_TEXTURE, texture, GL_TEXTURE_2D, internal_format, (size_t)width * height * GpuBytesPerTexel(internal_format), owner);
+	return texture;
+}
+
+GLuint GpuCreateTextureStorage2D(GLenum internal_format, int width, int height, const char* owner)
+{
+	GLuint texture = -1;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, internal_format, width, height);
+	track(GPU_RESOURCE_TEXTURE, texture, GL_TEXTURE_2D, internal_format, (size_t)width * height * GpuBytesPerTexel(internal_format), owner);
+	return texture;
+}
+
+GLuint GpuCreateTextureView(GLuint texture, GLenum internal_format, const char* owner)
+{
+	GLuint view = -1;
+	glGenTextures(1, &view); // a view needs a name that was never bound
+	glTextureView(view, GL_TEXTURE_2D, texture, internal_format, 0, 1, 0, 1);
+	glBindTexture(GL_TEXTURE_2D, view);
+	track(GPU_RESOURCE_TEXTURE, view, GL_TEXTURE_2D, internal_format, 0, owner);
+	return view;
+}
+
+void GpuDeleteTexture(GLuint* texture)
+{
+	if (*texture == -1)
+	{
+		return;
+	}
+	glDeleteTextures(1, texture);
+	untrack(GPU_RESOURCE_TEXTURE, *texture);
+	*texture = -1;
+}
+
+GLuint GpuCreateRenderbuffer(GLenum internal_format, int width, int height, const char* owner)
+{
+	GLuint renderbuffer = -1;
+	glGenRenderbuffers(1, &renderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, internal_format, width, height);
+	track(GPU_RESOURCE_RENDERBUFFER, renderbuffer, GL_RENDERBUFFER, internal_format, (size_t)width * height * GpuBytesPerTexel(internal_format), owner);
+	return renderbuffer;
+}
+
+void GpuDeleteRenderbuffer(GLuint* renderbuffer)
+{
+	if (*renderbuffer == -1)
+	{
+		return;
+	}
+	glDeleteRenderbuffers(1, renderbuffer);
+	untrack(GPU_RESOURCE_RENDERBUFFER, *renderbuffer);
+	*renderbuffer = -1;
+}
+
+void GpuTrackProgram(GLuint program, const char* owner)
+{
+	if (program != -1)
+	{
+		track(GPU_RESOURCE_PROGRAM, program, 0, 0, 0, owner);
+	}
+}
+
+void GpuDeleteProgram(GLuint* program)
+{
+	if (*program == -1)
+	{
+		return;
+	}
+	glDeleteProgram(*program);
+	untrack(GPU_RESOURCE_PROGRAM, *program);
+	*program = -1;
+}
+
+size_t GpuMemoryBytes(int kind)
+{
+	size_t total = 0;
+	for (std::map<std::pair<int, GLuint>, GpuResource>::const_iterator it = resources.begin(); it != resources.end(); ++it)
+	{
+		if (kind < 0 || it->second.kind == kind)
+		{
+			total += it->second.bytes;
+		}
+	}
+	return total;
+}
+
+int GpuResourceCount(int kind)
+{
+	int count = 0;
+	for (std::map<std::pair<int, GLuint>, GpuResource>::const_iterator it = resources.begin(); it != resources.end(); ++it)
+	{
+		if (kind < 0 || it->second.kind == kind)
+		{
+			count++;
+		}
+	}
+	return count;
+}
+
+std::vector<GpuResource> GpuResources()
+{
+	std::vector<GpuResource> list;
+	for (std::map<std::pair<int, GLuint>, GpuResource>::const_iterator it = resources.begin(); it != resources.end(); ++it)
+	{
+		list.push_back(it->second);
+	}
+	std::stable_sort(list.begin(), list.end(), [](const GpuResource& a, const GpuResource& b) { return a.bytes > b.bytes; });
+	return list;
+}
+
+// live objects per (kind, owner)
+static std::map<std::pair<int, std::string>, int> owner_counts()
+{
+	std::map<std::pair<int, std::string>, int> counts;
+	for (std::map<std::pair<int, GLuint>, GpuResource>::const_iterator it = resources.begin(); it != resources.end(); ++it)
+	{
+		counts[std::make_pair(it->second.kind, it->second.owner)]++;
+	}
+	return counts;
+}
+
+int GpuLeakedCount()
+{
+	int leaked = 0;
+	std::map<std::pair<int, std::string>, int> counts = owner_counts();
+	for (std::map<std::pair<int, std::string>, int>::const_iterator it = counts.begin(); it != counts.end(); ++it)
+	{
+		leaked += it->second - 1;
+	}
+	return leaked;
+}
+
+void GpuMemoryReport(bool at_exit)
+{
+	printf("GPU resources%s: %d objects, %.2f MB\n", at_exit ? " at exit" : "", GpuResourceCount(), GpuMemoryBytes() / (1024.0 * 1024.0));
+	for (int k = 0; k < GPU_RESOURCE_KIND_COUNT; k++)
+	{
+		printf("  %-12s %4d objects %10.2f MB\n", GpuResourceKindName(k), GpuResourceCount(k), GpuMemoryBytes(k) / (1024.0 * 1024.0));
+	}
+
+	std::map<std::pair<int, std::string>, int> counts = owner_counts();
+	std::vector<GpuResource> list = GpuResources();
+	for (size_t i = 0; i < list.size(); i++)
+	{
+		const GpuResource& r = list[i];
+		const int count = counts[std::make_pair(r.kind, r.owner)];
+		const char* flag = at_exit ? "  LEAK" : (count > 1 ? "  LEAK?" : "");
+		printf("  %-12s %5u %10.2f KB  %s%s\n", GpuResourceKindName(r.kind), r.name, r.bytes / 1024.0, r.owner.c_str(), flag);
+	}
+
+	if (at_exit && !list.empty())
+	{
+		printf("%d GPU objects were not deleted before exit\n", (int)list.size());
+	}
+}
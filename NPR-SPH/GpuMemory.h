@@ -0,0 +1,74 @@
+#pragma once
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+
+/*
+Registry of GPU resources.
+
+Buffers, textures and renderbuffers are created and deleted through the functions below, which
+record the size, usage and owner of each object. Programs are tracked by count only. Sizes are what
+the application asked for; drivers may pad, e.g. GL_RGB textures are usually stored with 4 bytes
+per texel, so textures are counted that way.
+
+Owners name a single role ("particles_ssbo", "compute rho_pres_comp.glsl"), so a second live object
+with the same owner means the previous one was never deleted. The registry is meant to be empty
+after shutdown; GpuMemoryReport(true) lists whatever is left as a leak.
+*/
+
+enum GpuResourceKind
+{
+	GPU_RESOURCE_BUFFER,
+	GPU_RESOURCE_TEXTURE,
+	GPU_RESOURCE_RENDERBUFFER,
+	GPU_RESOURCE_PROGRAM,
+	GPU_RESOURCE_KIND_COUNT
+};
+
+struct GpuResource
+{
+	int kind;
+	GLuint name;
+	GLenum target; // buffer binding point or texture target the object was created for
+	GLenum usage; // buffer usage hint, or internal format for textures and renderbuffers
+	size_t bytes;
+	std::string owner; // one object per owner; several live objects with the same owner are flagged as leaks
+};
+
+const char* GpuResourceKindName(int kind);
+
+// Create a buffer, leaving it bound to target. usage 0 allocates immutable storage with glBufferStorage
+// and flags, as persistently mapped buffers need.
+GLuint GpuCreateBuffer(GLenum target, GLsizeiptr size, const void* data, GLenum usage, const char* owner, GLbitfield flags = 0);
+void GpuDeleteBuffer(GLuint* buffer); // deletes, untracks and resets the name to -1; -1 is ignored
+void GpuResizeBuffer(GLuint buffer, GLsizeiptr size); // record a reallocation made with glBufferData
+
+// Create a 2D texture with one level, leaving it bound to GL_TEXTURE_2D
+GLuint GpuCreateTexture2D(GLint internal_format, int width, int height, GLenum format, GLenum type, const void* data, const char* owner);
+void GpuDeleteTexture(GLuint* texture);
+
+// Immutable storage for texture views, one level, leaving it bound to GL_TEXTURE_2D
+GLuint GpuCreateTextureStorage2D(GLenum internal_format, int width, int height, const char* owner);
+// A view of all of texture in another format of the same view class, leaving it bound to
+// GL_TEXTURE_2D. Counted as 0 bytes since it shares the storage of texture. Delete views with
+// GpuDeleteTexture before the texture they view.
+GLuint GpuCreateTextureView(GLuint texture, GLenum internal_format, const char* owner);
+size_t GpuBytesPerTexel(GLenum internal_format);
+
+GLuint GpuCreateRenderbuffer(GLenum internal_format, int width, int height, const char* owner);
+void GpuDeleteRenderbuffer(GLuint* renderbuffer);
+
+void GpuTrackProgram(GLuint program, const char* owner);
+void GpuDeleteProgram(GLuint* program);
+
+size_t GpuMemoryBytes(int kind = -1); // -1: all kinds
+int GpuResourceCount(int kind = -1);
+std::vector<GpuResource> GpuResources(); // snapshot, largest first
+int GpuLeakedCount(); // live objects beyond the first for each owner
+
+// Print a summary grouped by owner. at_exit treats every live resource as a leak.
+void GpuMemoryReport(bool at_exit);
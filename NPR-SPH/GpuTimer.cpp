@@ -0,0 +1,250 @@
+#include "GpuTimer.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+const char* GpuPassName(int pass)
+{
+	switch (pass)
+	{
+	case GPU_PASS_RHO_PRESSURE:
+		return "rho_pressure";
+	case GPU_PASS_FORCE:
+		return "force";
+	case GPU_PASS_INTEGRATE:
+		return "integrate";
+	case GPU_PASS_FLUID_DEPTH:
+		return "fluid_depth";
+	case GPU_PASS_FLUID_SMOOTH:
+		return "fluid_smooth";
+	case GPU_PASS_FBO:
+		return "pass0_fbo";
+	case GPU_PASS_SCREEN:
+		return "pass1_screen";
+	case GPU_PASS_EDGES:
+		return "edges";
+	case GPU_PASS_BRUSH_STROKES:
+		return "brush_strokes";
+	case GPU_PASS_BRUSH:
+		return "brush";
+	case GPU_PASS_UPSCALE:
+		return "upscale";
+	case GPU_PASS_CAPTURE:
+		return "capture";
+	case GPU_PASS_GUI:
+		return "gui";
+	}
+	return "unknown";
+}
+
+void GpuTimers::Init()
+{
+	Destroy();
+	for (int s = 0; s < GPU_TIMER_SETS; s++)
+	{
+		glGenQueries(GPU_PASS_COUNT, mQueries[s]);
+		glGenQueries(GPU_PASS_COUNT, mStamps[s]);
+		for (int p = 0; p < GPU_PASS_COUNT; p++)
+		{
+			mIssued[s][p] = false;
+		}
+	}
+	mActive = -1;
+	mHistoryHead = 0;
+	mHistoryCount = 0;
+	mDropped = 0;
+}
+
+void GpuTimers::Destroy()
+{
+	for (int s = 0; s < GPU_TIMER_SETS; s++)
+	{
+		if (mQueries[s][0] != -1)
+		{
+			glDeleteQueries(GPU_PASS_COUNT, mQueries[s]);
+			glDeleteQueries(GPU_PASS_COUNT, mStamps[s]);
+		}
+		for (int p = 0; p < GPU_PASS_COUNT; p++)
+		{
+			mQueries[s][p] = -1;
+			mStamps[s][p] = -1;
+			mIssued[s][p] = false;
+		}
+	}
+}
+
+void GpuTimers::BeginFrame()
+{
+	if (mQueries[0][0] == -1)
+	{
+		return;
+	}
+
+	mFrame++;
+	mSet = mFrame % GPU_TIMER_SETS;
+
+	// relate the GPU clock to the CPU one, doesn't wait for queued work
+	GLint64 gpu_now = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+	mClockOffset = (int64_t)ProfilerNowNs() - gpu_now;
+
+	// collect the set this frame is about to reuse
+	bool any = false;
+	bool ready = true;
+	for (int p = 0; p < GPU_PASS_COUNT; p++)
+	{
+		if (mIssued[mSet][p])
+		{
+			GLint available = GL_FALSE, stamp_available = GL_FALSE;
+			glGetQueryObjectiv(mQueries[mSet][p], GL_QUERY_RESULT_AVAILABLE, &available);
+			glGetQueryObjectiv(mStamps[mSet][p], GL_QUERY_RESULT_AVAILABLE, &stamp_available);
+			ready = ready && available == GL_TRUE && stamp_available == GL_TRUE;
+			any = true;
+		}
+	}
+
+	if (any && ready)
+	{
+		float* row = mHistory[mHistoryHead];
+		for (int p = 0; p < GPU_PASS_COUNT; p++)
+		{
+			row[p] = -1.0f;
+			mHistoryStart[mHistoryHead][p] = 0;
+			if (mIssued[mSet][p])
+			{
+				GLuint64 ns = 0, stamp = 0;
+				glGetQueryObjectui64v(mQueries[mSet][p], GL_QUERY_RESULT, &ns);
+				glGetQueryObjectui64v(mStamps[mSet][p], GL_QUERY_RESULT, &stamp);
+				row[p] = (float)(ns * 1e-6);
+				mHistoryStart[mHistoryHead][p] = (uint64_t)((int64_t)stamp + mClockOffset);
+			}
+		}
+		mHistoryFrames[mHistoryHead] = mSetFrames[mSet];
+		mHistoryHead = (mHistoryHead + 1) % GPU_TIMER_HISTORY;
+		mHistoryCount = std::min(mHistoryCount + 1, GPU_TIMER_HISTORY);
+	}
+	else if (any)
+	{
+		mDropped++; // the GPU is more than GPU_TIMER_SETS frames behind, don't wait for it
+	}
+
+	for (int p = 0; p < GPU_PASS_COUNT; p++)
+	{
+		mIssued[mSet][p] = false;
+	}
+	mSetFrames[mSet] = mFrame;
+}
+
+void GpuTimers::Begin(int pass)
+{
+	if (mQueries[0][0] == -1 || mActive != -1)
+	{
+		return;
+	}
+	glQueryCounter(mStamps[mSet][pass], GL_TIMESTAMP);
+	glBeginQuery(GL_TIME_ELAPSED, mQueries[mSet][pass]);
+	mActive = pass;
+}
+
+void GpuTimers::End(int pass)
+{
+	if (mActive != pass)
+	{
+		return;
+	}
+	glEndQuery(GL_TIME_ELAPSED);
+	mIssued[mSet][pass] = true;
+	mActive = -1;
+}
+
+GpuPassStats GpuTimers::Stats(int pass) const
+{
+	std::vector<float> samples;
+	samples.reserve(mHistoryCount);
+	for (int i = 0; i < mHistoryCount; i++)
+	{
+		if (mHistory[i][pass] >= 0.0f)
+		{
+			samples.push_back(mHistory[i][pass]);
+		}
+	}
+
+	GpuPassStats stats = { 0.0f, 0.0f, 0.0f, (int)samples.size() };
+	if (samples.empty())
+	{
+		return stats;
+	}
+
+	double sum = 0.0;
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		sum += samples[i];
+	}
+	stats.avg_ms = (float)(sum / samples.size());
+	stats.min_ms = *std::min_element(samples.begin(), samples.end());
+
+	const size_t p99 = std::min(samples.size() - 1, (size_t)(0.99 * samples.size()));
+	std::nth_element(samples.begin(), samples.begin() + p99, samples.end());
+	stats.p99_ms = samples[p99];
+	return stats;
+}
+
+float GpuTimers::LastMs(int pass) const
+{
+	if (mHistoryCount == 0)
+	{
+		return -1.0f;
+	}
+	return mHistory[(mHistoryHead + GPU_TIMER_HISTORY - 1) % GPU_TIMER_HISTORY][pass];
+}
+
+unsigned int GpuTimers::LastFrame() const
+{
+	if (mHistoryCount == 0)
+	{
+		return 0;
+	}
+	return mHistoryFrames[(mHistoryHead + GPU_TIMER_HISTORY - 1) % GPU_TIMER_HISTORY];
+}
+
+bool GpuTimers::ExportCsv(const char* filename) const
+{
+	FILE* fp = fopen(filename, "w");
+	if (fp == NULL)
+	{
+		printf("Could not open %s\n", filename);
+		return false;
+	}
+
+	fprintf(fp, "frame");
+	for (int p = 0; p < GPU_PASS_COUNT; p++)
+	{
+		fprintf(fp, ",%s_ms", GpuPassName(p));
+	}
+	fprintf(fp, "\n");
+
+	// oldest row first, passes that didn't run are left empty
+	const int first = (mHistoryHead + GPU_TIMER_HISTORY - mHistoryCount) % GPU_TIMER_HISTORY;
+	for (int i = 0; i < mHistoryCount; i++)
+	{
+		const int row = (first + i) % GPU_TIMER_HISTORY;
+		fprintf(fp, "%u", mHistoryFrames[row]);
+		for (int p = 0; p < GPU_PASS_COUNT; p++)
+		{
+			if (mHistory[row][p] >= 0.0f)
+			{
+				fprintf(fp, ",%.4f", mHistory[row][p]);
+			}
+			else
+			{
+				fprintf(fp, ",");
+			}
+		}
+		fprintf(fp, "\n");
+	}
+
+	fclose(fp);
+	return true;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/glew.h>
+#include <cstdint>
+
+/*
+Per-pass GPU timing with GL_TIME_ELAPSED queries.
+
+Every pass gets one query per frame set. Sets are double buffered: BeginFrame() collects the set
+issued two frames ago, which the GPU has normally finished by then, and only reads queries whose
+GL_QUERY_RESULT_AVAILABLE is set, so the CPU never waits on a timer. Results go into a rolling
+history used for the min/avg/p99 readout, the CSV export and the GPU track of the trace export.
+
+Each pass also gets a GL_TIMESTAMP at its start. The GPU clock is related to ProfilerNowNs() once
+per frame so pass start times can be placed next to the CPU markers.
+
+GL_TIME_ELAPSED queries can't be nested, so passes must not overlap.
+*/
+
+#define GPU_TIMER_SETS 2
+#define GPU_TIMER_HISTORY 300 // frames kept for statistics and export
+
+enum GpuPass
+{
+	GPU_PASS_RHO_PRESSURE,
+	GPU_PASS_FORCE,
+	GPU_PASS_INTEGRATE,
+	GPU_PASS_FLUID_DEPTH, // fluid surface: nearest sphere depth
+	GPU_PASS_FLUID_SMOOTH, // fluid surface: bilateral depth smoothing
+	GPU_PASS_FBO, // pass 0: the geometry into the G-buffer
+	GPU_PASS_SCREEN, // pass 1: full-screen outline composite to the back buffer
+	GPU_PASS_EDGES, // edge_comp: outline mask for the brush strokes
+	GPU_PASS_BRUSH_STROKES, // brush_comp: stroke generation
+	GPU_PASS_BRUSH,
+	GPU_PASS_UPSCALE, // internal render targets to the window
+	GPU_PASS_CAPTURE, // frame grab for the video encoder
+	GPU_PASS_GUI,
+	GPU_PASS_COUNT
+};
+
+const char* GpuPassName(int pass);
+
+struct GpuPassStats
+{
+	float min_ms;
+	float avg_ms;
+	float p99_ms;
+	int samples; // frames in the history that ran this pass
+};
+
+struct GpuTimers
+{
+	GLuint mQueries[GPU_TIMER_SETS][GPU_PASS_COUNT];
+	GLuint mStamps[GPU_TIMER_SETS][GPU_PASS_COUNT]; // GL_TIMESTAMP at the start of each pass
+	bool mIssued[GPU_TIMER_SETS][GPU_PASS_COUNT]; // pass ran in the frame that used this set
+	unsigned int mSetFrames[GPU_TIMER_SETS]; // frame number each set was issued in
+	unsigned int mFrame;
+	int mSet; // set used by the current frame
+	int mActive; // pass whose query is open, or -1
+	int64_t mClockOffset; // ProfilerNowNs() minus GPU timestamp
+
+	// rolling history, one row per collected frame, -1 where a pass didn't run
+	float mHistory[GPU_TIMER_HISTORY][GPU_PASS_COUNT];
+	uint64_t mHistoryStart[GPU_TIMER_HISTORY][GPU_PASS_COUNT]; // pass start on the ProfilerNowNs() clock
+	unsigned int mHistoryFrames[GPU_TIMER_HISTORY];
+	int mHistoryHead; // next row to write
+	int mHistoryCount;
+	unsigned int mDropped; // frames whose results weren't ready in time and were discarded
+
+	GpuTimers() : mFrame(0), mSet(0), mActive(-1), mClockOffset(0), mHistoryHead(0), mHistoryCount(0), mDropped(0)
+	{
+		for (int s = 0; s < GPU_TIMER_SETS; s++)
+		{
+			for (int p = 0; p < GPU_PASS_COUNT; p++)
+			{
+				mQueries[s][p] = -1;
+				mStamps[s][p] = -1;
+				mIssued[s][p] = false;
+			}
+			mSetFrames[s] = 0;
+		}
+	}
+
+	void Init();
+	void Destroy();
+
+	void BeginFrame(); // call once per frame before the first pass
+	void Begin(int pass);
+	void End(int pass);
+
+	GpuPassStats Stats(int pass) const;
+	float LastMs(int pass) const; // most recent collected sample, -1 if none
+	unsigned int LastFrame() const; // frame the most recent sample was issued in, 0 if none
+	bool ExportCsv(const char* filename) const;
+};
@@ -0,0 +1,163 @@
+#include "Headless.h"
+
+#include <cstdio>
+#include <vector>
+
+#include "FreeImage.h"
+
+#ifdef NPR_OSMESA
+#include <GL/osmesa.h>
+
+static OSMesaContext osmesa_context = NULL;
+static unsigned char osmesa_buffer[4]; // OSMesa needs a color buffer to make the context current, rendering goes to FBOs
+
+bool create_headless_context()
+{
+	const int attribs[] =
+	{
+		OSMESA_FORMAT, OSMESA_RGBA,
+		OSMESA_DEPTH_BITS, 24,
+		OSMESA_PROFILE, OSMESA_COMPAT_PROFILE, // point sprites and glDrawBuffer need the compatibility profile
+		OSMESA_CONTEXT_MAJOR_VERSION, 4,
+		OSMESA_CONTEXT_MINOR_VERSION, 4,
+		0
+	};
+	osmesa_context = OSMesaCreateContextAttribs(attribs, NULL);
+	if (osmesa_context == NULL)
+	{
+		printf("Could not create an OSMesa OpenGL 4.4 context\n");
+		return false;
+	}
+	if (!OSMesaMakeCurrent(osmesa_context, osmesa_buffer, GL_UNSIGNED_BYTE, 1, 1))
+	{
+		printf("Could not make the OSMesa context current\n");
+		return false;
+	}
+	return true;
+}
+
+void destroy_headless_context()
+{
+	if (osmesa_context != NULL)
+	{
+		OSMesaDestroyContext(osmesa_context);
+		osmesa_context = NULL;
+	}
+}
+
+#else
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static EGLDisplay egl_display = EGL_NO_DISPLAY;
+static EGLContext egl_context = EGL_NO_CONTEXT;
+
+bool create_headless_context()
+{
+	// prefer the surfaceless platform, it needs neither X nor a DRM device
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (get_platform_display != NULL)
+	{
+		egl_display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+	if (egl_display == EGL_NO_DISPLAY)
+	{
+		egl_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+
+	EGLint major, minor;
+	if (egl_display == EGL_NO_DISPLAY || !eglInitialize(egl_display, &major, &minor))
+	{
+		printf("Could not initialize EGL\n");
+		return false;
+	}
+	if (!eglBindAPI(EGL_OPENGL_API))
+	{
+		printf("EGL has no desktop OpenGL\n");
+		return false;
+	}
+
+	const EGLint config_attribs[] =
+	{
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_NONE
+	};
+	EGLConfig config = NULL;
+	EGLint num_configs = 0;
+	eglChooseConfig(egl_display, config_attribs, &config, 1, &num_configs);
+	// surfaceless displays may not offer pbuffer configs; the context never gets a surface anyway
+	if (num_configs == 0)
+	{
+		const EGLint any_config[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+		eglChooseConfig(egl_display, any_config, &config, 1, &num_configs);
+	}
+
+	const EGLint context_attribs[] =
+	{
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 4,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT, // point sprites and glDrawBuffer
+#ifdef _DEBUG
+		EGL_CONTEXT_OPENGL_DEBUG, EGL_TRUE,
+#endif
+		EGL_NONE
+	};
+	egl_context = eglCreateContext(egl_display, num_configs > 0 ? config : (EGLConfig)0, EGL_NO_CONTEXT, context_attribs);
+	if (egl_context == EGL_NO_CONTEXT)
+	{
+		printf("Could not create an EGL OpenGL 4.4 context (0x%x)\n", eglGetError());
+		return false;
+	}
+	if (!eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, egl_context))
+	{
+		printf("Could not make the EGL context current (0x%x)\n", eglGetError());
+		return false;
+	}
+	return true;
+}
+
+void destroy_headless_context()
+{
+	if (egl_display != EGL_NO_DISPLAY)
+	{
+		eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (egl_context != EGL_NO_CONTEXT)
+		{
+			eglDestroyContext(egl_display, egl_context);
+		}
+		eglTerminate(egl_display);
+	}
+	egl_context = EGL_NO_CONTEXT;
+	egl_display = EGL_NO_DISPLAY;
+}
+#endif
+
+bool save_framebuffer_image(const char* filename, int width, int height)
+{
+	std::vector<unsigned char> pixels(4 * width * height);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_BGRA, GL_UNSIGNED_BYTE, pixels.data());
+
+	// GL rows start at the bottom, which is also FreeImage's native order
+	FIBITMAP* image = FreeImage_ConvertFromRawBits(pixels.data(), width, height, 4 * width, 32, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK, FALSE);
+	FREE_IMAGE_FORMAT format = FreeImage_GetFIFFromFilename(filename);
+	if (format == FIF_UNKNOWN)
+	{
+		format = FIF_PNG;
+	}
+	// formats without alpha get a 24 bit copy
+	FIBITMAP* output = format == FIF_PNG || format == FIF_TARGA || format == FIF_TIFF ? image : FreeImage_ConvertTo24Bits(image);
+	const bool ok = FreeImage_Save(format, output, filename, 0) != 0;
+	if (output != image)
+	{
+		FreeImage_Unload(output);
+	}
+	FreeImage_Unload(image);
+
+	if (!ok)
+	{
+		printf("Could not write %s\n", filename);
+	}
+	return ok;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <GL/glew.h>
+
+/*
+OpenGL without a window, for batch renders on machines with no display or GPU.
+
+create_headless_context() makes a surfaceless EGL context current (EGL_MESA_platform_surfaceless,
+falling back to the default EGL display), or an OSMesa context when built with NPR_OSMESA. Both
+work with Mesa's llvmpipe. There is no default framebuffer, so everything, including what
+the windowed app draws to the screen, has to go to an FBO.
+
+GLEW has to be built with GLEW_EGL (or GLEW_OSMESA) for glewInit() to find the entry points.
+*/
+
+bool create_headless_context();
+void destroy_headless_context();
+
+// Save the current read framebuffer as an image, format from the extension (png, jpg, bmp, ...)
+bool save_framebuffer_image(const char* filename, int width, int height);
@@ -1,5 +1,6 @@
 #include <GL/glew.h>
 
+#include <cstring>
 #include <fstream>
 #include <iostream>
 using namespace std;
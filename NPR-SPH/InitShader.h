@@ -1,8 +1,10 @@
 #ifndef __INITSHADER_H__
 #define __INITSHADER_H__
 
+#ifdef _WIN32
 #include <windows.h>
-#include <GL/GL.h>
+#endif
+#include <GL/glew.h>
 
 GLuint InitShader( const char* computeShaderFile);
 GLuint InitShader( const char* vertexShaderFile, const char* fragmentShaderFile );
@@ -3,8 +3,9 @@
 #include <algorithm>
 
 #include <GL/glew.h>
+#include "GpuMemory.h"
 #include "assimp/Importer.hpp"
-#include "assimp/PostProcess.h"
+#include "assimp/postprocess.h"
 
 // Create an instance of the Importer class
 Assimp::Importer gImporter;
@@ -110,33 +111,23 @@ void GetBoundingBox(const aiScene* scene, aiVector3D* min, aiVector3D* max)
    GetBoundingBoxForNode(scene, scene->mRootNode, min, max);
 }
 
-void BufferIndexedVerts(MeshData& meshdata)
+void FreeMesh(MeshData& meshdata)
 {
-
    if (meshdata.mVao != -1)
    {
       glDeleteVertexArrays(1, &meshdata.mVao);
+      meshdata.mVao = -1;
    }
 
-   if (meshdata.mIndexBuffer != -1)
-   {
-      glDeleteBuffers(1, &meshdata.mIndexBuffer);
-   }
-
-   if (meshdata.mVboVerts != -1)
-   {
-      glDeleteBuffers(1, &meshdata.mVboVerts);
-   }
-
-   if (meshdata.mVboTexCoords != -1)
-   {
-      glDeleteBuffers(1, &meshdata.mVboTexCoords);
-   }
+   GpuDeleteBuffer(&meshdata.mIndexBuffer);
+   GpuDeleteBuffer(&meshdata.mVboVerts);
+   GpuDeleteBuffer(&meshdata.mVboTexCoords);
+   GpuDeleteBuffer(&meshdata.mVboNormals);
+}
 
-   if (meshdata.mVboNormals != -1)
-   {
-      glDeleteBuffers(1, &meshdata.mVboNormals);
-   }
+void BufferIndexedVerts(MeshData& meshdata)
+{
+   FreeMesh(meshdata);
 
    GLint program = -1;
    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
@@ -185,16 +176,12 @@ void BufferIndexedVerts(MeshData& meshdata)
    }
 
    //Buffer indices
-   glGenBuffers(1, &meshdata.mIndexBuffer);
-   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshdata.mIndexBuffer);
-   glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * totalNumIndices, indices.data(), GL_STATIC_DRAW);
+   meshdata.mIndexBuffer = GpuCreateBuffer(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * totalNumIndices, indices.data(), GL_STATIC_DRAW, "mesh indices");
 
 
    //Buffer vertices
    {
-      glGenBuffers(1, &meshdata.mVboVerts);
-      glBindBuffer(GL_ARRAY_BUFFER, meshdata.mVboVerts);
-      glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 3 * totalNumVerts, 0, GL_STATIC_DRAW);
+      meshdata.mVboVerts = GpuCreateBuffer(GL_ARRAY_BUFFER, sizeof(float) * 3 * totalNumVerts, 0, GL_STATIC_DRAW, "mesh positions");
 
       int offset = 0;
       for (int m = 0; m<numSubmeshes; m++)
@@ -217,9 +204,7 @@ void BufferIndexedVerts(MeshData& meshdata)
 
    // buffer texture coordinates
    {
-      glGenBuffers(1, &meshdata.mVboTexCoords);
-      glBindBuffer(GL_ARRAY_BUFFER, meshdata.mVboTexCoords);
-      glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 2 * totalNumVerts, 0, GL_STATIC_DRAW);
+      meshdata.mVboTexCoords = GpuCreateBuffer(GL_ARRAY_BUFFER, sizeof(float) * 2 * totalNumVerts, 0, GL_STATIC_DRAW, "mesh tex coords");
 
       int offset = 0;
       for (int m = 0; m<numSubmeshes; m++)
@@ -245,9 +230,7 @@ void BufferIndexedVerts(MeshData& meshdata)
 
    //buffer normals
    {
-      glGenBuffers(1, &meshdata.mVboNormals);
-      glBindBuffer(GL_ARRAY_BUFFER, meshdata.mVboNormals);
-      glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 3 * totalNumVerts, 0, GL_STATIC_DRAW);
+      meshdata.mVboNormals = GpuCreateBuffer(GL_ARRAY_BUFFER, sizeof(float) * 3 * totalNumVerts, 0, GL_STATIC_DRAW, "mesh normals");
 
       int offset = 0;
       for (int m = 0; m<numSubmeshes; m++)
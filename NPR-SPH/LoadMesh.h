@@ -5,7 +5,7 @@
 #include <string>
 #include <vector>
 #include <GL/glew.h>
-#include "assimp/Scene.h"
+#include "assimp/scene.h"
 
 struct SubmeshData
 {
@@ -41,6 +41,7 @@ struct MeshData
 
 
 MeshData LoadMesh(const std::string& pFile);
+void FreeMesh(MeshData& mesh); // delete the VAO and buffers, LoadMesh() always creates new ones
 
 
 #endif
\ No newline at end of file
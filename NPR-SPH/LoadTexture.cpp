@@ -1,5 +1,6 @@
 #include "LoadTexture.h"
 #include "FreeImage.h"
+#include "GpuMemory.h"
 
 
 GLuint LoadTexture(const std::string& fname)
@@ -19,9 +20,7 @@ GLuint LoadTexture(const std::string& fname)
    FreeImage_ConvertToRawBits(byteImg, img, scanW, 32, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK, FALSE);
    FreeImage_Unload(img);
 
-   glGenTextures(1, &tex_id);
-   glBindTexture(GL_TEXTURE_2D, tex_id);
-   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_BGRA, GL_UNSIGNED_BYTE, byteImg);
+   tex_id = GpuCreateTexture2D(GL_RGBA, w, h, GL_BGRA, GL_UNSIGNED_BYTE, byteImg, fname.c_str());
    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -2,7 +2,9 @@
 #define __LOADTEXTURE_H__
 
 #include <string>
+#ifdef _WIN32
 #include <windows.h>
+#endif
 #include "GL/glew.h"
 #include "GL/gl.h"
 
@@ -1,4 +1,6 @@
+#ifdef _WIN32
 #include <windows.h>
+#endif
 
 // CGT521 Final 
 // By Angel Lam and Varun Ramakrishnan
@@ -8,12 +10,18 @@
 //           2. (SPH) Fluid simulation with compute shader
 
 
+#ifndef NPR_HEADLESS
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
+#endif
 
 #include <GL/glew.h>
+#ifndef NPR_HEADLESS
 #include <GLFW/glfw3.h>
+#else
+typedef struct GLFWwindow GLFWwindow; // display() and resize() keep their signatures, the window is always null
+#endif
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -22,18 +30,31 @@
 #include <iostream>
 #include <vector>
 
+#ifndef NPR_HEADLESS
 #include "UniformGui.h"
+#endif
 #include "InitShader.h"    // Functions for loading shaders from text files
 #include "LoadTexture.h"   // Functions for creating OpenGL textures from image files
 #include "VideoMux.h"      // Functions for saving videos
 #include "DebugCallback.h" // Functions for debugging glsl
 #include "LoadMesh.h"      // Functions for loading meshes
-
-// particle setups
-#define NUM_PARTICLES 10000
-#define PARTICLE_RADIUS 0.005f
-#define WORK_GROUP_SIZE 1024
-#define NUM_WORK_GROUPS 10 // Ceiling of particle count divided by work group size
+#include "Simulation.h"    // Particle layout and simulation uniform structures
+#include "Checkpoint.h"    // Functions for saving and restoring simulation state
+#include "Trajectory.h"    // Functions for recording compressed particle trajectories
+#include "ParticleReadback.h" // Stall-free readback of the particle buffer
+#include "DynamicResolution.h" // Internal render scale steered by the GPU frame time
+#include "RenderTargetPool.h" // Screen-sized textures at the framebuffer size, aliased between passes
+#include "StrokeCache.h"    // Reuse of brush strokes and the painted layer across frames
+#include "GpuTimer.h"       // Per-pass GPU timer queries
+#include "Profiler.h"       // CPU scoped markers and trace export
+#include "GpuMemory.h"      // Size and owner of every GPU buffer and texture
+#include "SceneFile.h"      // Scene and parameter files with live reload
+#include "BrushStrokes.h"   // Paint strokes generated in a compute shader
+#ifdef NPR_HEADLESS
+#include "Headless.h"       // EGL/OSMesa context without a window
+#include "CameraPath.h"     // Keyframed camera for offscreen renders
+#include "FramePattern.h"   // Checked printf patterns for image sequences
+#endif
 
 const int init_window_width = 720;
 const int init_window_height = 720;
@@ -41,20 +62,87 @@ const char* const window_title = "CGT 521 Final Project - NPR-SPH";
 
 // openGL
 GLuint shader_program = -1;
-GLuint compute_programs[3] = { -1, -1, -1 };
+GLuint compute_programs[3] = { (GLuint)-1, (GLuint)-1, (GLuint)-1 };
 GLuint particle_position_vao = -1;
 GLuint particles_ssbo = -1;
 
 GLuint fbo = -1;
 GLuint fbo_tex = -1;
-GLuint depthrenderbuffer;
+GLuint fbo_color_tex = -1; // shaded color from the geometry pass
+GLuint fbo_depth_tex = -1; // sampled by the composite to give the screen the geometry's depth
+GLuint fluid_fbo = -1; // fluid_depth_tex with fbo_depth_tex
+GLuint fluid_depth_tex = -1; // R32F linear view depth of the nearest sphere, then the smoothed surface
+GLuint fluid_smooth_tex = -1; // R32F depth smoothed along x only
+GLuint edge_tex = -1; // R16F outline mask the brush strokes sample, from edge_comp.glsl
+GLuint edge_radius_tex = -1; // R16F outline radius of the edge pixels
+GLuint edge_seed_tex[2] = { (GLuint)-1, (GLuint)-1 }; // RG16I nearest edge pixel, ping-ponged by the jump flood
+GLuint scene_fbo = -1; // composite and brush strokes at the internal resolution, upscaled to the screen
+GLuint scene_tex = -1;
+GLuint scene_depth = -1;
+GLuint paint_layer_fbo = -1; // brush strokes as material color weights, kept across frames by stroke_cache
+GLuint paint_layer_tex[3] = { (GLuint)-1, (GLuint)-1, (GLuint)-1 }; // RGBA16F, see brush_fs.glsl
+GLuint blend_compare_fbo = -1; // blend_compare_tex with scene_depth
+GLuint blend_compare_tex = -1; // RGBA8 copy of the composite each mode of compare_stroke_blending() paints over
+RenderTargetPool render_targets; // owns the screen-sized textures above, see allocate_render_targets()
+RenderTargetPool paint_layer_targets; // paint_layer_tex, only while paint_layer_needed()
 GLuint texture_id = -1; // Texture map for mesh
 
+// what display() treats as the screen: 0 is the window, headless builds render into an offscreen FBO
+GLuint screen_fbo = 0;
+int framebuffer_width = init_window_width;
+int framebuffer_height = init_window_height;
+// internal resolution of everything before the upscale, framebuffer size times dynamic_resolution.mScale
+DynamicResolution dynamic_resolution;
+int render_width = init_window_width;
+int render_height = init_window_height;
+
 GLuint scene_ubo = -1;
 GLuint constants_ubo = -1;
 GLuint boundary_ubo = -1;
 GLuint material_ubo = -1;
 
+// CPU-side consumers (trajectory, checkpoints) read the particle buffer through this ring
+ParticleReadback particle_readback;
+CheckpointState pending_checkpoint; // simulation uniforms captured when the save was requested
+std::string pending_checkpoint_filename;
+bool checkpoint_requested = false; // capture for a checkpoint at the end of this frame's simulation step
+
+// trajectory replay: recorded positions stream into replay_vbo, which particle_position_vao reads instead of particles_ssbo
+TrajectoryPlayer replay_player;
+GLuint replay_vbo = -1;
+bool replaying = false;
+bool replay_paused = false;
+float replay_frame = 0.0f;
+float replay_rate = 1.0f; // trajectory frames advanced per displayed frame, negative plays backwards
+int replay_uploaded = -1; // trajectory frame currently held by replay_vbo
+
+GpuTimers gpu_timers; // GL_TIME_ELAPSED per render and compute pass, shown in the Profiler Window
+
+BrushStrokes brush_strokes; // paint style strokes, regenerated every frame
+float outline_thickness = 5.0f; // paint outline radius in pixels for edges at the eye, 0 beyond 4 units
+float brush_density = 4000.0f; // mesh strokes per unit area, with the mesh scaled to unit size
+BrushCulling brush_culling = { true, 0.5f, 4.0f, 0.0f };
+StrokeCache stroke_cache;
+unsigned int particle_version = 0; // changes whenever the particle positions the strokes follow do
+int stroke_blend = STROKE_BLEND_OVER; // StrokeBlend
+const char* const stroke_blend_names[STROKE_BLEND_COUNT] = { "over", "weighted", "sorted" }; // in scene files and on the command line
+
+// every stroke blend mode against the sorted reference, from compare_stroke_blending()
+struct StrokeBlendComparison
+{
+	bool requested; // run at the next paint pass
+	bool valid;
+	GLuint strokes;
+	int width;
+	int height;
+	float ms[STROKE_BLEND_COUNT]; // GPU time of the pass, best of a few; sorting included for STROKE_BLEND_SORTED
+	float rms_error[STROKE_BLEND_COUNT]; // against STROKE_BLEND_SORTED, in 8 bit color steps
+	float max_error[STROKE_BLEND_COUNT];
+	float order_rms[STROKE_BLEND_COUNT]; // between drawing as generated and front to back
+} blend_comparison;
+
+SceneFile scene_file; // camera, material, style and solver settings, see bind_scene_file()
+
 // compute shaders
 static const std::string rho_pres_com_shader("rho_pres_comp.glsl");
 static const std::string force_comp_shader("force_comp.glsl");
@@ -64,11 +152,32 @@ static const std::string integrate_comp_shader("integrate_comp.glsl");
 enum render_style { toon, paint };
 GLuint toon_shader_program = -1;
 GLuint brush_shader_program = -1;
+GLuint brush_comp_program = -1; // generates the strokes brush_shader_program draws
+GLuint stroke_sort_program = -1; // compute: back to front order of the strokes for STROKE_BLEND_SORTED
+GLuint impostor_shader_program = -1; // particles as ray-traced spheres
+GLuint fluid_depth_program = -1; // impostor spheres writing linear depth for the fluid surface
+GLuint fluid_smooth_program = -1; // compute: one direction of the depth smoothing
+GLuint edge_program = -1; // compute: outline mask for the brush strokes
+GLuint fluid_shader_program = -1; // shades the smoothed depth
+GLuint composite_shader_program = -1; // outlines the G-buffer into scene_fbo
+GLuint upscale_shader_program = -1; // scene_fbo to the screen
+GLuint paint_resolve_shader_program = -1; // paint layer and material colors into scene_fbo
 static const std::string toon_vs("toon_vs.glsl");
 static const std::string toon_fs("toon_fs.glsl");
-static const std::string brush_gs("brush_gs.glsl");
+static const std::string brush_comp("brush_comp.glsl");
 static const std::string brush_fs("brush_fs.glsl");
 static const std::string brush_vs("brush_vs.glsl");
+static const std::string stroke_sort_comp("stroke_sort_comp.glsl");
+static const std::string impostor_vs("impostor_vs.glsl");
+static const std::string impostor_fs("impostor_fs.glsl");
+static const std::string fluid_depth_fs("fluid_depth_fs.glsl");
+static const std::string fluid_smooth_comp("fluid_smooth_comp.glsl");
+static const std::string edge_comp("edge_comp.glsl");
+static const std::string fluid_fs("fluid_fs.glsl");
+static const std::string fullscreen_vs("fullscreen_vs.glsl");
+static const std::string composite_fs("composite_fs.glsl");
+static const std::string upscale_fs("upscale_fs.glsl");
+static const std::string paint_resolve_fs("paint_resolve_fs.glsl");
 
 // meshes
 MeshData mesh_data;
@@ -87,16 +196,14 @@ bool recording = false;
 bool simulate; // to pause and run simulation
 int obj_mode = 0; // 0 for mesh and 1 for simulation
 float simulation_radius = 10.0f;
+enum particle_style { point_sprites, sphere_impostors, fluid_surface };
+int particle_display = particle_style::sphere_impostors;
+float particle_radius = PARTICLE_RADIUS; // model-space sphere radius of the impostors
+float surface_smoothing = 4.0f; // fluid surface filter radius, in sphere radii
 glm::vec3 center = glm::vec3(0.0f);	// world-space eye position
 int style = render_style::toon;
-
-struct Particle
-{
-	glm::vec4 pos;
-	glm::vec4 vel;
-	glm::vec4 force;
-	glm::vec4 extras; // 0 - rho, 1 - pressure, 2 - age
-};
+float time_step = 1.0f / NUM_PARTICLES; // simulation time step
+unsigned int sim_frame = 0; // number of simulation steps taken since the last reset
 
 // These uniform structure mirrors the uniform block declared in the shader
 struct SceneUniforms
@@ -107,19 +214,8 @@ struct SceneUniforms
 	glm::vec4 light_w = glm::vec4(0.0f, 1.0f, 1.0f, 1.0f); // world-space light position
 } SceneData;
 
-struct ConstantsUniform
-{
-	float mass = 0.02f; // Particle Mass
-	float smoothing_coeff = 4.0f; // Smoothing length coefficient for neighborhood
-	float visc = 3000.0f; // Fluid viscosity
-	float resting_rho = 1000.0f; // Resting density
-}ConstantsData;
-
-struct BoundaryUniform
-{
-	glm::vec4 upper = glm::vec4(0.5f, 1.0f, 0.5f, 1.0f);
-	glm::vec4 lower = glm::vec4(-0.1f, -0.35f, -0.1f, 1.0f);
-}BoundaryData;
+ConstantsUniform ConstantsData;
+BoundaryUniform BoundaryData;
 
 struct MaterialUniforms
 {
@@ -144,18 +240,38 @@ namespace UniformLocs
 {
 	int M = 0; //model matrix
 	int style = 1; // toon/cell or paint
-	int pass = 2;
 	int mode = 3; // mesh or simulation
 	int mesh_d = 4; // mesh depth
 	int mesh_range = 5; // mesh range
 	int scale = 6;
 	int sim_rad = 7; // particle radius 
+	int time_step = TIME_STEP_LOCATION; // integration time step
+	int particle_radius = 9; // impostor sphere radius
+	int smooth_direction = 10; // fluid depth smoothing axis
+	int jump = 18; // edge map pass: 0 detect, > 0 jump flood step, < 0 resolve
+	int outline_radius = 19; // paint outline radius in pixels at the eye
+	int window = 20; // upscale target size
+	int paint_layer = 21; // brush strokes into the paint layer instead of the scene
+	int stroke_order = 23; // StrokeOrder of the brush strokes
+	int weighted_blend = 24; // paint layer accumulated for weighted blended OIT
+	int filter_radius = 11; // world-space fluid smoothing radius
+	int viewport = 12; // fluid textures are allocated for the largest monitor
 }
 
 void init_particles();
-
+void save_checkpoint(const char* filename);
+void load_checkpoint(const char* filename);
+void consume_particle_readback(const void* data, unsigned int frame, int tags);
+void start_replay(const char* filename);
+void stop_replay();
+void update_replay();
+void bind_scene_file();
+
+#ifndef NPR_HEADLESS
 void draw_gui(GLFWwindow* window)
 {
+	PROFILE_SCOPE("draw_gui");
+
 	// Begin ImGui Frame
 	ImGui_ImplOpenGL3_NewFrame();
 	ImGui_ImplGlfw_NewFrame();
@@ -217,6 +333,49 @@ void draw_gui(GLFWwindow* window)
 	if (style == render_style::paint) {
 		// add paint options
 		ImGui::SliderFloat("Brush Size", &MaterialData.brush_scale, 0.0001f, 2.0f);
+		ImGui::SliderFloat("Outline Thickness", &outline_thickness, 0.0f, 32.0f);
+		if (obj_mode == 0) {
+			ImGui::SliderFloat("Stroke Density", &brush_density, 100.0f, 50000.0f, "%.0f", ImGuiSliderFlags_Logarithmic);
+			ImGui::Text("%d strokes over %.2f units^2", brush_strokes.mSeedCount, brush_strokes.mSurfaceArea);
+		}
+		ImGui::Checkbox("Cull Strokes", &brush_culling.enabled);
+		if (brush_culling.enabled) {
+			ImGui::SliderFloat("Min Stroke Pixels", &brush_culling.cull_pixels, 0.0f, 4.0f);
+			ImGui::SliderFloat("LOD Stroke Pixels", &brush_culling.lod_pixels, 1.0f, 32.0f);
+		}
+		const BrushStats& stats = brush_strokes.mStats;
+		if (stats.total > 0) {
+			ImGui::Text("%u of %u strokes drawn, %.1f%% culled", stats.total - stats.Culled(), stats.total, 100.0f * stats.Culled() / stats.total);
+			ImGui::Text("frustum %u, back-facing %u, small %u, thinned %u", stats.frustum_culled, stats.backface_culled, stats.small_culled, stats.thinned);
+			const float fill = (float)stats.drawn_fill + stats.saved_fill;
+			ImGui::Text("%.2f Mpixels blended, %.1f%% saved", stats.drawn_fill * (BRUSH_FILL_UNIT * 1e-6f), fill > 0.0f ? 100.0f * stats.saved_fill / fill : 0.0f);
+		}
+		ImGui::Text("Stroke Blending");
+		ImGui::RadioButton("Over", &stroke_blend, STROKE_BLEND_OVER);
+		ImGui::SameLine();
+		ImGui::RadioButton("Weighted OIT", &stroke_blend, STROKE_BLEND_WEIGHTED);
+		ImGui::SameLine();
+		ImGui::RadioButton("Sorted", &stroke_blend, STROKE_BLEND_SORTED);
+		if (ImGui::Button("Compare Blending")) {
+			blend_comparison.requested = true;
+		}
+		if (blend_comparison.valid) {
+			ImGui::Text("%u strokes at %dx%d", blend_comparison.strokes, blend_comparison.width, blend_comparison.height);
+			for (int b = 0; b < STROKE_BLEND_SORTED; b++) {
+				ImGui::Text("%-8s %6.3f ms, error rms %5.2f max %3.0f, order rms %5.2f", stroke_blend_names[b], blend_comparison.ms[b],
+					blend_comparison.rms_error[b], blend_comparison.max_error[b], blend_comparison.order_rms[b]);
+			}
+			ImGui::Text("%-8s %6.3f ms, the reference", stroke_blend_names[STROKE_BLEND_SORTED], blend_comparison.ms[STROKE_BLEND_SORTED]);
+		}
+		ImGui::Checkbox("Stroke Cache", &stroke_cache.mEnabled);
+		if (stroke_cache.mEnabled) {
+			ImGui::Text("strokes regenerated %u, reprojected %u", stroke_cache.mRegenerated, stroke_cache.mReprojected);
+			ImGui::Text("layer drawn %u, resolve only %u", stroke_cache.mLayerDraws, stroke_cache.mResolved);
+			ImGui::Text("last regenerated: %s", stroke_cache.mRegenerateReason);
+			if (ImGui::Button("Reset Cache Counts")) {
+				stroke_cache.ResetCounters();
+			}
+		}
 	}
 
 	ImGui::RadioButton("Mesh", &obj_mode, 0);
@@ -225,7 +384,44 @@ void draw_gui(GLFWwindow* window)
 
 	if (obj_mode == 1) {
 		// add simulation options 
-		ImGui::SliderFloat("Particle Size", &simulation_radius, 10.0f, 100.0f);
+		ImGui::RadioButton("Points", &particle_display, particle_style::point_sprites);
+		ImGui::SameLine();
+		ImGui::RadioButton("Spheres", &particle_display, particle_style::sphere_impostors);
+		ImGui::SameLine();
+		ImGui::RadioButton("Surface", &particle_display, particle_style::fluid_surface);
+		if (particle_display == particle_style::point_sprites)
+		{
+			ImGui::SliderFloat("Particle Size", &simulation_radius, 10.0f, 100.0f);
+		}
+		else
+		{
+			ImGui::SliderFloat("Sphere Radius", &particle_radius, 0.001f, 0.02f);
+		}
+		if (particle_display == particle_style::fluid_surface)
+		{
+			ImGui::SliderFloat("Surface Smoothing", &surface_smoothing, 1.0f, 8.0f);
+		}
+
+		static char replay_filename[filename_len] = "trajectory.sphtraj";
+		ImGui::InputText("Replay filename", replay_filename, filename_len);
+		if (replaying == false)
+		{
+			if (ImGui::Button("Start Replay"))
+			{
+				start_replay(replay_filename);
+			}
+		}
+		else
+		{
+			if (ImGui::Button("Stop Replay"))
+			{
+				stop_replay();
+			}
+			ImGui::SameLine();
+			ImGui::Checkbox("Pause Replay", &replay_paused);
+			ImGui::SliderFloat("Replay Frame", &replay_frame, 0.0f, (float)(replay_player.NumFrames() - 1), "%.0f");
+			ImGui::SliderFloat("Replay Rate", &replay_rate, -4.0f, 4.0f);
+		}
 	}
 	else {
 		// add mesh options
@@ -234,6 +430,24 @@ void draw_gui(GLFWwindow* window)
 		ImGui::RadioButton("Knot", &mesh_id, 2);
 	}
 
+	static char scene_filename[filename_len] = "scene.txt";
+	ImGui::InputText("Scene filename", scene_filename, filename_len);
+	if (ImGui::Button("Save Preset"))
+	{
+		scene_file.Save(scene_filename);
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Load Preset"))
+	{
+		scene_file.Load(scene_filename);
+	}
+	ImGui::SameLine();
+	bool live_reload = !scene_file.Watched().empty();
+	if (ImGui::Checkbox("Live Reload", &live_reload))
+	{
+		scene_file.Watch(live_reload ? scene_filename : "");
+	}
+
 	ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
 	ImGui::End();
 
@@ -244,17 +458,243 @@ void draw_gui(GLFWwindow* window)
 	ImGui::SliderFloat("Smoothing", &ConstantsData.smoothing_coeff, 7.0f, 10.0f);
 	ImGui::SliderFloat("Viscosity", &ConstantsData.visc, 1000.0f, 5000.0f);
 	ImGui::SliderFloat("Resting Density", &ConstantsData.resting_rho, 1000.0f, 5000.0f);
+
+	static char checkpoint_filename[filename_len] = "checkpoint.sph";
+	ImGui::InputText("Checkpoint filename", checkpoint_filename, filename_len);
+	if (CheckpointSaveInProgress() || !pending_checkpoint_filename.empty())
+	{
+		ImGui::Text("Saving checkpoint...");
+	}
+	else if (ImGui::Button("Save Checkpoint"))
+	{
+		save_checkpoint(checkpoint_filename);
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Load Checkpoint"))
+	{
+		load_checkpoint(checkpoint_filename);
+	}
+	ImGui::Text("Frame %u", sim_frame);
+
+	static char trajectory_filename[filename_len] = "trajectory.sphtraj";
+	ImGui::InputText("Trajectory filename", trajectory_filename, filename_len);
+	if (trajectory_recording() == false)
+	{
+		if (ImGui::Button("Start Trajectory"))
+		{
+			start_trajectory(trajectory_filename, NUM_PARTICLES, BoundaryData);
+		}
+	}
+	else
+	{
+		if (ImGui::Button("Stop Trajectory"))
+		{
+			particle_readback.Poll(true, consume_particle_readback); // hand over frames that are still in flight
+			finish_trajectory();
+		}
+		uint32_t frames;
+		uint64_t raw_bytes, compressed_bytes;
+		trajectory_stats(&frames, &raw_bytes, &compressed_bytes);
+		ImGui::Text("%u frames, %.2f MB (%.1fx smaller)", frames, compressed_bytes / (1024.0 * 1024.0), compressed_bytes > 0 ? (double)raw_bytes / compressed_bytes : 0.0);
+	}
+	ImGui::End();
+
+	// Draw GPU pass timings
+	ImGui::Begin("Profiler Window");
+	ImGui::Text("GPU time over the last %d frames", gpu_timers.mHistoryCount);
+	if (ImGui::BeginTable("gpu_passes", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+	{
+		ImGui::TableSetupColumn("Pass");
+		ImGui::TableSetupColumn("Last ms");
+		ImGui::TableSetupColumn("Min ms");
+		ImGui::TableSetupColumn("Avg ms");
+		ImGui::TableSetupColumn("p99 ms");
+		ImGui::TableHeadersRow();
+		float total_avg = 0.0f;
+		for (int p = 0; p < GPU_PASS_COUNT; p++)
+		{
+			GpuPassStats stats = gpu_timers.Stats(p);
+			float last = gpu_timers.LastMs(p);
+			total_avg += stats.avg_ms * stats.samples / glm::max(gpu_timers.mHistoryCount, 1);
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn(); ImGui::Text("%s", GpuPassName(p));
+			if (stats.samples == 0)
+			{
+				continue; // pass not used recently, e.g. brush in toon style
+			}
+			ImGui::TableNextColumn(); last >= 0.0f ? ImGui::Text("%.3f", last) : ImGui::Text("-");
+			ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.min_ms);
+			ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.avg_ms);
+			ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.p99_ms);
+		}
+		ImGui::EndTable();
+		ImGui::Text("Total GPU %.3f ms/frame", total_avg);
+	}
+	if (gpu_timers.mDropped > 0)
+	{
+		ImGui::Text("%u frames dropped (results not ready)", gpu_timers.mDropped);
+	}
+
+	// internal resolution, steered by the GPU time above
+	ImGui::Checkbox("Dynamic Resolution", &dynamic_resolution.mEnabled);
+	if (dynamic_resolution.mEnabled)
+	{
+		ImGui::SliderFloat("Target ms", &dynamic_resolution.mTargetMs, 4.0f, 50.0f);
+		ImGui::DragFloatRange2("Scale Range", &dynamic_resolution.mMinScale, &dynamic_resolution.mMaxScale, 0.01f, 0.25f, 1.0f);
+	}
+	else
+	{
+		ImGui::SliderFloat("Resolution Scale", &dynamic_resolution.mScale, 0.25f, 1.0f);
+	}
+	ImGui::Text("Scale %.3f, %dx%d of %dx%d", dynamic_resolution.mScale, render_width, render_height, framebuffer_width, framebuffer_height);
+	if (dynamic_resolution.mEnabled)
+	{
+		ImGui::Text("Scaled passes %.2f ms, fixed passes %.2f ms", dynamic_resolution.mScaledMs, dynamic_resolution.mFixedMs);
+	}
+	for (int i = 0; i < dynamic_resolution.mDecisionCount; i++)
+	{
+		const DynamicResolutionDecision& decision = dynamic_resolution.Decision(i);
+		ImGui::Text("frame %u: %.3f -> %.3f, %s (%.2f + %.2f ms)", decision.frame, decision.old_scale, decision.new_scale, decision.reason, decision.scaled_ms, decision.fixed_ms);
+	}
+
+	static char timings_filename[filename_len] = "gpu_timings.csv";
+	ImGui::InputText("CSV filename", timings_filename, filename_len);
+	if (ImGui::Button("Export CSV"))
+	{
+		gpu_timers.ExportCsv(timings_filename);
+	}
+
+	// CPU markers, written together with the GPU history as a Chrome/Perfetto trace
+	bool cpu_markers = profiler_enabled.load();
+	if (ImGui::Checkbox("Record CPU markers", &cpu_markers))
+	{
+		profiler_enabled.store(cpu_markers);
+	}
+	static char trace_filename[filename_len] = "trace.json";
+	ImGui::InputText("Trace filename", trace_filename, filename_len);
+	if (ImGui::Button("Write Trace"))
+	{
+		WriteChromeTrace(trace_filename, &gpu_timers);
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Clear Markers"))
+	{
+		ProfilerClear();
+	}
+	ImGui::End();
+
+	// Draw aggregated GL debug output (debug builds register the callback)
+	ImGui::Begin("GL Debug Window");
+	ImGui::Text("%u messages, %u errors, %u performance warnings", DebugMessageCount(), DebugTypeCount(GL_DEBUG_TYPE_ERROR), DebugTypeCount(GL_DEBUG_TYPE_PERFORMANCE));
+	ImGui::Text("Severity high %u, medium %u, low %u, notification %u", DebugSeverityCount(GL_DEBUG_SEVERITY_HIGH), DebugSeverityCount(GL_DEBUG_SEVERITY_MEDIUM),
+		DebugSeverityCount(GL_DEBUG_SEVERITY_LOW), DebugSeverityCount(GL_DEBUG_SEVERITY_NOTIFICATION));
+	ImGui::Text("Source API %u, shader compiler %u, window system %u, other %u", DebugSourceCount(GL_DEBUG_SOURCE_API), DebugSourceCount(GL_DEBUG_SOURCE_SHADER_COMPILER),
+		DebugSourceCount(GL_DEBUG_SOURCE_WINDOW_SYSTEM), DebugSourceCount(GL_DEBUG_SOURCE_OTHER) + DebugSourceCount(GL_DEBUG_SOURCE_THIRD_PARTY) + DebugSourceCount(GL_DEBUG_SOURCE_APPLICATION));
+	if (DebugMessagesDropped() > 0)
+	{
+		ImGui::Text("%u dropped (queue full)", DebugMessagesDropped());
+	}
+	ImGui::Checkbox("Break on first error", &debug_break_on_error);
+	ImGui::SameLine();
+	if (ImGui::Button("Clear"))
+	{
+		ClearDebugMessages();
+	}
+	std::vector<DebugMessageEntry> debug_messages = DebugMessageList();
+	if (ImGui::CollapsingHeader("Performance warnings", ImGuiTreeNodeFlags_DefaultOpen))
+	{
+		for (size_t i = 0; i < debug_messages.size(); i++)
+		{
+			if (debug_messages[i].type == GL_DEBUG_TYPE_PERFORMANCE)
+			{
+				ImGui::TextWrapped("%6ux  %s", debug_messages[i].count, debug_messages[i].text.c_str());
+			}
+		}
+	}
+	if (ImGui::CollapsingHeader("All messages"))
+	{
+		for (size_t i = 0; i < debug_messages.size(); i++)
+		{
+			const DebugMessageEntry& m = debug_messages[i];
+			const ImVec4 color = m.type == GL_DEBUG_TYPE_ERROR || m.severity == GL_DEBUG_SEVERITY_HIGH ? ImVec4(1.0f, 0.3f, 0.3f, 1.0f) : ImVec4(1.0f, 1.0f, 1.0f, 1.0f);
+			ImGui::TextColored(color, "%6ux  %s %s %s id %u", m.count, DebugSeverityName(m.severity), DebugTypeName(m.type), DebugSourceName(m.source), m.id);
+			ImGui::TextWrapped("%s", m.text.c_str());
+		}
+	}
+	ImGui::End();
+
+	// Draw GPU memory use
+	ImGui::Begin("GPU Memory Window");
+	ImGui::Text("%d objects, %.2f MB", GpuResourceCount(), GpuMemoryBytes() / (1024.0 * 1024.0));
+	for (int k = 0; k < GPU_RESOURCE_KIND_COUNT; k++)
+	{
+		ImGui::Text("%-12s %4d  %8.2f MB", GpuResourceKindName(k), GpuResourceCount(k), GpuMemoryBytes(k) / (1024.0 * 1024.0));
+	}
+	const int leaked = GpuLeakedCount();
+	if (leaked > 0)
+	{
+		ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "%d objects look leaked (same owner allocated twice)", leaked);
+	}
+	ImGui::Text("Render targets: %dx%d, %d in %d textures, %.2f MB (%.2f MB unaliased)", render_targets.mWidth, render_targets.mHeight,
+		(int)render_targets.mTargets.size(), (int)render_targets.mStorage.size(),
+		render_targets.Bytes() / (1024.0 * 1024.0), render_targets.UnaliasedBytes() / (1024.0 * 1024.0));
+	ImGui::Text("Reallocated %d times", render_targets.mAllocations - 1);
+	if (paint_layer_targets.mWidth > 0)
+	{
+		ImGui::Text("Paint layer: %dx%d, %.2f MB", paint_layer_targets.mWidth, paint_layer_targets.mHeight, paint_layer_targets.Bytes() / (1024.0 * 1024.0));
+	}
+	else
+	{
+		ImGui::Text("Paint layer: not allocated");
+	}
+	if (ImGui::CollapsingHeader("Render Targets"))
+	{
+		for (size_t s = 0; s < render_targets.mStorage.size(); s++)
+		{
+			ImGui::Text("%s  %8.1f KB:", render_targets.mStorage[s].owner, render_targets.mStorage[s].bytes / 1024.0);
+			for (size_t i = 0; i < render_targets.mTargets.size(); i++)
+			{
+				const RenderTarget& target = render_targets.mTargets[i];
+				if (target.storage == (int)s)
+				{
+					ImGui::Text("    %-16s %s .. %s", target.name, GpuPassName(target.first_pass), GpuPassName(target.last_pass));
+				}
+			}
+		}
+	}
+	if (ImGui::CollapsingHeader("Resources"))
+	{
+		std::vector<GpuResource> gpu_resources = GpuResources();
+		for (size_t i = 0; i < gpu_resources.size(); i++)
+		{
+			const GpuResource& r = gpu_resources[i];
+			ImGui::Text("%-12s %10.1f KB  %s", GpuResourceKindName(r.kind), r.bytes / 1024.0, r.owner.c_str());
+		}
+	}
+	if (ImGui::Button("Print Report"))
+	{
+		GpuMemoryReport(false);
+	}
 	ImGui::End();
 
 	// End ImGui Frame
 	ImGui::Render();
+	gpu_timers.Begin(GPU_PASS_GUI);
 	ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+	gpu_timers.End(GPU_PASS_GUI);
+}
+#endif
+
+glm::mat4 model_matrix()
+{
+	return glm::rotate(angle, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::scale(glm::vec3(scale * mesh_data.mScaleFactor));
 }
 
 void sendUniforms() {
 	// sends the uniform to current active shader program
+	PROFILE_SCOPE("sendUniforms");
 
-	glm::mat4 M = glm::rotate(angle, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::scale(glm::vec3(scale * mesh_data.mScaleFactor));
+	glm::mat4 M = model_matrix();
 	glm::mat4 V = glm::lookAt(glm::vec3(SceneData.eye_w.x, SceneData.eye_w.y, SceneData.eye_w.z), center, glm::vec3(0.0f, 1.0f, 0.0f));
 	glm::mat4 P = glm::perspective(glm::pi<float>() / 4.0f, aspect, 0.1f, 100.0f);
 	SceneData.P = P;
@@ -266,7 +706,8 @@ void sendUniforms() {
 	glUniform1f(UniformLocs::mesh_d, mesh_d);
 	glUniform1f(UniformLocs::mesh_range, mesh_range);
 	//glUniform1f(UniformLocs::scale, scale);
-	glUniform1f(UniformLocs::sim_rad, simulation_radius);
+	glUniform1f(UniformLocs::sim_rad, simulation_radius * render_width / glm::max(framebuffer_width, 1)); // point sprite pixels
+	glUniform1f(UniformLocs::particle_radius, particle_radius);
 
 	glBindBuffer(GL_UNIFORM_BUFFER, scene_ubo); //Bind the OpenGL UBO before we update the data.
 	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(SceneData), &SceneData); //Upload the new uniform values.
@@ -281,26 +722,504 @@ void sendUniforms() {
 	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(MaterialUniforms), &MaterialData); //Upload the new uniform values.
 }
 
+// One eye-facing quad per particle, which impostor_vs turns into a ray-traced sphere
+void draw_particle_spheres()
+{
+	glVertexAttribDivisor(0, 1); // one position per quad, on whichever buffer the VAO reads
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, NUM_PARTICLES);
+	glVertexAttribDivisor(0, 0); // the brush pass still draws a point per particle
+}
+
+// Particles for the geometry pass, drawn with the program from particle_program()
+void draw_particles()
+{
+	if (particle_display == particle_style::sphere_impostors)
+	{
+		draw_particle_spheres();
+	}
+	else if (particle_display == particle_style::fluid_surface)
+	{
+		glDrawArrays(GL_TRIANGLES, 0, 3); // full-screen triangle over the smoothed depth
+	}
+	else
+	{
+		glDrawArrays(GL_POINTS, 0, NUM_PARTICLES);
+	}
+}
+
+GLuint particle_program()
+{
+	if (particle_display == particle_style::sphere_impostors)
+	{
+		return impostor_shader_program;
+	}
+	if (particle_display == particle_style::fluid_surface)
+	{
+		return fluid_shader_program;
+	}
+	return toon_shader_program;
+}
+
+// for fluid_smooth_comp and fluid_fs, on top of sendUniforms()
+void send_fluid_uniforms()
+{
+	const float world_radius = particle_radius * scale * mesh_data.mScaleFactor; // radius after M
+	glUniform1f(UniformLocs::filter_radius, surface_smoothing * world_radius);
+	glUniform2i(UniformLocs::viewport, render_width, render_height);
+}
+
+// Depth of the fluid surface: the nearest sphere per pixel, then a separable bilateral filter along
+// x and y. The result in fluid_depth_tex is shaded by fluid_fs with one fragment per pixel, so
+// only this pass depends on the number of particles.
+void render_fluid_depth()
+{
+	gpu_timers.Begin(GPU_PASS_FLUID_DEPTH);
+	glUseProgram(fluid_depth_program);
+	sendUniforms();
+	glBindFramebuffer(GL_FRAMEBUFFER, fluid_fbo);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f); // 0: no fluid
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	draw_particle_spheres();
+	glBindFramebuffer(GL_FRAMEBUFFER, screen_fbo);
+	gpu_timers.End(GPU_PASS_FLUID_DEPTH);
+
+	gpu_timers.Begin(GPU_PASS_FLUID_SMOOTH);
+	glUseProgram(fluid_smooth_program);
+	send_fluid_uniforms();
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	// x: depth -> smooth, y: smooth -> depth
+	const GLuint src[2] = { fluid_depth_tex, fluid_smooth_tex };
+	const GLuint dst[2] = { fluid_smooth_tex, fluid_depth_tex };
+	for (int i = 0; i < 2; i++)
+	{
+		glUniform2i(UniformLocs::smooth_direction, 1 - i, i);
+		glBindImageTexture(0, src[i], 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		glBindImageTexture(1, dst[i], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		glDispatchCompute((render_width + 15) / 16, (render_height + 15) / 16, 1); // local size 16x16
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+	glBindTextureUnit(1, fluid_depth_tex);
+	gpu_timers.End(GPU_PASS_FLUID_SMOOTH);
+}
+
+// Outlines for the brush strokes: Sobel on the G-buffer depth once per pixel, then a jump flood
+// gives every pixel its nearest outline, so thick lines cost no more than thin ones. brush_fs reads
+// edge_tex with one fetch.
+void render_edges()
+{
+	gpu_timers.Begin(GPU_PASS_EDGES);
+	glUseProgram(edge_program);
+	glUniform2i(UniformLocs::viewport, render_width, render_height);
+	glUniform1f(UniformLocs::outline_radius, outline_thickness);
+	glBindTextureUnit(0, fbo_tex);
+	glBindTextureUnit(3, fbo_depth_tex);
+	glBindImageTexture(0, edge_radius_tex, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R16F);
+	glBindImageTexture(3, edge_tex, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R16F);
+
+	// detect, jumps from the first power of two that reaches the thickest outline down to 1, 1 again, resolve
+	std::vector<int> jumps(1, 0);
+	int first_jump = 1;
+	while (2 * first_jump - 1 < outline_thickness + 1.0f)
+	{
+		first_jump *= 2;
+	}
+	for (int jump = first_jump; jump >= 1; jump /= 2)
+	{
+		jumps.push_back(jump);
+	}
+	jumps.push_back(1);
+	jumps.push_back(-1);
+
+	int seeds = 0; // edge_seed_tex being read
+	for (size_t i = 0; i < jumps.size(); i++)
+	{
+		glUniform1i(UniformLocs::jump, jumps[i]);
+		glBindImageTexture(1, edge_seed_tex[seeds], 0, GL_FALSE, 0, GL_READ_ONLY, GL_RG16I);
+		glBindImageTexture(2, edge_seed_tex[1 - seeds], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16I);
+		glDispatchCompute((render_width + 15) / 16, (render_height + 15) / 16, 1); // local size 16x16
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+		seeds = 1 - seeds;
+	}
+	glBindTextureUnit(4, edge_tex);
+	gpu_timers.End(GPU_PASS_EDGES);
+}
+
+// One stroke per mesh seed or particle, written by brush_comp.glsl for the indirect draw
+void generate_brush_strokes(const BrushCulling& culling)
+{
+	if (obj_mode == 0 && brush_density != brush_strokes.mSeedDensity)
+	{
+		brush_strokes.SeedMesh(mesh_data, brush_density); // slider or scene file changed it
+	}
+
+	glUseProgram(brush_comp_program);
+	glUniformMatrix4fv(UniformLocs::M, 1, false, glm::value_ptr(model_matrix()));
+	glUniform1i(UniformLocs::mode, obj_mode);
+	glUniform1f(UniformLocs::mesh_d, mesh_d);
+	glUniform1f(UniformLocs::mesh_range, mesh_range);
+	glUniform1f(UniformLocs::scale, scale);
+	glUniform2i(UniformLocs::viewport, render_width, render_height);
+
+	BrushSources sources = brush_strokes.MeshSources();
+	if (obj_mode == 1)
+	{
+		// the same positions particle_position_vao reads
+		sources.buffer = replaying ? replay_vbo : particles_ssbo;
+		sources.stride = replaying ? 4 : sizeof(Particle) / sizeof(float);
+		sources.count = NUM_PARTICLES;
+	}
+	brush_strokes.Generate(sources, culling);
+}
+
+// Back to front order of the strokes for STROKE_BLEND_SORTED; returns the StrokeOrder to draw in
+int sort_brush_strokes(int blend)
+{
+	if (blend != STROKE_BLEND_SORTED)
+	{
+		return STROKE_ORDER_GENERATED;
+	}
+	glUseProgram(stroke_sort_program);
+	brush_strokes.Sort();
+	return STROKE_ORDER_BACK_TO_FRONT;
+}
+
+// The strokes straight into target, alpha blended, or as material color weights into the paint
+// layer for resolve_paint_layer(). Weighted blended OIT always goes through the layer: it blends
+// additively into the color weights and their sum in the alpha of layer 0, and multiplies 1 - alpha
+// into the alpha of layer 1, none of which is a color before the resolve divides them out.
+void draw_brush_strokes(GLuint target, int blend, bool layer, int order)
+{
+	const bool weighted = blend == STROKE_BLEND_WEIGHTED;
+	layer = layer || weighted;
+
+	// instanced quads draw brush strokes
+	glUseProgram(brush_shader_program);
+	sendUniforms();
+	glUniform1i(UniformLocs::paint_layer, layer);
+	glUniform1i(UniformLocs::weighted_blend, weighted);
+	glUniform1i(UniformLocs::stroke_order, order);
+	glEnable(GL_BLEND);
+	glDepthMask(GL_FALSE);
+	if (layer)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, paint_layer_fbo);
+		const GLfloat zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		const GLfloat uncovered[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+		for (int i = 0; i < 3; i++)
+		{
+			glClearBufferfv(GL_COLOR, i, (weighted && i == 1) ? uncovered : zero);
+		}
+		if (weighted)
+		{
+			glBlendFunc(GL_ONE, GL_ONE);
+			glBlendFuncSeparatei(1, GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+		}
+		else
+		{
+			glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA); // brush_fs premultiplies the layer
+		}
+	}
+	else
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, target);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	}
+	brush_strokes.Draw();
+	glDisable(GL_BLEND);
+	glDepthMask(GL_TRUE);
+	glBindFramebuffer(GL_FRAMEBUFFER, target);
+}
+
+// The paint layer times the current material colors, over the composite in target
+void resolve_paint_layer(GLuint target, int blend)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, target);
+	glUseProgram(paint_resolve_shader_program);
+	glUniform1i(UniformLocs::weighted_blend, blend == STROKE_BLEND_WEIGHTED);
+	for (int i = 0; i < 3; i++)
+	{
+		glBindTextureUnit(6 + i, paint_layer_tex[i]);
+	}
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+	glDepthMask(GL_FALSE);
+	glDepthFunc(GL_ALWAYS);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+	glDisable(GL_BLEND);
+}
+
+// Every StrokeBlend over a copy of the composite in scene_fbo, timed and read back to measure over
+// and weighted against the sorted reference, and each of them against itself drawn front to back.
+// Waits for every query and readback, so it only runs once when asked for.
+void compare_stroke_blending()
+{
+	const int width = render_width;
+	const int height = render_height;
+	struct BlendRun
+	{
+		int blend;
+		int order;
+	};
+	// the reference first: it leaves the order the front to back runs read
+	const BlendRun runs[5] = { { STROKE_BLEND_SORTED, STROKE_ORDER_BACK_TO_FRONT }, { STROKE_BLEND_OVER, STROKE_ORDER_GENERATED },
+		{ STROKE_BLEND_WEIGHTED, STROKE_ORDER_GENERATED }, { STROKE_BLEND_OVER, STROKE_ORDER_FRONT_TO_BACK }, { STROKE_BLEND_WEIGHTED, STROKE_ORDER_FRONT_TO_BACK } };
+	const int repeats = 5;
+	std::vector<unsigned char> images[5];
+	GLuint query;
+	glGenQueries(1, &query);
+	for (int r = 0; r < 5; r++)
+	{
+		const int blend = runs[r].blend;
+		float best_ms = 0.0f;
+		for (int i = 0; i < repeats; i++)
+		{
+			glCopyImageSubData(scene_tex, GL_TEXTURE_2D, 0, 0, 0, 0, blend_compare_tex, GL_TEXTURE_2D, 0, 0, 0, 0, width, height, 1);
+			glBeginQuery(GL_TIME_ELAPSED, query);
+			const int order = (blend == STROKE_BLEND_SORTED) ? sort_brush_strokes(blend) : runs[r].order;
+			draw_brush_strokes(blend_compare_fbo, blend, false, order);
+			if (blend == STROKE_BLEND_WEIGHTED)
+			{
+				resolve_paint_layer(blend_compare_fbo, blend);
+			}
+			glEndQuery(GL_TIME_ELAPSED);
+			GLuint64 ns = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+			best_ms = (i == 0) ? ns * 1e-6f : glm::min(best_ms, ns * 1e-6f);
+		}
+		if (runs[r].order != STROKE_ORDER_FRONT_TO_BACK)
+		{
+			blend_comparison.ms[blend] = best_ms;
+		}
+		images[r].resize((size_t)width * height * 4);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, blend_compare_fbo);
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, images[r].data());
+	}
+	glDeleteQueries(1, &query);
+	glBindFramebuffer(GL_FRAMEBUFFER, scene_fbo);
+
+	// rms and largest difference of the color channels
+	auto difference = [](const std::vector<unsigned char>& a, const std::vector<unsigned char>& b, float* max_error)
+	{
+		double sum = 0.0;
+		int largest = 0;
+		for (size_t i = 0; i < a.size(); i++)
+		{
+			if (i % 4 == 3)
+			{
+				continue;
+			}
+			const int d = abs((int)a[i] - (int)b[i]);
+			sum += d * d;
+			largest = glm::max(largest, d);
+		}
+		if (max_error != NULL)
+		{
+			*max_error = (float)largest;
+		}
+		return a.empty() ? 0.0f : (float)sqrt(sum / (a.size() / 4 * 3));
+	};
+	for (int b = 0; b < STROKE_BLEND_COUNT; b++)
+	{
+		blend_comparison.rms_error[b] = 0.0f;
+		blend_comparison.max_error[b] = 0.0f;
+		blend_comparison.order_rms[b] = 0.0f;
+	}
+	blend_comparison.rms_error[STROKE_BLEND_OVER] = difference(images[1], images[0], &blend_comparison.max_error[STROKE_BLEND_OVER]);
+	blend_comparison.rms_error[STROKE_BLEND_WEIGHTED] = difference(images[2], images[0], &blend_comparison.max_error[STROKE_BLEND_WEIGHTED]);
+	blend_comparison.order_rms[STROKE_BLEND_OVER] = difference(images[1], images[3], NULL);
+	blend_comparison.order_rms[STROKE_BLEND_WEIGHTED] = difference(images[2], images[4], NULL);
+
+	blend_comparison.strokes = 0;
+	glGetNamedBufferSubData(brush_strokes.mDrawCommand, offsetof(DrawArraysIndirectCommand, instance_count), sizeof(GLuint), &blend_comparison.strokes);
+	blend_comparison.width = width;
+	blend_comparison.height = height;
+	blend_comparison.valid = true;
+
+	std::cout << "Stroke blending, " << blend_comparison.strokes << " strokes at " << width << "x" << height << ":" << std::endl;
+	for (int b = 0; b < STROKE_BLEND_SORTED; b++)
+	{
+		std::cout << "  " << stroke_blend_names[b] << ": " << blend_comparison.ms[b] << " ms, error rms " << blend_comparison.rms_error[b]
+			<< " max " << blend_comparison.max_error[b] << " against sorted, rms " << blend_comparison.order_rms[b] << " drawn front to back" << std::endl;
+	}
+	std::cout << "  sorted: " << blend_comparison.ms[STROKE_BLEND_SORTED] << " ms" << std::endl;
+}
+
+// Brush strokes over the composite in scene_fbo. stroke_cache decides how much of last frame's
+// work still holds: the strokes while the camera stays within their guard band, the painted layer
+// while only the material colors change.
+void render_paint()
+{
+	const bool compare_blending = blend_comparison.requested;
+	if (compare_blending)
+	{
+		blend_comparison.requested = false;
+		stroke_cache.Invalidate(); // fresh strokes, and the comparison overwrites the layer
+	}
+
+	BrushCulling culling = brush_culling;
+	culling.guard_band = stroke_cache.mEnabled ? STROKE_CACHE_GUARD_BAND : 0.0f;
+
+	// everything brush_comp reads but the view matrix; SceneData is current since pass 0
+	StrokeCacheKey stroke_inputs;
+	stroke_inputs.Add(obj_mode);
+	stroke_inputs.Add(model_matrix());
+	stroke_inputs.Add(SceneData.P);
+	stroke_inputs.Add(mesh_d);
+	stroke_inputs.Add(mesh_range);
+	stroke_inputs.Add(scale);
+	stroke_inputs.Add(MaterialData.brush_scale);
+	stroke_inputs.Add(render_width);
+	stroke_inputs.Add(render_height);
+	stroke_inputs.Add(culling.enabled);
+	stroke_inputs.Add(culling.cull_pixels);
+	stroke_inputs.Add(culling.lod_pixels);
+	stroke_inputs.Add(culling.guard_band);
+	if (obj_mode == 0)
+	{
+		stroke_inputs.Add(display_mesh);
+		stroke_inputs.Add(brush_density);
+	}
+	else
+	{
+		stroke_inputs.Add(replaying);
+		stroke_inputs.Add(particle_version);
+	}
+	const bool regenerate = stroke_cache.NeedStrokes(stroke_inputs, SceneData.V);
+
+	// and what else reaches brush_vs, brush_fs and the G-buffer and edge map they sample, colors aside
+	StrokeCacheKey layer_inputs = stroke_inputs;
+	layer_inputs.Add(SceneData.V);
+	layer_inputs.Add(SceneData.eye_w);
+	layer_inputs.Add(SceneData.light_w);
+	layer_inputs.Add(MaterialData.shininess);
+	layer_inputs.Add(outline_thickness);
+	layer_inputs.Add(particle_display);
+	layer_inputs.Add(particle_radius);
+	layer_inputs.Add(simulation_radius);
+	layer_inputs.Add(surface_smoothing);
+	layer_inputs.Add(render_targets.mAllocations);
+	layer_inputs.Add(paint_layer_targets.mAllocations);
+	layer_inputs.Add(stroke_cache.mGenerations);
+	layer_inputs.Add(stroke_blend);
+	const StrokeCacheAction action = stroke_cache.LayerAction(layer_inputs);
+
+	if (action != STROKE_CACHE_RESOLVE)
+	{
+		render_edges();
+	}
+	if (regenerate)
+	{
+		gpu_timers.Begin(GPU_PASS_BRUSH_STROKES);
+		generate_brush_strokes(culling);
+		gpu_timers.End(GPU_PASS_BRUSH_STROKES);
+	}
+
+	if (compare_blending)
+	{
+		compare_stroke_blending(); // between the timed passes, its queries can't nest in theirs
+	}
+
+	gpu_timers.Begin(GPU_PASS_BRUSH);
+	if (action != STROKE_CACHE_RESOLVE)
+	{
+		const int order = sort_brush_strokes(stroke_blend);
+		draw_brush_strokes(scene_fbo, stroke_blend, action == STROKE_CACHE_DRAW_LAYER, order);
+	}
+	if (action != STROKE_CACHE_DIRECT || stroke_blend == STROKE_BLEND_WEIGHTED)
+	{
+		resolve_paint_layer(scene_fbo, stroke_blend);
+	}
+	gpu_timers.End(GPU_PASS_BRUSH);
+}
+
+// The paint layer lives from one frame to the next, so it is only kept while the paint style
+// uses it: for the stroke cache, for weighted blending, or for a blend comparison this frame.
+bool paint_layer_needed()
+{
+	return style == render_style::paint && (stroke_cache.mEnabled || stroke_blend == STROKE_BLEND_WEIGHTED || blend_comparison.requested);
+}
+
+// Size the screen-sized targets to the framebuffer, reattaching the framebuffers when the
+// textures were recreated. Called before every frame, so it only does work after a resize or
+// when the paint layer is turned on or off.
+void allocate_render_targets()
+{
+	if (render_targets.Allocate(framebuffer_width, framebuffer_height))
+	{
+		// G-buffer of the geometry pass
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fbo_tex, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, fbo_color_tex, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, fbo_depth_tex, 0);
+
+		// fluid surface depth, sharing the depth buffer since the two are never drawn at the same time
+		glBindFramebuffer(GL_FRAMEBUFFER, fluid_fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fluid_depth_tex, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, fbo_depth_tex, 0);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, scene_fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, scene_tex, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, scene_depth, 0);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, blend_compare_fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, blend_compare_tex, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, scene_depth, 0);
+	}
+
+	// a resize reallocates both pools, so the layer is always attached to the current scene_depth
+	if (!paint_layer_needed())
+	{
+		paint_layer_targets.Release();
+	}
+	else if (paint_layer_targets.Allocate(framebuffer_width, framebuffer_height))
+	{
+		// the strokes are depth tested against the composite like when drawn into scene_fbo
+		glBindFramebuffer(GL_FRAMEBUFFER, paint_layer_fbo);
+		const GLenum layer_attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+		for (int i = 0; i < 3; i++)
+		{
+			glFramebufferTexture2D(GL_FRAMEBUFFER, layer_attachments[i], GL_TEXTURE_2D, paint_layer_tex[i], 0);
+		}
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, scene_depth, 0);
+		glDrawBuffers(3, layer_attachments);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, screen_fbo);
+}
+
 // This function gets called every time the scene gets redisplayed
 void display(GLFWwindow* window)
 {
+	PROFILE_SCOPE("display");
+	gpu_timers.BeginFrame();
+	allocate_render_targets(); // after a resize
+	dynamic_resolution.Update(gpu_timers);
+	dynamic_resolution.RenderSize(framebuffer_width, framebuffer_height, &render_width, &render_height);
+
 	// Clear the screen to the color previously specified in the glClearColor(...) call.
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	// Use compute shader
 	if (obj_mode == 1) {
 		glBindVertexArray(particle_position_vao);
-		if (simulate)
+		if (replaying)
 		{
-			glUseProgram(compute_programs[0]); // Use density and pressure calculation program
-			glDispatchCompute(NUM_WORK_GROUPS, 1, 1);
-			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-			glUseProgram(compute_programs[1]); // Use force calculation program
-			glDispatchCompute(NUM_WORK_GROUPS, 1, 1);
-			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-			glUseProgram(compute_programs[2]); // Use integration calculation program
-			glDispatchCompute(NUM_WORK_GROUPS, 1, 1);
-			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+			update_replay(); // recorded positions replace the compute passes
+		}
+		else if (simulate)
+		{
+			step_simulation(compute_programs, NUM_PARTICLES, time_step, &gpu_timers);
+			sim_frame++;
+			particle_version++;
+
+			if (trajectory_recording())
+			{
+				particle_readback.Capture(particles_ssbo, sim_frame, READBACK_TRAJECTORY | (checkpoint_requested ? READBACK_CHECKPOINT : 0), consume_particle_readback);
+				checkpoint_requested = false;
+			}
 		}
 	}
 	else {
@@ -308,81 +1227,110 @@ void display(GLFWwindow* window)
 		glBindVertexArray(mesh_data.mVao);
 	}
 
+	if (checkpoint_requested)
+	{
+		// not recording or paused: capture just for the checkpoint
+		particle_readback.Capture(particles_ssbo, sim_frame, READBACK_CHECKPOINT, consume_particle_readback);
+		checkpoint_requested = false;
+	}
+
+	glViewport(0, 0, render_width, render_height); // every pass up to the upscale
+	const bool surface_pass = obj_mode == 1 && particle_display == particle_style::fluid_surface;
+	if (surface_pass)
+	{
+		render_fluid_depth();
+	}
+
 	// toon shader
-	glUseProgram(toon_shader_program);
+	glUseProgram(obj_mode == 1 ? particle_program() : toon_shader_program);
 	// Set uniforms
 	sendUniforms();
+	if (surface_pass)
+	{
+		send_fluid_uniforms();
+	}
 
-	// pass 0: render scene info needed for compositing into the texture: 
-	// bw image, depth value for contour edge detection, alpha
+	// pass 0: the only geometry pass, into the G-buffer:
+	// bw image, depth value for contour edge detection and alpha in fbo_tex, shaded color in fbo_color_tex
 	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-	glUniform1i(UniformLocs::pass, 0);
+	gpu_timers.Begin(GPU_PASS_FBO);
 	glBindFramebuffer(GL_FRAMEBUFFER, fbo); // Render to FBO.
-	glBindTextureUnit(0, fbo_tex);
-	glDrawBuffer(GL_COLOR_ATTACHMENT0);
+	const GLenum gbuffer_attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, gbuffer_attachments);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	// draw mesh or particles
 	if (obj_mode == 1)
 	{
-		glDrawArrays(GL_POINTS, 0, NUM_PARTICLES);
+		draw_particles();
 	}
 	else {
 		glDrawElements(GL_TRIANGLES, mesh_data.mSubmesh[0].mNumIndices, GL_UNSIGNED_INT, 0);
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, screen_fbo);
+	gpu_timers.End(GPU_PASS_FBO);
 
-	// pass 1: draw what we see on screen
+	// pass 1: full-screen Sobel outline over the G-buffer, composited into scene_fbo
+	gpu_timers.Begin(GPU_PASS_SCREEN);
+	glBindFramebuffer(GL_FRAMEBUFFER, scene_fbo);
 	glClearColor(clear_color.r, clear_color.g, clear_color.b, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glUniform1i(UniformLocs::pass, 1);
-	if (obj_mode == 1)
-	{
-		glDrawArrays(GL_POINTS, 0, NUM_PARTICLES);
-	}
-	else {
-		glDrawElements(GL_TRIANGLES, mesh_data.mSubmesh[0].mNumIndices, GL_UNSIGNED_INT, 0);
-	}
+	glUseProgram(composite_shader_program);
+	glBindTextureUnit(0, fbo_tex);
+	glBindTextureUnit(2, fbo_color_tex);
+	glBindTextureUnit(3, fbo_depth_tex);
+	glDepthFunc(GL_ALWAYS); // the composite only copies the depth the geometry pass already tested
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glDepthFunc(GL_LESS);
+	gpu_timers.End(GPU_PASS_SCREEN);
 
 	if (style == render_style::paint) {
-
-		// add brush strokes 
-
-		// geometry_shader draw brush strokes
-		glUseProgram(brush_shader_program);
-		sendUniforms();
-
-		// enable alpha blending and disable depth 
-		glEnable(GL_BLEND);
-		glDepthMask(GL_FALSE);
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-		if (obj_mode == 1)
-		{
-			glDrawArrays(GL_POINTS, 0, NUM_PARTICLES);
-		}
-		else {
-			glDrawElements(GL_POINTS, mesh_data.mSubmesh[0].mNumIndices, GL_UNSIGNED_INT, 0);
-		}
-		glDisable(GL_BLEND);
-		glDepthMask(GL_TRUE);
-		// unbind
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		render_paint();
 	}
 
+	// upscale to the screen, edge-aware so the outlines stay sharp
+	gpu_timers.Begin(GPU_PASS_UPSCALE);
+	glBindFramebuffer(GL_FRAMEBUFFER, screen_fbo);
+	glViewport(0, 0, framebuffer_width, framebuffer_height);
+	glUseProgram(upscale_shader_program);
+	glUniform2i(UniformLocs::viewport, render_width, render_height);
+	glUniform2i(UniformLocs::window, framebuffer_width, framebuffer_height);
+	glBindTextureUnit(5, scene_tex);
+	glDepthFunc(GL_ALWAYS);
+	glDepthMask(GL_FALSE);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glDepthMask(GL_TRUE);
+	glDepthFunc(GL_LESS);
+	gpu_timers.End(GPU_PASS_UPSCALE);
+
 	// grab frame before gui draws
 	if (recording == true)
 	{
+		gpu_timers.Begin(GPU_PASS_CAPTURE);
 		glFinish();
-		glReadBuffer(GL_BACK);
-		int w, h;
-		glfwGetFramebufferSize(window, &w, &h);
-		read_frame_to_encode(&rgb, &pixels, w, h);
+		glReadBuffer(screen_fbo == 0 ? GL_BACK : GL_COLOR_ATTACHMENT0);
+		{
+			PROFILE_SCOPE("read_frame_to_encode");
+			read_frame_to_encode(&rgb, &pixels, framebuffer_width, framebuffer_height);
+		}
+		gpu_timers.End(GPU_PASS_CAPTURE);
+		PROFILE_SCOPE("encode_frame");
 		encode_frame(rgb);
 	}
 
+	{
+		PROFILE_SCOPE("particle_readback");
+		particle_readback.Poll(false, consume_particle_readback);
+	}
+
+	FlushDebugMessages(); // print and aggregate what the driver reported this frame
+
+#ifndef NPR_HEADLESS
 	draw_gui(window);
 
 	/* Swap front and back buffers */
+	PROFILE_SCOPE("swap_buffers");
 	glfwSwapBuffers(window);
+#endif
 }
 
 void idle()
@@ -394,6 +1342,7 @@ void idle()
 void prepare_shader(GLuint* shader_name, const char* vShaderFile, const char* gShaderFile, const char* fShaderFile)
 {
 	GLuint new_shader = gShaderFile != NULL ? InitShader(vShaderFile, gShaderFile, fShaderFile) : InitShader(vShaderFile, fShaderFile);
+	GpuTrackProgram(new_shader, vShaderFile);
 
 	if (new_shader == -1) // loading failed
 	{
@@ -403,16 +1352,15 @@ void prepare_shader(GLuint* shader_name, const char* vShaderFile, const char* gS
 	{
 		glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
 
-		if (*shader_name != -1)
-		{
-			glDeleteProgram(*shader_name);
-		}
+		GpuDeleteProgram(shader_name);
 		*shader_name = new_shader;
 	}
 }
 
 void reload_mesh()
 {
+	PROFILE_SCOPE("reload_mesh");
+	FreeMesh(mesh_data);
 	mesh_data = LoadMesh(mesh_options[mesh_id]);
 	glBindVertexArray(0); // Unbind VAO
 
@@ -421,35 +1369,41 @@ void reload_mesh()
 	// add mesh_d to vertex to offset everything to 0 and divide all by abs(min-max) 
 	mesh_range = glm::abs(mesh_data.mBbMin.z - mesh_data.mBbMax.z);
 
+	brush_strokes.SeedMesh(mesh_data, brush_density);
+
 	// set which mesh is being displayed
 	display_mesh = mesh_id;
 }
 
 void reload_shader()
 {
+	PROFILE_SCOPE("reload_shader");
 	prepare_shader(&toon_shader_program, toon_vs.c_str(), NULL, toon_fs.c_str());
-	prepare_shader(&brush_shader_program, brush_vs.c_str(), brush_gs.c_str(), brush_fs.c_str());
-
-	// Load compute shaders
-	GLuint compute_shader_handle = InitShader(rho_pres_com_shader.c_str());
-	if (compute_shader_handle != -1)
-	{
-		compute_programs[0] = compute_shader_handle;
-	}
-
-	compute_shader_handle = InitShader(force_comp_shader.c_str());
-	if (compute_shader_handle != -1)
-	{
-		compute_programs[1] = compute_shader_handle;
-	}
-
-	compute_shader_handle = InitShader(integrate_comp_shader.c_str());
-	if (compute_shader_handle != -1)
+	prepare_shader(&brush_shader_program, brush_vs.c_str(), NULL, brush_fs.c_str());
+	prepare_shader(&impostor_shader_program, impostor_vs.c_str(), NULL, impostor_fs.c_str());
+	prepare_shader(&fluid_depth_program, impostor_vs.c_str(), NULL, fluid_depth_fs.c_str());
+	prepare_shader(&fluid_shader_program, fullscreen_vs.c_str(), NULL, fluid_fs.c_str());
+	prepare_shader(&composite_shader_program, fullscreen_vs.c_str(), NULL, composite_fs.c_str());
+	prepare_shader(&upscale_shader_program, fullscreen_vs.c_str(), NULL, upscale_fs.c_str());
+	prepare_shader(&paint_resolve_shader_program, fullscreen_vs.c_str(), NULL, paint_resolve_fs.c_str());
+
+	// Load compute shaders, keeping the previous program if one fails to compile
+	const std::string* compute_shaders[7] = { &rho_pres_com_shader, &force_comp_shader, &integrate_comp_shader, &fluid_smooth_comp, &brush_comp, &edge_comp, &stroke_sort_comp };
+	GLuint* programs[7] = { &compute_programs[0], &compute_programs[1], &compute_programs[2], &fluid_smooth_program, &brush_comp_program, &edge_program, &stroke_sort_program };
+	for (int i = 0; i < 7; i++)
 	{
-		compute_programs[2] = compute_shader_handle;
+		GLuint compute_shader_handle = InitShader(compute_shaders[i]->c_str());
+		if (compute_shader_handle != -1)
+		{
+			GpuTrackProgram(compute_shader_handle, compute_shaders[i]->c_str());
+			GpuDeleteProgram(programs[i]);
+			*programs[i] = compute_shader_handle;
+		}
 	}
+	stroke_cache.Invalidate(); // drawn by the previous programs
 }
 
+#ifndef NPR_HEADLESS
 // This function gets called when a key is pressed
 void keyboard(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
@@ -459,6 +1413,10 @@ void keyboard(GLFWwindow* window, int key, int scancode, int action, int mods)
 		{
 		case 'r':
 		case 'R':
+			if (replaying)
+			{
+				stop_replay();
+			}
 			init_particles();
 			reload_shader();
 			break;
@@ -475,33 +1433,65 @@ void keyboard(GLFWwindow* window, int key, int scancode, int action, int mods)
 	}
 }
 
+#endif
+
 void resize(GLFWwindow* window, int width, int height)
 {
 	glViewport(0, 0, width, height); // Set viewport to cover entire framebuffer
 	aspect = float(width) / float(height); // Set aspect ratio
+	framebuffer_width = width;
+	framebuffer_height = height; // the render targets follow on the next display()
 }
 
 /// <summary>
-/// Make positions for a cube grid
+/// Connect the settings a scene file can hold to the globals above
 /// </summary>
-/// <returns>Vector of positions for the grid</returns>
-std::vector<glm::vec4> make_grid()
+void bind_scene_file()
 {
-	std::vector<glm::vec4> positions;
-
-	// 20x20x20 Cube of particles within [0, 0.095] on all axes
-	for (int i = 0; i < 10; i++)
+	static const char* const mode_names[] = { "mesh", "sph" };
+	static const char* const style_names[] = { "toon", "paint" };
+	static const char* mesh_names[3];
+	for (int i = 0; i < 3; i++)
 	{
-		for (int j = 0; j < 100; j++)
-		{
-			for (int k = 0; k < 10; k++)
-			{
-				positions.push_back(glm::vec4((float)i * PARTICLE_RADIUS, (float)j * PARTICLE_RADIUS, (float)k * PARTICLE_RADIUS, 1.0f));
-			}
-		}
+		mesh_names[i] = mesh_options[i].c_str();
 	}
 
-	return positions;
+	scene_file.BindEnum("mode", &obj_mode, mode_names, 2);
+	scene_file.BindEnum("mesh", &mesh_id, mesh_names, 3); // the main loop reloads the mesh when it changes
+	scene_file.BindEnum("style", &style, style_names, 2);
+
+	scene_file.BindFloat("angle", &angle);
+	scene_file.BindFloat("scale", &scale);
+	scene_file.BindFloat("eye", &SceneData.eye_w.x, 3);
+	scene_file.BindFloat("center", &center.x, 3);
+	scene_file.BindFloat("light", &SceneData.light_w.x, 3);
+	scene_file.BindFloat("background", &clear_color.r, 3);
+
+	scene_file.BindFloat("material.dark", &MaterialData.dark.r, 3);
+	scene_file.BindFloat("material.midtone", &MaterialData.midtone.r, 3);
+	scene_file.BindFloat("material.highlight", &MaterialData.highlight.r, 3);
+	scene_file.BindFloat("material.outline", &MaterialData.outline.r, 3);
+	scene_file.BindFloat("material.shininess", &MaterialData.shininess);
+	scene_file.BindFloat("material.brush_scale", &MaterialData.brush_scale);
+	scene_file.BindFloat("brush_density", &brush_density);
+	scene_file.BindFloat("outline_thickness", &outline_thickness);
+	scene_file.BindBool("dynamic_resolution", &dynamic_resolution.mEnabled);
+	scene_file.BindFloat("dynamic_resolution.target_ms", &dynamic_resolution.mTargetMs);
+	scene_file.BindFloat("dynamic_resolution.min_scale", &dynamic_resolution.mMinScale);
+	scene_file.BindFloat("dynamic_resolution.max_scale", &dynamic_resolution.mMaxScale);
+	scene_file.BindBool("brush_culling", &brush_culling.enabled);
+	scene_file.BindFloat("brush_cull_pixels", &brush_culling.cull_pixels);
+	scene_file.BindFloat("brush_lod_pixels", &brush_culling.lod_pixels);
+	scene_file.BindBool("stroke_cache", &stroke_cache.mEnabled);
+	scene_file.BindEnum("stroke_blend", &stroke_blend, stroke_blend_names, STROKE_BLEND_COUNT);
+
+	scene_file.BindBool("simulate", &simulate);
+	scene_file.BindFloat("particle_size", &simulation_radius);
+	static const char* const particle_names[] = { "points", "spheres", "surface" };
+	scene_file.BindEnum("particles", &particle_display, particle_names, 3);
+	scene_file.BindFloat("particle_radius", &particle_radius);
+	scene_file.BindFloat("surface_smoothing", &surface_smoothing);
+	BindSimulationSettings(scene_file, &ConstantsData, &BoundaryData, &time_step);
 }
 
 /// <summary>
@@ -510,32 +1500,160 @@ std::vector<glm::vec4> make_grid()
 void init_particles()
 {
 	// Initialize particle data
-	std::vector<Particle> particles(NUM_PARTICLES);
-	std::vector<glm::vec4> grid_positions = make_grid(); // Get grid positions
-	for (int i = 0; i < NUM_PARTICLES; i++)
+	free_particle_buffers(&particles_ssbo, &particle_position_vao);
+	std::vector<Particle> particles = make_particles(NUM_PARTICLES, BoundaryData);
+	init_particle_buffers(particles, &particles_ssbo, &particle_position_vao);
+
+	sim_frame = 0;
+	particle_version++;
+}
+
+/// <summary>
+/// Request a checkpoint. The particle buffer is captured through the readback ring at the end of
+/// this frame's simulation step and written to disk on a background thread once the copy lands.
+/// </summary>
+void save_checkpoint(const char* filename)
+{
+	pending_checkpoint.constants = ConstantsData;
+	pending_checkpoint.boundary = BoundaryData;
+	pending_checkpoint.time_step = time_step;
+	pending_checkpoint_filename = filename;
+	checkpoint_requested = true;
+}
+
+/// <summary>
+/// Receives particle buffer copies from the readback ring, one to three frames after they were captured
+/// </summary>
+void consume_particle_readback(const void* data, unsigned int frame, int tags)
+{
+	const Particle* particles = (const Particle*)data;
+
+	if (tags & READBACK_TRAJECTORY)
 	{
-		particles[i].pos = grid_positions[i];
-		particles[i].vel = glm::vec4(0.0f);
-		particles[i].force = glm::vec4(0.0f);
-		particles[i].extras = glm::vec4(0.0f); // 0 - rho, 1 - pressure, 2 - age
+		push_trajectory_frame(particles, NUM_PARTICLES);
 	}
 
-	// Generate and bind shader storage buffer
-	glGenBuffers(1, &particles_ssbo);
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, particles_ssbo);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(Particle) * NUM_PARTICLES, particles.data(), GL_STREAM_DRAW);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particles_ssbo);
+	if (tags & READBACK_CHECKPOINT)
+	{
+		CheckpointState state = pending_checkpoint;
+		state.particles.assign(particles, particles + NUM_PARTICLES);
+		state.frame = frame;
+		WaitForCheckpoint(); // only blocks if the user saves faster than the disk can keep up
+		SaveCheckpointAsync(pending_checkpoint_filename, std::move(state));
+		pending_checkpoint_filename.clear();
+	}
+}
+
+/// <summary>
+/// Open a recorded trajectory and point particle_position_vao at the replay buffer
+/// </summary>
+void start_replay(const char* filename)
+{
+	if (!replay_player.Open(filename))
+	{
+		return;
+	}
+	if (replay_player.NumParticles() != NUM_PARTICLES || replay_player.NumFrames() == 0)
+	{
+		std::cout << filename << " holds " << replay_player.NumParticles() << " particles, expected " << NUM_PARTICLES << std::endl;
+		replay_player.Close();
+		return;
+	}
+
+	if (replay_vbo == -1)
+	{
+		replay_vbo = GpuCreateBuffer(GL_ARRAY_BUFFER, sizeof(glm::vec4) * NUM_PARTICLES, nullptr, GL_STREAM_DRAW, "replay_vbo");
+	}
 
-	// Generate and bind VAO for particle positions
-	glGenVertexArrays(1, &particle_position_vao);
 	glBindVertexArray(particle_position_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, replay_vbo);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), nullptr);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+
+	replaying = true;
+	replay_paused = false;
+	replay_frame = 0.0f;
+	replay_uploaded = -1;
+	obj_mode = 1;
+	replay_player.Seek(0, 1);
+}
+
+/// <summary>
+/// Close the trajectory and let particle_position_vao read the simulation again
+/// </summary>
+void stop_replay()
+{
+	replay_player.Close();
+	replaying = false;
 
+	glBindVertexArray(particle_position_vao);
 	glBindBuffer(GL_ARRAY_BUFFER, particles_ssbo);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Particle), nullptr); // Bind buffer containing particle positions to VAO
-	glEnableVertexAttribArray(0); // Enable attribute with location = 0 (vertex position) for VAO
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Particle), nullptr);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+}
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0); // Unbind SSBO
-	glBindVertexArray(0); // Unbind VAO
+/// <summary>
+/// Advance the playback position and upload the frame if the reader thread has decoded it
+/// </summary>
+void update_replay()
+{
+	PROFILE_SCOPE("update_replay");
+	static std::vector<glm::vec4> positions;
+	const float last = (float)(replay_player.NumFrames() - 1);
+
+	if (!replay_paused)
+	{
+		replay_frame += replay_rate;
+		// loop around at either end
+		if (replay_frame > last) replay_frame = 0.0f;
+		if (replay_frame < 0.0f) replay_frame = last;
+	}
+	replay_frame = glm::clamp(replay_frame, 0.0f, last);
+
+	const int frame = (int)replay_frame;
+	replay_player.Seek(frame, replay_rate < 0.0f ? -1 : 1);
+
+	// if the frame isn't ready yet keep showing the previous one instead of stalling
+	if (frame != replay_uploaded && replay_player.GetFrame(frame, positions))
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, replay_vbo);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(glm::vec4) * NUM_PARTICLES, positions.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		replay_uploaded = frame;
+		particle_version++;
+	}
+}
+
+/// <summary>
+/// Map a checkpoint file and upload its payload straight into the particle buffer
+/// </summary>
+void load_checkpoint(const char* filename)
+{
+	CheckpointView view;
+	if (!MapCheckpoint(filename, &view))
+	{
+		return;
+	}
+
+	if (view.header->num_particles != NUM_PARTICLES)
+	{
+		std::cout << filename << " holds " << view.header->num_particles << " particles, expected " << NUM_PARTICLES << std::endl;
+		UnmapCheckpoint(&view);
+		return;
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, particles_ssbo);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, view.header->payload_size, view.particles);
+
+	ConstantsData = view.header->constants;
+	BoundaryData = view.header->boundary;
+	time_step = view.header->time_step;
+	sim_frame = view.header->frame;
+	particle_version++;
+
+	UnmapCheckpoint(&view);
 }
 
 #define BUFFER_OFFSET( offset )   ((GLvoid*) (offset))
@@ -565,95 +1683,118 @@ void initOpenGL()
 	glEnable(GL_VERTEX_PROGRAM_POINT_SIZE);
 
 	init_particles();
+	particle_readback.Init(sizeof(Particle) * NUM_PARTICLES);
+	gpu_timers.Init();
 
 	reload_shader();
 	reload_mesh();
 
-	// get biggest texture size needed, so resize wont clip textures
-	int count;
-	GLFWmonitor** monitors = glfwGetMonitors(&count);
-	GLFWmonitor* primary = glfwGetPrimaryMonitor();
-	float max_x = 0.0f;
-	float max_y = 0.0f;
-	for (int m = 0; m < count; m++) {
-
-		const GLFWvidmode* mode = glfwGetVideoMode(monitors[m]);
-		float xscale = mode->width;
-		float yscale = mode->height;
-
-		if ((xscale * yscale) > (max_x * max_y)) {
-			// maintain aspect ratio
-			max_x = xscale;
-			max_y = yscale;
-		}
-	}
-
-	// Create a texture object and set initial wrapping and filtering state
-	// R: BW value, G: depth value, B: alpha channel
-	glGenTextures(1, &fbo_tex);
-	glBindTexture(GL_TEXTURE_2D, fbo_tex);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, max_x, max_y, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	// screen-sized targets, with the passes each one has to last through
+	render_targets.Add("fluid_depth_tex", GL_R32F, GL_NEAREST, GPU_PASS_FLUID_DEPTH, GPU_PASS_FBO, &fluid_depth_tex);
+	render_targets.Add("fluid_smooth_tex", GL_R32F, GL_NEAREST, GPU_PASS_FLUID_SMOOTH, GPU_PASS_FLUID_SMOOTH, &fluid_smooth_tex);
+	// the depth buffer, a texture so the composite pass can copy it to scene_fbo for the brush strokes
+	render_targets.Add("fbo depth", GL_DEPTH_COMPONENT24, GL_NEAREST, GPU_PASS_FLUID_DEPTH, GPU_PASS_EDGES, &fbo_depth_tex);
+	// R: BW value, G: depth value, B: alpha channel. Float, so depth steps are not lost to 8 bit quantization
+	render_targets.Add("fbo_tex", GL_RGBA16F, GL_LINEAR, GPU_PASS_FBO, GPU_PASS_BRUSH, &fbo_tex);
+	render_targets.Add("fbo_color_tex", GL_RGBA8, GL_NEAREST, GPU_PASS_FBO, GPU_PASS_SCREEN, &fbo_color_tex);
+	// composite and strokes at the internal resolution, upscaled to the screen
+	render_targets.Add("scene_tex", GL_RGBA8, GL_NEAREST, GPU_PASS_SCREEN, GPU_PASS_UPSCALE, &scene_tex);
+	render_targets.Add("scene depth", GL_DEPTH_COMPONENT24, GL_NEAREST, GPU_PASS_SCREEN, GPU_PASS_BRUSH, &scene_depth);
+	// outline mask of the paint style and the jump flood behind it
+	render_targets.Add("edge_radius_tex", GL_R16F, GL_NEAREST, GPU_PASS_EDGES, GPU_PASS_EDGES, &edge_radius_tex);
+	render_targets.Add("edge_seed_tex 0", GL_RG16I, GL_NEAREST, GPU_PASS_EDGES, GPU_PASS_EDGES, &edge_seed_tex[0]);
+	render_targets.Add("edge_seed_tex 1", GL_RG16I, GL_NEAREST, GPU_PASS_EDGES, GPU_PASS_EDGES, &edge_seed_tex[1]);
+	render_targets.Add("edge_tex", GL_R16F, GL_NEAREST, GPU_PASS_EDGES, GPU_PASS_BRUSH, &edge_tex);
+	// kept from frame to frame, so live through every pass and never shared; a pool of their own
+	// so they can be dropped while nothing uses them
+	paint_layer_targets.Add("paint_layer_tex 0", GL_RGBA16F, GL_NEAREST, GPU_PASS_RHO_PRESSURE, GPU_PASS_GUI, &paint_layer_tex[0]);
+	paint_layer_targets.Add("paint_layer_tex 1", GL_RGBA16F, GL_NEAREST, GPU_PASS_RHO_PRESSURE, GPU_PASS_GUI, &paint_layer_tex[1]);
+	paint_layer_targets.Add("paint_layer_tex 2", GL_RGBA16F, GL_NEAREST, GPU_PASS_RHO_PRESSURE, GPU_PASS_GUI, &paint_layer_tex[2]);
+	// "Compare Blending" only, free while it shares a texture with the G-buffer passes
+	render_targets.Add("blend_compare_tex", GL_RGBA8, GL_NEAREST, GPU_PASS_BRUSH, GPU_PASS_BRUSH, &blend_compare_tex);
 
-	// Create the framebuffer object
 	glGenFramebuffers(1, &fbo);
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-
-	// http://www.opengl-tutorial.org/intermediate-tutorials/tutorial-14-render-to-texture/
-	// The depth buffer
-	glGenRenderbuffers(1, &depthrenderbuffer);
-	glBindRenderbuffer(GL_RENDERBUFFER, depthrenderbuffer);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, max_x, max_y);
-
-	// bind fbo texture to render to 
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fbo_tex, 0);
-
-	// attach depth renderbuffer to FBO
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthrenderbuffer);
-
-	// unbind the fbo
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glGenFramebuffers(1, &fluid_fbo);
+	glGenFramebuffers(1, &scene_fbo);
+	glGenFramebuffers(1, &paint_layer_fbo);
+	glGenFramebuffers(1, &blend_compare_fbo);
+	allocate_render_targets();
 
 	// Create and initialize uniform buffers
 
 	// For SceneUniforms
-	glGenBuffers(1, &scene_ubo);
-	glBindBuffer(GL_UNIFORM_BUFFER, scene_ubo);
 	// Allocate memory for the buffer, but don't copy (since pointer is null).
-	glBufferData(GL_UNIFORM_BUFFER, sizeof(SceneUniforms), nullptr, GL_STREAM_DRAW);
+	scene_ubo = GpuCreateBuffer(GL_UNIFORM_BUFFER, sizeof(SceneUniforms), nullptr, GL_STREAM_DRAW, "scene_ubo");
 	// Associate this uniform buffer with the uniform block in the shader that has the same binding.
 	glBindBufferBase(GL_UNIFORM_BUFFER, UboBinding::scene, scene_ubo);
 
 	// For ConstantsUniform
-	glGenBuffers(1, &constants_ubo);
-	glBindBuffer(GL_UNIFORM_BUFFER, constants_ubo);
-	glBufferData(GL_UNIFORM_BUFFER, sizeof(ConstantsUniform), nullptr, GL_STREAM_DRAW);
+	constants_ubo = GpuCreateBuffer(GL_UNIFORM_BUFFER, sizeof(ConstantsUniform), nullptr, GL_STREAM_DRAW, "constants_ubo");
 	glBindBufferBase(GL_UNIFORM_BUFFER, UboBinding::constants, constants_ubo);
 
 	// boundary ubo
-	glGenBuffers(1, &boundary_ubo);
-	glBindBuffer(GL_UNIFORM_BUFFER, boundary_ubo);
-	glBufferData(GL_UNIFORM_BUFFER, sizeof(BoundaryUniform), nullptr, GL_STREAM_DRAW);
+	boundary_ubo = GpuCreateBuffer(GL_UNIFORM_BUFFER, sizeof(BoundaryUniform), nullptr, GL_STREAM_DRAW, "boundary_ubo");
 	glBindBufferBase(GL_UNIFORM_BUFFER, UboBinding::boundary, boundary_ubo);
 
 	// for MaterialUniforms
-	glGenBuffers(1, &material_ubo);
-	glBindBuffer(GL_UNIFORM_BUFFER, material_ubo);
-	glBufferData(GL_UNIFORM_BUFFER, sizeof(MaterialUniforms), &MaterialData, GL_STREAM_DRAW);
+	material_ubo = GpuCreateBuffer(GL_UNIFORM_BUFFER, sizeof(MaterialUniforms), &MaterialData, GL_STREAM_DRAW, "material_ubo");
 	glBindBufferBase(GL_UNIFORM_BUFFER, UboBinding::material, material_ubo);
 
 	glBindBuffer(GL_UNIFORM_BUFFER, 0);
 }
 
+// Delete everything initOpenGL() and the reload functions created
+void shutdown_opengl()
+{
+	FreeMesh(mesh_data);
+	free_particle_buffers(&particles_ssbo, &particle_position_vao);
+	GpuDeleteBuffer(&replay_vbo);
+	brush_strokes.Destroy();
+
+	glDeleteFramebuffers(1, &fbo);
+	glDeleteFramebuffers(1, &fluid_fbo);
+	glDeleteFramebuffers(1, &scene_fbo);
+	glDeleteFramebuffers(1, &paint_layer_fbo);
+	glDeleteFramebuffers(1, &blend_compare_fbo);
+	render_targets.Release();
+	paint_layer_targets.Release();
+
+	GpuDeleteBuffer(&scene_ubo);
+	GpuDeleteBuffer(&constants_ubo);
+	GpuDeleteBuffer(&boundary_ubo);
+	GpuDeleteBuffer(&material_ubo);
+
+	GpuDeleteProgram(&toon_shader_program);
+	GpuDeleteProgram(&brush_shader_program);
+	GpuDeleteProgram(&brush_comp_program);
+	GpuDeleteProgram(&stroke_sort_program);
+	GpuDeleteProgram(&impostor_shader_program);
+	GpuDeleteProgram(&fluid_depth_program);
+	GpuDeleteProgram(&fluid_shader_program);
+	GpuDeleteProgram(&composite_shader_program);
+	GpuDeleteProgram(&upscale_shader_program);
+	GpuDeleteProgram(&paint_resolve_shader_program);
+	GpuDeleteProgram(&fluid_smooth_program);
+	GpuDeleteProgram(&edge_program);
+	for (int i = 0; i < 3; i++)
+	{
+		GpuDeleteProgram(&compute_programs[i]);
+	}
+}
+
+#ifndef NPR_HEADLESS
 // C++ programs start executing in the main() function.
 int main(int argc, char** argv)
 {
 	GLFWwindow* window;
 
+	// NPR-SPH [scene.txt]: start from a scene file and reload it whenever it changes
+	bind_scene_file();
+	if (argc > 1 && scene_file.Load(argv[1]))
+	{
+		scene_file.Watch(argv[1]);
+	}
+
 	/* Initialize the library */
 	if (!glfwInit())
 	{
@@ -678,6 +1819,8 @@ int main(int argc, char** argv)
 
 	/* Make the window's context current */
 	glfwMakeContextCurrent(window);
+	glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
+	ProfilerSetThreadName("main");
 
 	initOpenGL();
 
@@ -690,6 +1833,7 @@ int main(int argc, char** argv)
 	/* Loop until the user closes the window */
 	while (!glfwWindowShouldClose(window))
 	{
+		scene_file.ReloadIfChanged();
 		idle();
 		if (mesh_id != display_mesh) {
 			// reload if selected mesh is different from mesh being displayed
@@ -698,9 +1842,19 @@ int main(int argc, char** argv)
 		display(window);
 
 		/* Poll for and process events */
+		PROFILE_SCOPE("poll_events");
 		glfwPollEvents();
 	}
 
+	particle_readback.Poll(true, consume_particle_readback); // deliver copies still in flight
+	WaitForCheckpoint(); // don't cut off a checkpoint that is still being written
+	finish_trajectory();
+	replay_player.Close();
+	particle_readback.Destroy();
+	gpu_timers.Destroy();
+	shutdown_opengl();
+	GpuMemoryReport(true); // anything still registered was never deleted
+
 	// Cleanup ImGui
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplGlfw_Shutdown();
@@ -708,4 +1862,169 @@ int main(int argc, char** argv)
 
 	glfwTerminate();
 	return 0;
-}
\ No newline at end of file
+}
+#else
+// parse "r,g,b" into a material color, keeping alpha
+static bool parse_color(const char* text, glm::vec4& color)
+{
+	return sscanf(text, "%f,%f,%f", &color.r, &color.g, &color.b) == 3;
+}
+
+static bool parse_stroke_blend(const char* text, int* blend)
+{
+	for (int b = 0; b < STROKE_BLEND_COUNT; b++)
+	{
+		if (strcmp(text, stroke_blend_names[b]) == 0)
+		{
+			*blend = b;
+			return true;
+		}
+	}
+	return false;
+}
+
+/// <summary>
+/// Render frames without a window, e.g. NPR-SPH --sph --frames 600 --out frame%04d.png
+/// An output name without a printf pattern is encoded as a single video through ffmpeg instead.
+/// </summary>
+int main(int argc, char** argv)
+{
+	int frames = 1;
+	const char* out = "frame%04d.png";
+	std::vector<CameraKey> camera_path;
+	bool compare_blending = false; // measure the stroke blend modes on the last frame
+	bool args_ok = true;
+	bind_scene_file();
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		const bool has_value = i + 1 < argc;
+		if (arg == "--width" && has_value) framebuffer_width = atoi(argv[++i]);
+		else if (arg == "--height" && has_value) framebuffer_height = atoi(argv[++i]);
+		else if (arg == "--frames" && has_value) frames = atoi(argv[++i]);
+		else if (arg == "--out" && has_value) out = argv[++i];
+		else if (arg == "--mesh" && has_value) mesh_id = glm::clamp(atoi(argv[++i]), 0, 2);
+		else if (arg == "--style" && has_value) style = std::string(argv[++i]) == "paint" ? render_style::paint : render_style::toon;
+		else if (arg == "--angle" && has_value) angle = (float)atof(argv[++i]);
+		else if (arg == "--scene" && has_value) args_ok = scene_file.Load(argv[++i]); // options after it override the file
+		else if (arg == "--camera" && has_value) args_ok = LoadCameraPath(argv[++i], camera_path);
+		else if (arg == "--dark" && has_value) args_ok = parse_color(argv[++i], MaterialData.dark);
+		else if (arg == "--midtone" && has_value) args_ok = parse_color(argv[++i], MaterialData.midtone);
+		else if (arg == "--highlight" && has_value) args_ok = parse_color(argv[++i], MaterialData.highlight);
+		else if (arg == "--outline" && has_value) args_ok = parse_color(argv[++i], MaterialData.outline);
+		else if (arg == "--shininess" && has_value) MaterialData.shininess = (float)atof(argv[++i]);
+		else if (arg == "--brush-scale" && has_value) MaterialData.brush_scale = (float)atof(argv[++i]);
+		else if (arg == "--brush-density" && has_value) brush_density = (float)atof(argv[++i]);
+		else if (arg == "--stroke-blend" && has_value) args_ok = parse_stroke_blend(argv[++i], &stroke_blend);
+		else if (arg == "--compare-blending") compare_blending = true;
+		else if (arg == "--sph")
+		{
+			obj_mode = 1;
+			simulate = true;
+		}
+		else
+		{
+			args_ok = false;
+		}
+
+		if (!args_ok)
+		{
+			std::cout << "usage: " << argv[0] << " [--width w] [--height h] [--frames n] [--out frame%04d.png|video.mp4]"
+				" [--scene scene.txt] [--mesh 0-2] [--style toon|paint] [--angle radians] [--camera path.txt] [--sph]"
+				" [--dark r,g,b] [--midtone r,g,b] [--highlight r,g,b] [--outline r,g,b] [--shininess s] [--brush-scale s] [--brush-density d]"
+				" [--stroke-blend over|weighted|sorted] [--compare-blending]" << std::endl;
+			return -1;
+		}
+	}
+	if (compare_blending && style != render_style::paint)
+	{
+		std::cout << "--compare-blending needs the paint style (--style paint)" << std::endl;
+		return -1;
+	}
+	// offline frames take as long as they need, at full resolution
+	dynamic_resolution.mEnabled = false;
+	dynamic_resolution.mScale = 1.0f;
+
+	if (framebuffer_width <= 0 || framebuffer_height <= 0 || frames <= 0)
+	{
+		std::cout << "width, height and frames must be positive" << std::endl;
+		return -1;
+	}
+	if (strchr(out, '%') != nullptr && !IsFramePattern(out))
+	{
+		std::cout << "--out " << out << " needs exactly one frame number like %04d, and no other % but %%" << std::endl;
+		return -1;
+	}
+
+	if (!create_headless_context())
+	{
+		return -1;
+	}
+	ProfilerSetThreadName("main");
+
+	initOpenGL();
+
+	// color and depth targets standing in for the window's default framebuffer
+	GLuint screen_tex = GpuCreateTexture2D(GL_RGBA8, framebuffer_width, framebuffer_height, GL_RGBA, GL_UNSIGNED_BYTE, 0, "headless screen");
+	glBindTexture(GL_TEXTURE_2D, 0);
+	GLuint screen_depth = GpuCreateRenderbuffer(GL_DEPTH_COMPONENT24, framebuffer_width, framebuffer_height, "headless screen depth");
+	glGenFramebuffers(1, &screen_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, screen_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, screen_tex, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, screen_depth);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "Offscreen framebuffer is incomplete" << std::endl;
+		return -1;
+	}
+	resize(nullptr, framebuffer_width, framebuffer_height);
+
+	const bool image_sequence = strchr(out, '%') != nullptr;
+	if (!image_sequence)
+	{
+		recording = true;
+		start_encoding(out, framebuffer_width, framebuffer_height); // Uses ffmpeg
+	}
+
+	for (int frame = 0; frame < frames; frame++)
+	{
+		if (!camera_path.empty())
+		{
+			const CameraKey key = SampleCameraPath(camera_path, (float)frame);
+			SceneData.eye_w = glm::vec4(key.eye, SceneData.eye_w.w);
+			angle = key.angle;
+		}
+
+		blend_comparison.requested = compare_blending && frame == frames - 1;
+		idle();
+		display(nullptr);
+
+		if (image_sequence)
+		{
+			glReadBuffer(GL_COLOR_ATTACHMENT0);
+			save_framebuffer_image(FrameFilename(out, frame).c_str(), framebuffer_width, framebuffer_height);
+		}
+	}
+
+	if (recording)
+	{
+		recording = false;
+		finish_encoding(); // Uses ffmpeg
+	}
+
+	particle_readback.Poll(true, consume_particle_readback); // deliver copies still in flight
+	WaitForCheckpoint();
+	finish_trajectory();
+	particle_readback.Destroy();
+	gpu_timers.Destroy();
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(1, &screen_fbo);
+	GpuDeleteTexture(&screen_tex);
+	GpuDeleteRenderbuffer(&screen_depth);
+	shutdown_opengl();
+	GpuMemoryReport(true); // anything still registered was never deleted
+
+	destroy_headless_context();
+	return 0;
+}
+#endif
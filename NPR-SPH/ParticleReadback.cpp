@@ -0,0 +1,98 @@
+#include "ParticleReadback.h"
+#include "GpuMemory.h"
+
+#include <string>
+
+void ParticleReadback::Init(GLsizeiptr size, const char* owner)
+{
+	Destroy();
+
+	mSize = size;
+	for (int i = 0; i < READBACK_SLOTS; i++)
+	{
+		const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		const std::string name = owner + (" " + std::to_string(i));
+		mBuffers[i] = GpuCreateBuffer(GL_COPY_WRITE_BUFFER, size, nullptr, 0, name.c_str(), flags);
+		mMapped[i] = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	mNext = 0;
+}
+
+void ParticleReadback::Destroy()
+{
+	for (int i = 0; i < READBACK_SLOTS; i++)
+	{
+		if (mFences[i] != 0)
+		{
+			glDeleteSync(mFences[i]);
+			mFences[i] = 0;
+		}
+		if (mBuffers[i] != -1)
+		{
+			glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffers[i]);
+			glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+			GpuDeleteBuffer(&mBuffers[i]);
+			mMapped[i] = nullptr;
+		}
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	mSize = 0;
+}
+
+bool ParticleReadback::Pending() const
+{
+	for (int i = 0; i < READBACK_SLOTS; i++)
+	{
+		if (mFences[i] != 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void ParticleReadback::Capture(GLuint source, unsigned int frame, int tags, const ReadbackConsumer& consumer)
+{
+	// the slot still holds an undelivered copy: the GPU is READBACK_SLOTS frames behind, so finish it first
+	if (mFences[mNext] != 0)
+	{
+		mWaits++;
+		Poll(true, consumer);
+	}
+
+	// make compute shader writes visible to the copy
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_COPY_READ_BUFFER, source);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffers[mNext]);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, mSize);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	mFences[mNext] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	mFrames[mNext] = frame;
+	mTags[mNext] = tags;
+	mNext = (mNext + 1) % READBACK_SLOTS;
+}
+
+void ParticleReadback::Poll(bool wait, const ReadbackConsumer& consumer)
+{
+	for (int i = 0; i < READBACK_SLOTS; i++)
+	{
+		const int slot = (mNext + i) % READBACK_SLOTS; // oldest copy first
+		if (mFences[slot] == 0)
+		{
+			continue;
+		}
+
+		GLenum status = glClientWaitSync(mFences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, wait ? 1000000000 : 0);
+		if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED)
+		{
+			break; // copies complete in order, so newer ones aren't done either
+		}
+
+		glDeleteSync(mFences[slot]);
+		mFences[slot] = 0;
+		consumer(mMapped[slot], mFrames[slot], mTags[slot]);
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/glew.h>
+#include <functional>
+
+/*
+Stall-free readback of GPU buffers.
+
+Capture() copies the source buffer into the next slot of a ring of persistently mapped buffers with
+glCopyBufferSubData and drops a fence behind the copy. Poll() hands every slot whose fence has
+signaled to the consumer, oldest first, so CPU-side users see data one to three frames late without
+ever calling glGetBufferSubData on a buffer the GPU is still writing.
+*/
+
+#define READBACK_SLOTS 3
+
+// Why a capture was requested, so consumers can ignore captures meant for someone else
+enum ReadbackTag
+{
+	READBACK_TRAJECTORY = 1,
+	READBACK_CHECKPOINT = 2,
+};
+
+// data points into persistently mapped memory and is only valid during the callback
+typedef std::function<void(const void* data, unsigned int frame, int tags)> ReadbackConsumer;
+
+struct ParticleReadback
+{
+	GLuint mBuffers[READBACK_SLOTS];
+	void* mMapped[READBACK_SLOTS];
+	GLsync mFences[READBACK_SLOTS];
+	unsigned int mFrames[READBACK_SLOTS];
+	int mTags[READBACK_SLOTS];
+	GLsizeiptr mSize;
+	int mNext; // slot the next capture goes into
+	unsigned int mWaits; // captures that had to wait because the GPU was more than READBACK_SLOTS frames behind
+
+	ParticleReadback() : mSize(0), mNext(0), mWaits(0)
+	{
+		for (int i = 0; i < READBACK_SLOTS; i++)
+		{
+			mBuffers[i] = -1;
+			mMapped[i] = nullptr;
+			mFences[i] = 0;
+			mFrames[i] = 0;
+			mTags[i] = 0;
+		}
+	}
+
+	void Init(GLsizeiptr size, const char* owner = "particle readback"); // owner names the buffers in the GPU memory registry
+	void Destroy();
+	bool Pending() const; // true while any copy hasn't been consumed yet
+
+	// Queue a copy of source. consumer receives captures that are still pending if the ring is full.
+	void Capture(GLuint source, unsigned int frame, int tags, const ReadbackConsumer& consumer);
+
+	// Deliver finished copies. With wait == true all pending copies are delivered.
+	void Poll(bool wait, const ReadbackConsumer& consumer);
+};
@@ -0,0 +1,228 @@
+#include "Profiler.h"
+#include "GpuTimer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+std::atomic<bool> profiler_enabled(false);
+
+struct ProfileEvent
+{
+	const char* name;
+	uint64_t start_ns;
+	uint64_t end_ns;
+	int tid;
+};
+
+// Written only by the thread that owns it, read by WriteChromeTrace()
+struct ProfileRing
+{
+	ProfileEvent events[PROFILE_RING_SIZE];
+	std::atomic<uint64_t> head; // events ever written
+	std::atomic<uint64_t> tail; // events before this were cleared
+	bool in_use; // owned by a running thread, guarded by rings_mutex
+};
+
+static std::mutex rings_mutex;
+static std::vector<ProfileRing*> rings;
+static std::vector<std::string> thread_names; // indexed by tid
+static thread_local int thread_tid = -1;
+
+// Hands the ring back when its thread exits so short-lived threads (checkpoint saves) reuse rings
+struct ProfileRingOwner
+{
+	ProfileRing* ring;
+	ProfileRingOwner() : ring(nullptr) {}
+	~ProfileRingOwner()
+	{
+		if (ring != nullptr)
+		{
+			std::lock_guard<std::mutex> lock(rings_mutex);
+			ring->in_use = false;
+		}
+	}
+};
+static thread_local ProfileRingOwner thread_ring;
+
+static int current_tid()
+{
+	if (thread_tid < 0)
+	{
+		std::lock_guard<std::mutex> lock(rings_mutex);
+		thread_tid = (int)thread_names.size();
+		thread_names.push_back("thread " + std::to_string(thread_tid));
+	}
+	return thread_tid;
+}
+
+static ProfileRing* current_ring()
+{
+	if (thread_ring.ring == nullptr)
+	{
+		std::lock_guard<std::mutex> lock(rings_mutex);
+		for (size_t i = 0; i < rings.size() && thread_ring.ring == nullptr; i++)
+		{
+			if (!rings[i]->in_use)
+			{
+				thread_ring.ring = rings[i];
+			}
+		}
+		if (thread_ring.ring == nullptr)
+		{
+			thread_ring.ring = new ProfileRing();
+			thread_ring.ring->head.store(0);
+			thread_ring.ring->tail.store(0);
+			rings.push_back(thread_ring.ring);
+		}
+		thread_ring.ring->in_use = true;
+	}
+	return thread_ring.ring;
+}
+
+uint64_t ProfilerNowNs()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void ProfilerRecord(const char* name, uint64_t start_ns, uint64_t end_ns)
+{
+	const int tid = current_tid();
+	ProfileRing* ring = current_ring();
+	const uint64_t h = ring->head.load(std::memory_order_relaxed);
+	ProfileEvent& e = ring->events[h % PROFILE_RING_SIZE];
+	e.name = name;
+	e.start_ns = start_ns;
+	e.end_ns = end_ns;
+	e.tid = tid;
+	ring->head.store(h + 1, std::memory_order_release); // publish after the event is complete
+}
+
+void ProfilerSetThreadName(const char* name)
+{
+	const int tid = current_tid();
+	std::lock_guard<std::mutex> lock(rings_mutex);
+	thread_names[tid] = name;
+}
+
+void ProfilerClear()
+{
+	std::lock_guard<std::mutex> lock(rings_mutex);
+	for (size_t i = 0; i < rings.size(); i++)
+	{
+		rings[i]->tail.store(rings[i]->head.load(std::memory_order_acquire));
+	}
+}
+
+static void write_escaped(FILE* fp, const char* s)
+{
+	for (; *s; s++)
+	{
+		if (*s == '"' || *s == '\\') fputc('\\', fp);
+		fputc(*s, fp);
+	}
+}
+
+bool WriteChromeTrace(const char* filename, const GpuTimers* gpu_timers)
+{
+	// snapshot the rings; writers keep running, so entries overwritten during the copy are dropped
+	std::vector<ProfileEvent> events;
+	std::vector<std::string> names;
+	{
+		std::lock_guard<std::mutex> lock(rings_mutex);
+		for (size_t i = 0; i < rings.size(); i++)
+		{
+			ProfileRing* ring = rings[i];
+			const uint64_t head = ring->head.load(std::memory_order_acquire);
+			uint64_t first = head > PROFILE_RING_SIZE ? head - PROFILE_RING_SIZE : 0;
+			first = std::max(first, ring->tail.load());
+			const size_t begin = events.size();
+			for (uint64_t e = first; e < head; e++)
+			{
+				events.push_back(ring->events[e % PROFILE_RING_SIZE]);
+			}
+			const uint64_t head_after = ring->head.load(std::memory_order_acquire);
+			const uint64_t valid = head_after > PROFILE_RING_SIZE ? head_after - PROFILE_RING_SIZE : 0;
+			if (valid > first)
+			{
+				const size_t overwritten = (size_t)std::min(valid - first, head - first);
+				events.erase(events.begin() + begin, events.begin() + begin + overwritten);
+			}
+		}
+		names = thread_names;
+	}
+
+	FILE* fp = fopen(filename, "w");
+	if (fp == NULL)
+	{
+		printf("Could not open %s\n", filename);
+		return false;
+	}
+
+	// timestamps relative to the earliest event keep the numbers short
+	uint64_t base = UINT64_MAX;
+	for (size_t i = 0; i < events.size(); i++)
+	{
+		base = std::min(base, events[i].start_ns);
+	}
+	if (gpu_timers != nullptr)
+	{
+		for (int r = 0; r < gpu_timers->mHistoryCount; r++)
+		{
+			for (int p = 0; p < GPU_PASS_COUNT; p++)
+			{
+				if (gpu_timers->mHistory[r][p] >= 0.0f)
+				{
+					base = std::min(base, gpu_timers->mHistoryStart[r][p]);
+				}
+			}
+		}
+	}
+	if (base == UINT64_MAX)
+	{
+		base = 0;
+	}
+
+	fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"CPU\"}},\n");
+	fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"GPU\"}},\n");
+	fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"GL queue\"}}");
+	for (size_t t = 0; t < names.size(); t++)
+	{
+		fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"", (int)t);
+		write_escaped(fp, names[t].c_str());
+		fprintf(fp, "\"}}");
+	}
+
+	for (size_t i = 0; i < events.size(); i++)
+	{
+		const ProfileEvent& e = events[i];
+		fprintf(fp, ",\n{\"name\":\"");
+		write_escaped(fp, e.name);
+		fprintf(fp, "\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", e.tid, (e.start_ns - base) * 1e-3, (e.end_ns - e.start_ns) * 1e-3);
+	}
+
+	if (gpu_timers != nullptr)
+	{
+		for (int r = 0; r < gpu_timers->mHistoryCount; r++)
+		{
+			for (int p = 0; p < GPU_PASS_COUNT; p++)
+			{
+				const float ms = gpu_timers->mHistory[r][p];
+				if (ms < 0.0f || gpu_timers->mHistoryStart[r][p] < base)
+				{
+					continue;
+				}
+				fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u}}",
+					GpuPassName(p), (gpu_timers->mHistoryStart[r][p] - base) * 1e-3, ms * 1e3, gpu_timers->mHistoryFrames[r]);
+			}
+		}
+	}
+
+	fprintf(fp, "\n]}\n");
+	fclose(fp);
+	return true;
+}
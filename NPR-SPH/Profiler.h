@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/*
+CPU scoped-marker profiler.
+
+PROFILE_SCOPE("name") records the time between the marker and the end of the enclosing scope into
+a ring buffer owned by the calling thread. Each ring has a single writer, so recording is a couple
+of clock reads and a release store; rings are only allocated the first time a thread records.
+While the profiler is disabled a marker costs one relaxed load and a branch, and defining
+NPR_NO_PROFILE removes the markers completely.
+
+WriteChromeTrace() dumps every ring, plus the GPU pass timings from GpuTimers on a separate
+"GPU" track, as Chrome trace event JSON that chrome://tracing and ui.perfetto.dev can open.
+
+Marker names must be string literals (or otherwise outlive the profiler), only the pointer is kept.
+*/
+
+#define PROFILE_RING_SIZE 65536 // events kept per thread, older ones are overwritten
+
+struct GpuTimers;
+
+extern std::atomic<bool> profiler_enabled;
+
+uint64_t ProfilerNowNs(); // steady clock, the time base of every event
+void ProfilerRecord(const char* name, uint64_t start_ns, uint64_t end_ns);
+void ProfilerSetThreadName(const char* name);
+void ProfilerClear(); // drop everything recorded so far
+bool WriteChromeTrace(const char* filename, const GpuTimers* gpu_timers);
+
+class ProfileScope
+{
+public:
+	explicit ProfileScope(const char* name) : mName(name), mStart(0)
+	{
+		if (profiler_enabled.load(std::memory_order_relaxed))
+		{
+			mStart = ProfilerNowNs();
+		}
+	}
+
+	~ProfileScope()
+	{
+		if (mStart != 0)
+		{
+			ProfilerRecord(mName, mStart, ProfilerNowNs());
+		}
+	}
+
+private:
+	const char* mName;
+	uint64_t mStart; // 0 when the profiler was off as the scope opened
+
+	ProfileScope(const ProfileScope&);
+	ProfileScope& operator=(const ProfileScope&);
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef NPR_NO_PROFILE
+#define PROFILE_SCOPE(name)
+#else
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#endif
@@ -0,0 +1,147 @@
+#include "RenderTargetPool.h"
+#include "GpuMemory.h"
+
+#include <algorithm>
+#include <cstdio>
+
+// Formats a view can be made in share a class; color classes go by texel size, depth formats
+// can only be viewed as themselves
+static int view_class(GLenum internal_format)
+{
+	switch (internal_format)
+	{
+	case GL_DEPTH_COMPONENT16:
+	case GL_DEPTH_COMPONENT24:
+	case GL_DEPTH_COMPONENT32F:
+	case GL_DEPTH24_STENCIL8:
+		return -(int)internal_format;
+	}
+	return (int)GpuBytesPerTexel(internal_format);
+}
+
+static bool overlap(const RenderTarget& a, const RenderTarget& b)
+{
+	return a.first_pass <= b.last_pass && b.first_pass <= a.last_pass;
+}
+
+void RenderTargetPool::Add(const char* name, GLenum internal_format, GLint filter, int first_pass, int last_pass, GLuint* texture)
+{
+	RenderTarget target;
+	target.name = name;
+	target.internal_format = internal_format;
+	target.filter = filter;
+	target.first_pass = first_pass;
+	target.last_pass = last_pass;
+	target.texture = texture;
+	target.storage = -1;
+	mTargets.push_back(target);
+	mWidth = 0; // place it on the next Allocate()
+}
+
+bool RenderTargetPool::Allocate(int width, int height)
+{
+	if (width <= 0 || height <= 0 || (width == mWidth && height == mHeight))
+	{
+		return false;
+	}
+	Release();
+	mWidth = width;
+	mHeight = height;
+	mAllocations++;
+
+	// greedy interval assignment in order of first use
+	std::vector<int> order(mTargets.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		order[i] = (int)i;
+	}
+	std::stable_sort(order.begin(), order.end(), [this](int a, int b) { return mTargets[a].first_pass < mTargets[b].first_pass; });
+
+	for (size_t o = 0; o < order.size(); o++)
+	{
+		RenderTarget& target = mTargets[order[o]];
+		target.storage = -1;
+		for (int s = 0; s < (int)mStorage.size() && target.storage < 0; s++)
+		{
+			if (view_class(mStorage[s].internal_format) != view_class(target.internal_format))
+			{
+				continue;
+			}
+			bool free = true;
+			for (size_t other = 0; other < o; other++)
+			{
+				const RenderTarget& placed = mTargets[order[other]];
+				if (placed.storage == s && overlap(placed, target))
+				{
+					free = false;
+					break;
+				}
+			}
+			if (free)
+			{
+				target.storage = s;
+			}
+		}
+		if (target.storage < 0)
+		{
+			RenderTargetStorage storage;
+			storage.texture = -1;
+			storage.internal_format = target.internal_format;
+			storage.bytes = (size_t)width * height * GpuBytesPerTexel(target.internal_format);
+			snprintf(storage.owner, sizeof(storage.owner), "render target %d", (int)mStorage.size());
+			target.storage = (int)mStorage.size();
+			mStorage.push_back(storage);
+		}
+	}
+
+	for (size_t s = 0; s < mStorage.size(); s++)
+	{
+		mStorage[s].texture = GpuCreateTextureStorage2D(mStorage[s].internal_format, width, height, mStorage[s].owner);
+	}
+	for (size_t i = 0; i < mTargets.size(); i++)
+	{
+		RenderTarget& target = mTargets[i];
+		*target.texture = GpuCreateTextureView(mStorage[target.storage].texture, target.internal_format, target.name);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, target.filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, target.filter);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return true;
+}
+
+void RenderTargetPool::Release()
+{
+	for (size_t i = 0; i < mTargets.size(); i++)
+	{
+		GpuDeleteTexture(mTargets[i].texture);
+	}
+	for (size_t s = 0; s < mStorage.size(); s++)
+	{
+		GpuDeleteTexture(&mStorage[s].texture);
+	}
+	mStorage.clear();
+	mWidth = 0;
+	mHeight = 0;
+}
+
+size_t RenderTargetPool::Bytes() const
+{
+	size_t bytes = 0;
+	for (size_t s = 0; s < mStorage.size(); s++)
+	{
+		bytes += mStorage[s].bytes;
+	}
+	return bytes;
+}
+
+size_t RenderTargetPool::UnaliasedBytes() const
+{
+	size_t bytes = 0;
+	for (size_t i = 0; i < mTargets.size(); i++)
+	{
+		bytes += (size_t)mWidth * mHeight * GpuBytesPerTexel(mTargets[i].internal_format);
+	}
+	return bytes;
+}
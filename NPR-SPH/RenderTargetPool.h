@@ -0,0 +1,67 @@
+#pragma once
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/glew.h>
+#include <cstddef>
+#include <vector>
+
+/*
+Screen-sized render targets, allocated at the framebuffer size.
+
+Every target is added once with its format and the first and last GpuPass that use it within a
+frame. Allocate() is called at the start of every frame with the framebuffer size and only does
+work when the size changed, e.g. after resize(), so dragging the window edge reallocates once per
+frame drawn instead of once per callback.
+
+Targets whose passes don't overlap share storage: each target is a texture view of an immutable
+storage texture, and targets of the same view class (e.g. R32F, RG16I and RGBA8 are all 32 bits
+per texel) go to the first storage none of whose other targets is live at the same time. Contents
+therefore only last from a target's first pass to its last, and every target must be written
+before it is read each frame. Passes run in order on one context, so a later pass writing an
+aliased target never overwrites what an earlier one is still reading.
+
+Texture names change when the targets are reallocated; Allocate() returns true then so the caller
+can reattach its framebuffers.
+*/
+
+struct RenderTarget
+{
+	const char* name; // owner in the GPU memory registry
+	GLenum internal_format;
+	GLint filter;
+	int first_pass; // GpuPass range the contents must survive
+	int last_pass;
+	GLuint* texture; // set to the view on allocation
+	int storage; // index into RenderTargetPool::mStorage
+};
+
+struct RenderTargetStorage
+{
+	GLuint texture;
+	GLenum internal_format; // of the first target placed here
+	size_t bytes;
+	char owner[32];
+};
+
+struct RenderTargetPool
+{
+	std::vector<RenderTarget> mTargets;
+	std::vector<RenderTargetStorage> mStorage;
+	int mWidth;
+	int mHeight;
+	int mAllocations; // times the targets were (re)allocated
+
+	RenderTargetPool() : mWidth(0), mHeight(0), mAllocations(0) {}
+
+	void Add(const char* name, GLenum internal_format, GLint filter, int first_pass, int last_pass, GLuint* texture);
+
+	// (re)allocate everything at width x height if that is not the current size; 0 sizes (a
+	// minimized window) keep the old targets
+	bool Allocate(int width, int height);
+	void Release(); // delete the textures; Allocate() creates them again
+
+	size_t Bytes() const; // storage actually allocated
+	size_t UnaliasedBytes() const; // what one texture per target would take
+};
@@ -0,0 +1,245 @@
+#include "SceneFile.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+
+static time_t modification_time(const std::string& filename)
+{
+	struct stat info;
+	return stat(filename.c_str(), &info) == 0 ? info.st_mtime : 0;
+}
+
+// shortest text that reads back as the same float, so saved files stay readable
+static void print_float(FILE* f, float v)
+{
+	char text[32];
+	for (int precision = 6; precision <= 9; precision++) // 9 digits always round trip
+	{
+		snprintf(text, sizeof(text), "%.*g", precision, v);
+		if (strtof(text, NULL) == v)
+		{
+			break;
+		}
+	}
+	fprintf(f, " %s", text);
+}
+
+void SceneFile::Bind(const char* key, BindingType type, void* value, int count, const char* const* names)
+{
+	Binding b;
+	b.key = key;
+	b.type = type;
+	b.value = value;
+	b.count = count;
+	b.names = names;
+	mIndex[b.key] = (int)mBindings.size();
+	mBindings.push_back(b);
+}
+
+void SceneFile::BindFloat(const char* key, float* value, int count)
+{
+	Bind(key, BINDING_FLOAT, value, count, nullptr);
+}
+
+void SceneFile::BindInt(const char* key, int* value)
+{
+	Bind(key, BINDING_INT, value, 1, nullptr);
+}
+
+void SceneFile::BindBool(const char* key, bool* value)
+{
+	Bind(key, BINDING_BOOL, value, 1, nullptr);
+}
+
+void SceneFile::BindEnum(const char* key, int* value, const char* const* names, int num_names)
+{
+	Bind(key, BINDING_ENUM, value, num_names, names);
+}
+
+bool SceneFile::Load(const std::string& filename, bool warn_unknown)
+{
+	std::ifstream in(filename.c_str());
+	if (!in)
+	{
+		std::cout << "Could not open scene file " << filename << std::endl;
+		return false;
+	}
+
+	std::string line, key;
+	int line_number = 0;
+	while (std::getline(in, line))
+	{
+		line_number++;
+		std::istringstream fields(line);
+		if (!(fields >> key) || key[0] == '#')
+		{
+			continue;
+		}
+
+		std::unordered_map<std::string, int>::const_iterator it = mIndex.find(key);
+		if (it == mIndex.end())
+		{
+			if (warn_unknown)
+			{
+				std::cout << filename << ":" << line_number << ": unknown key " << key << std::endl;
+			}
+			continue;
+		}
+
+		// parse into temporaries so a malformed line leaves the variable untouched
+		const Binding& b = mBindings[it->second];
+		bool ok = true;
+		switch (b.type)
+		{
+		case BINDING_FLOAT:
+		{
+			std::vector<float> v(b.count);
+			for (int i = 0; i < b.count && ok; i++)
+			{
+				ok = (bool)(fields >> v[i]);
+			}
+			if (ok)
+			{
+				memcpy(b.value, v.data(), sizeof(float) * b.count);
+			}
+			break;
+		}
+		case BINDING_INT:
+		case BINDING_BOOL:
+		{
+			int v;
+			ok = (bool)(fields >> v);
+			if (ok && b.type == BINDING_INT) *(int*)b.value = v;
+			if (ok && b.type == BINDING_BOOL) *(bool*)b.value = v != 0;
+			break;
+		}
+		case BINDING_ENUM:
+		{
+			std::string name;
+			ok = false;
+			if (fields >> name)
+			{
+				for (int i = 0; i < b.count && !ok; i++)
+				{
+					if (name == b.names[i])
+					{
+						*(int*)b.value = i;
+						ok = true;
+					}
+				}
+			}
+			break;
+		}
+		}
+
+		if (!ok)
+		{
+			std::cout << filename << ":" << line_number << ": bad value for " << key << std::endl;
+		}
+	}
+	return true;
+}
+
+bool SceneFile::Save(const std::string& filename)
+{
+	FILE* f = fopen(filename.c_str(), "w");
+	if (f == NULL)
+	{
+		std::cout << "Could not write scene file " << filename << std::endl;
+		return false;
+	}
+
+	fprintf(f, "# NPR-SPH scene\n");
+	for (size_t i = 0; i < mBindings.size(); i++)
+	{
+		const Binding& b = mBindings[i];
+		fprintf(f, "%s", b.key.c_str());
+		switch (b.type)
+		{
+		case BINDING_FLOAT:
+			for (int c = 0; c < b.count; c++)
+			{
+				print_float(f, ((const float*)b.value)[c]);
+			}
+			break;
+		case BINDING_INT:
+			fprintf(f, " %d", *(const int*)b.value);
+			break;
+		case BINDING_BOOL:
+			fprintf(f, " %d", *(const bool*)b.value ? 1 : 0);
+			break;
+		case BINDING_ENUM:
+		{
+			const int v = *(const int*)b.value;
+			fprintf(f, " %s", v >= 0 && v < b.count ? b.names[v] : b.names[0]);
+			break;
+		}
+		}
+		fprintf(f, "\n");
+	}
+
+	const bool ok = fclose(f) == 0;
+	if (filename == mWatched)
+	{
+		// our own save shouldn't bounce back as a reload
+		mWatchedTime = modification_time(filename);
+		mPendingTime = 0;
+	}
+	return ok;
+}
+
+void SceneFile::Watch(const std::string& filename)
+{
+	mWatched = filename;
+	mWatchedTime = filename.empty() ? 0 : modification_time(filename);
+	mPendingTime = 0;
+}
+
+bool SceneFile::ReloadIfChanged()
+{
+	if (mWatched.empty())
+	{
+		return false;
+	}
+
+	const double now = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	if (now - mLastPoll < 0.5)
+	{
+		return false;
+	}
+	mLastPoll = now;
+
+	const time_t t = modification_time(mWatched);
+	if (t == 0 || t == mWatchedTime)
+	{
+		mPendingTime = 0;
+		return false;
+	}
+	if (t != mPendingTime)
+	{
+		mPendingTime = t; // still being written, maybe; look again next poll
+		return false;
+	}
+
+	mWatchedTime = t;
+	mPendingTime = 0;
+	std::cout << "Reloading " << mWatched << std::endl;
+	return Load(mWatched);
+}
+
+void BindSimulationSettings(SceneFile& file, ConstantsUniform* constants, BoundaryUniform* boundary, float* time_step)
+{
+	file.BindFloat("constants.mass", &constants->mass);
+	file.BindFloat("constants.smoothing", &constants->smoothing_coeff);
+	file.BindFloat("constants.visc", &constants->visc);
+	file.BindFloat("constants.rest_density", &constants->resting_rho);
+	file.BindFloat("boundary.upper", &boundary->upper.x, 3);
+	file.BindFloat("boundary.lower", &boundary->lower.x, 3);
+	file.BindFloat("time_step", time_step);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <ctime>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Simulation.h"
+
+/*
+Scene and parameter files.
+
+A scene file is plain text, one setting per line: a key followed by its values, e.g.
+	style paint
+	eye 10 2 0
+	constants.visc 3000
+Lines starting with # are comments. The application binds its variables to keys once; Load()
+writes every bound variable that appears in the file, so a file may hold just a few overrides and
+missing keys keep their current values. Save() writes every binding in the order they were made.
+
+Watch() and ReloadIfChanged() give live reload: the watched file is loaded again after its
+modification time changes and has been stable for one poll, so half-written saves are skipped.
+*/
+
+class SceneFile
+{
+public:
+	SceneFile() : mWatchedTime(0), mPendingTime(0), mLastPoll(0.0) {}
+
+	void BindFloat(const char* key, float* value, int count = 1); // count > 1 for vectors
+	void BindInt(const char* key, int* value);
+	void BindBool(const char* key, bool* value);
+	void BindEnum(const char* key, int* value, const char* const* names, int num_names); // stored by name
+
+	bool Load(const std::string& filename, bool warn_unknown = true); // tools that bind a subset pass false
+	bool Save(const std::string& filename);
+
+	void Watch(const std::string& filename); // empty filename stops watching
+	const std::string& Watched() const { return mWatched; }
+	bool ReloadIfChanged(); // true when the watched file was reloaded; checks the file at most twice a second
+
+private:
+	enum BindingType { BINDING_FLOAT, BINDING_INT, BINDING_BOOL, BINDING_ENUM };
+	struct Binding
+	{
+		std::string key;
+		BindingType type;
+		void* value;
+		int count;
+		const char* const* names;
+	};
+	void Bind(const char* key, BindingType type, void* value, int count, const char* const* names);
+
+	std::vector<Binding> mBindings;
+	std::unordered_map<std::string, int> mIndex; // key -> binding
+
+	std::string mWatched;
+	time_t mWatchedTime; // modification time of the last load
+	time_t mPendingTime; // changed time seen at the previous poll, loaded once it stays put
+	double mLastPoll; // seconds on the steady clock
+};
+
+// Keys for the solver settings shared by the app, the headless renderer and the tools:
+// constants.mass, constants.smoothing, constants.visc, constants.rest_density,
+// boundary.upper, boundary.lower and time_step
+void BindSimulationSettings(SceneFile& file, ConstantsUniform* constants, BoundaryUniform* boundary, float* time_step);
@@ -0,0 +1,110 @@
+#include "Simulation.h"
+#include "GpuTimer.h"
+#include "Profiler.h"
+#include "GpuMemory.h"
+
+#include <algorithm>
+#include <cmath>
+
+/// <summary>
+/// Make positions for a cube grid
+/// </summary>
+/// <returns>Vector of positions for the grid</returns>
+std::vector<glm::vec4> make_grid(int num_particles, const BoundaryUniform& boundary)
+{
+	std::vector<glm::vec4> positions;
+	positions.reserve(num_particles);
+
+	// The block starts at the origin and has to stay inside the boundary, or the walls clamp the
+	// particles that stick out onto them. Columns are 100 particles tall and the footprint grows
+	// with the particle count (10x10 for 10000 particles). Once the footprint reaches the walls the
+	// columns grow taller, and once they would reach the top the spacing shrinks.
+	const float width = std::min(boundary.upper.x, boundary.upper.z);
+	float spacing = PARTICLE_RADIUS;
+	while ((long long)(width / spacing) * (long long)(width / spacing) * (long long)(boundary.upper.y / spacing) < num_particles && spacing > 0.01f * PARTICLE_RADIUS)
+	{
+		spacing *= 0.99f;
+	}
+	const int max_side = std::max(1, (int)(width / spacing));
+	const int side = std::min(max_side, std::max(10, (int)std::ceil(std::sqrt(num_particles / 100.0))));
+	const int layers = (num_particles + side * side - 1) / (side * side);
+
+	for (int i = 0; i < side; i++)
+	{
+		for (int j = 0; j < layers; j++)
+		{
+			for (int k = 0; k < side; k++)
+			{
+				if ((int)positions.size() == num_particles)
+				{
+					return positions;
+				}
+				positions.push_back(glm::vec4((float)i * spacing, (float)j * spacing, (float)k * spacing, 1.0f));
+			}
+		}
+	}
+
+	return positions;
+}
+
+std::vector<Particle> make_particles(int num_particles, const BoundaryUniform& boundary)
+{
+	std::vector<Particle> particles(num_particles);
+	std::vector<glm::vec4> grid_positions = make_grid(num_particles, boundary); // Get grid positions
+	for (int i = 0; i < num_particles; i++)
+	{
+		particles[i].pos = grid_positions[i];
+		particles[i].vel = glm::vec4(0.0f);
+		particles[i].force = glm::vec4(0.0f);
+		particles[i].extras = glm::vec4(0.0f); // 0 - rho, 1 - pressure, 2 - age
+	}
+	return particles;
+}
+
+void init_particle_buffers(const std::vector<Particle>& particles, GLuint* ssbo, GLuint* vao)
+{
+	// Generate and bind shader storage buffer
+	*ssbo = GpuCreateBuffer(GL_SHADER_STORAGE_BUFFER, sizeof(Particle) * particles.size(), particles.data(), GL_STREAM_DRAW, "particles_ssbo");
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, *ssbo);
+
+	// Generate and bind VAO for particle positions
+	glGenVertexArrays(1, vao);
+	glBindVertexArray(*vao);
+
+	glBindBuffer(GL_ARRAY_BUFFER, *ssbo);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Particle), nullptr); // Bind buffer containing particle positions to VAO
+	glEnableVertexAttribArray(0); // Enable attribute with location = 0 (vertex position) for VAO
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0); // Unbind SSBO
+	glBindVertexArray(0); // Unbind VAO
+}
+
+void free_particle_buffers(GLuint* ssbo, GLuint* vao)
+{
+	if (*vao != -1)
+	{
+		glDeleteVertexArrays(1, vao);
+		*vao = -1;
+	}
+	GpuDeleteBuffer(ssbo);
+}
+
+void step_simulation(const GLuint compute_programs[3], int num_particles, float time_step, GpuTimers* timers)
+{
+	const GLuint num_work_groups = (num_particles + WORK_GROUP_SIZE - 1) / WORK_GROUP_SIZE; // Ceiling of particle count divided by work group size
+	const int passes[3] = { GPU_PASS_RHO_PRESSURE, GPU_PASS_FORCE, GPU_PASS_INTEGRATE };
+	PROFILE_SCOPE("step_simulation");
+
+	for (int i = 0; i < 3; i++)
+	{
+		if (timers) timers->Begin(passes[i]);
+		glUseProgram(compute_programs[i]); // density and pressure, force, integration
+		if (i == 2)
+		{
+			glUniform1f(TIME_STEP_LOCATION, time_step);
+		}
+		glDispatchCompute(num_work_groups, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		if (timers) timers->End(passes[i]);
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+// particle setups
+#define NUM_PARTICLES 10000
+#define PARTICLE_RADIUS 0.005f
+#define WORK_GROUP_SIZE 1024 // must match local_size_x in the compute shaders
+#define TIME_STEP_LOCATION 8 // layout(location = 8) uniform float dt in integrate_comp.glsl
+
+// Mirrors the Particle struct in the compute shaders (std430, 64 bytes)
+struct Particle
+{
+	glm::vec4 pos;
+	glm::vec4 vel;
+	glm::vec4 force;
+	glm::vec4 extras; // 0 - rho, 1 - pressure, 2 - age
+};
+
+// These uniform structures mirror the uniform blocks declared in the compute shaders
+struct ConstantsUniform
+{
+	float mass = 0.02f; // Particle Mass
+	float smoothing_coeff = 4.0f; // Smoothing length coefficient for neighborhood
+	float visc = 3000.0f; // Fluid viscosity
+	float resting_rho = 1000.0f; // Resting density
+};
+
+struct BoundaryUniform
+{
+	glm::vec4 upper = glm::vec4(0.5f, 1.0f, 0.5f, 1.0f);
+	glm::vec4 lower = glm::vec4(-0.1f, -0.35f, -0.1f, 1.0f);
+};
+
+// Shared scene setup so the interactive app and the benchmarks simulate the same thing
+
+// Positions for a block of particles spaced PARTICLE_RADIUS apart: 10x100x10 for NUM_PARTICLES,
+// larger counts widen the footprint and keep the column 100 particles tall until the block reaches
+// the walls of boundary, then grow it upwards. Past about 2M particles in the default box the
+// spacing shrinks so the block still fits.
+std::vector<glm::vec4> make_grid(int num_particles = NUM_PARTICLES, const BoundaryUniform& boundary = BoundaryUniform());
+
+// Particles at rest on the grid positions
+std::vector<Particle> make_particles(int num_particles = NUM_PARTICLES, const BoundaryUniform& boundary = BoundaryUniform());
+
+// Create the particle SSBO (binding 0) and a VAO that reads its positions as attribute 0
+void init_particle_buffers(const std::vector<Particle>& particles, GLuint* ssbo, GLuint* vao);
+void free_particle_buffers(GLuint* ssbo, GLuint* vao);
+
+// One simulation step: density/pressure, force and integration dispatches.
+// compute_programs are the programs built from rho_pres_comp, force_comp and integrate_comp.
+// Each dispatch is timed when timers is given.
+struct GpuTimers;
+void step_simulation(const GLuint compute_programs[3], int num_particles, float time_step, GpuTimers* timers = nullptr);
@@ -0,0 +1,215 @@
+#include "SphCpu.h"
+
+#include <algorithm>
+#include <cmath>
+
+// For calculations, same values as the compute shaders
+#define PI 3.141592741f
+#define GAS_CONST 2000.0f // const for equation of state
+#define DAMPING 0.3f // Boundary epsilon
+
+static const glm::vec3 G = glm::vec3(0.0f, -9806.65f, 0.0f); // Gravity force
+static const int particles_per_task = 1024;
+
+const char* NeighborSearchName(int search)
+{
+	switch (search)
+	{
+	case NEIGHBOR_BRUTE_FORCE:
+		return "brute_force";
+	case NEIGHBOR_UNIFORM_GRID:
+		return "uniform_grid";
+	}
+	return "unknown";
+}
+
+void SphCpu::Init(int num_particles)
+{
+	mParticles = make_particles(num_particles, mBoundary);
+	mCellStart.clear();
+	mCellParticles.clear();
+	mParticleCell.clear();
+}
+
+size_t SphCpu::MemoryBytes() const
+{
+	return mParticles.capacity() * sizeof(Particle) +
+		(mCellStart.capacity() + mCellParticles.capacity() + mParticleCell.capacity()) * sizeof(int);
+}
+
+void SphCpu::Step()
+{
+	if (mSearch == NEIGHBOR_UNIFORM_GRID)
+	{
+		BuildGrid();
+	}
+	Run(&SphCpu::ComputeDensityPressure);
+	Run(&SphCpu::ComputeForces);
+	Run(&SphCpu::Integrate);
+}
+
+void SphCpu::Run(void (SphCpu::*pass)(int, int))
+{
+	const int n = (int)mParticles.size();
+	if (mPool == nullptr)
+	{
+		(this->*pass)(0, n);
+	}
+	else
+	{
+		mPool->ParallelFor(0, n, particles_per_task, [this, pass](int begin, int end) { (this->*pass)(begin, end); });
+	}
+}
+
+glm::ivec3 SphCpu::CellOf(const glm::vec3& p) const
+{
+	glm::ivec3 c = glm::ivec3(glm::floor((p - glm::vec3(mBoundary.lower)) / mCellSize));
+	return glm::clamp(c, glm::ivec3(0), mGridDims - 1);
+}
+
+void SphCpu::BuildGrid()
+{
+	mCellSize = mConstants.smoothing_coeff * PARTICLE_RADIUS;
+	glm::vec3 extent = glm::vec3(mBoundary.upper - mBoundary.lower);
+	mGridDims = glm::max(glm::ivec3(glm::ceil(extent / mCellSize)), glm::ivec3(1));
+
+	const int num_cells = mGridDims.x * mGridDims.y * mGridDims.z;
+	const int n = (int)mParticles.size();
+	mCellStart.assign(num_cells + 1, 0);
+	mCellParticles.resize(n);
+	mParticleCell.resize(n);
+
+	// counting sort of particle indices by cell
+	for (int i = 0; i < n; i++)
+	{
+		glm::ivec3 c = CellOf(glm::vec3(mParticles[i].pos));
+		mParticleCell[i] = (c.z * mGridDims.y + c.y) * mGridDims.x + c.x;
+		mCellStart[mParticleCell[i] + 1]++;
+	}
+	for (int c = 0; c < num_cells; c++)
+	{
+		mCellStart[c + 1] += mCellStart[c];
+	}
+	std::vector<int> fill(mCellStart.begin(), mCellStart.end() - 1);
+	for (int i = 0; i < n; i++)
+	{
+		mCellParticles[fill[mParticleCell[i]]++] = i;
+	}
+}
+
+// Calls visit(j) for every particle j that may lie within the smoothing length of particle i (including i)
+template <typename Visit>
+void SphCpu::ForEachNeighbor(int i, Visit visit) const
+{
+	if (mSearch == NEIGHBOR_BRUTE_FORCE)
+	{
+		const int n = (int)mParticles.size();
+		for (int j = 0; j < n; j++)
+		{
+			visit(j);
+		}
+		return;
+	}
+
+	const glm::ivec3 c = CellOf(glm::vec3(mParticles[i].pos));
+	const glm::ivec3 lo = glm::max(c - 1, glm::ivec3(0));
+	const glm::ivec3 hi = glm::min(c + 1, mGridDims - 1);
+	for (int z = lo.z; z <= hi.z; z++)
+	{
+		for (int y = lo.y; y <= hi.y; y++)
+		{
+			const int row = (z * mGridDims.y + y) * mGridDims.x;
+			for (int k = mCellStart[row + lo.x]; k < mCellStart[row + hi.x + 1]; k++)
+			{
+				visit(mCellParticles[k]);
+			}
+		}
+	}
+}
+
+void SphCpu::ComputeDensityPressure(int begin, int end)
+{
+	const float smoothing_length = mConstants.smoothing_coeff * PARTICLE_RADIUS; // Smoothing length for neighbourhood
+	const float h2 = smoothing_length * smoothing_length;
+	const float poly6 = mConstants.mass * 315.0f / (64.0f * PI * std::pow(smoothing_length, 9.0f));
+
+	for (int i = begin; i < end; i++)
+	{
+		const glm::vec3 pi = glm::vec3(mParticles[i].pos);
+		float rho = 0.0f;
+		ForEachNeighbor(i, [&](int j)
+		{
+			glm::vec3 delta = pi - glm::vec3(mParticles[j].pos);
+			float r2 = glm::dot(delta, delta);
+			if (r2 < h2) // Check if particle is inside smoothing radius
+			{
+				float d = h2 - r2;
+				rho += poly6 * d * d * d; // Use Poly6 kernel
+			}
+		});
+		mParticles[i].extras[0] = rho;
+		mParticles[i].extras[1] = std::max(GAS_CONST * (rho - mConstants.resting_rho), 0.0f);
+	}
+}
+
+void SphCpu::ComputeForces(int begin, int end)
+{
+	const float smoothing_length = mConstants.smoothing_coeff * PARTICLE_RADIUS; // Smoothing length for neighbourhood
+	const float spiky = -45.0f / (PI * std::pow(smoothing_length, 6.0f)); // Spiky kernel
+	const float laplacian = 45.0f / (PI * std::pow(smoothing_length, 6.0f)); // Laplacian kernel
+
+	for (int i = begin; i < end; i++)
+	{
+		const Particle& p = mParticles[i];
+		glm::vec3 pres_force = glm::vec3(0.0f);
+		glm::vec3 visc_force = glm::vec3(0.0f);
+		ForEachNeighbor(i, [&](int j)
+		{
+			if (i == j)
+			{
+				return;
+			}
+			const Particle& q = mParticles[j];
+			glm::vec3 delta = glm::vec3(p.pos) - glm::vec3(q.pos);
+			float r = glm::length(delta);
+			if (r < smoothing_length && r > 0.0f) // coincident particles would give NaN directions
+			{
+				pres_force -= mConstants.mass * (p.extras[1] + q.extras[1]) / (2.0f * q.extras[0]) * spiky * (smoothing_length - r) * (smoothing_length - r) * (delta / r);
+				visc_force += mConstants.mass * glm::vec3(q.vel - p.vel) / q.extras[0] * laplacian * (smoothing_length - r);
+			}
+		});
+		visc_force *= mConstants.visc;
+
+		glm::vec3 grav_force = p.extras[0] * G;
+		mParticles[i].force = glm::vec4(pres_force + visc_force + grav_force, mParticles[i].force.w);
+	}
+}
+
+void SphCpu::Integrate(int begin, int end)
+{
+	for (int i = begin; i < end; i++)
+	{
+		Particle& p = mParticles[i];
+		glm::vec3 acceleration = glm::vec3(p.force) / p.extras[0];
+		glm::vec3 new_vel = glm::vec3(p.vel) + mTimeStep * acceleration;
+		glm::vec3 new_pos = glm::vec3(p.pos) + mTimeStep * new_vel;
+
+		// Boundary conditions
+		for (int a = 0; a < 3; a++)
+		{
+			if (new_pos[a] < mBoundary.lower[a])
+			{
+				new_pos[a] = mBoundary.lower[a];
+				new_vel[a] *= -DAMPING;
+			}
+			else if (new_pos[a] > mBoundary.upper[a])
+			{
+				new_pos[a] = mBoundary.upper[a];
+				new_vel[a] *= -DAMPING;
+			}
+		}
+
+		p.vel = glm::vec4(new_vel, p.vel.w);
+		p.pos = glm::vec4(new_pos, p.pos.w);
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+
+#include "Simulation.h"
+#include "ThreadPool.h"
+
+/*
+CPU implementation of the SPH solver in rho_pres_comp.glsl, force_comp.glsl and integrate_comp.glsl.
+Used by the benchmark and the parameter sweep, where many small simulations run concurrently.
+*/
+
+enum NeighborSearch
+{
+	NEIGHBOR_BRUTE_FORCE, // every pair, exactly what the compute shaders do
+	NEIGHBOR_UNIFORM_GRID, // cells of one smoothing length, only the 27 surrounding cells are visited
+	NEIGHBOR_SEARCH_COUNT
+};
+
+const char* NeighborSearchName(int search);
+
+struct SphCpu
+{
+	std::vector<Particle> mParticles;
+	ConstantsUniform mConstants;
+	BoundaryUniform mBoundary;
+	float mTimeStep;
+	int mSearch;
+	ThreadPool* mPool; // nullptr runs single threaded
+
+	SphCpu() : mTimeStep(1.0f / NUM_PARTICLES), mSearch(NEIGHBOR_UNIFORM_GRID), mPool(nullptr) {}
+
+	void Init(int num_particles); // same block of particles as init_particles()
+	void Step();
+	size_t MemoryBytes() const;
+
+private:
+	// uniform grid, rebuilt every step with a counting sort
+	std::vector<int> mCellStart; // first entry in mCellParticles for every cell, plus one past the end
+	std::vector<int> mCellParticles; // particle indices sorted by cell
+	std::vector<int> mParticleCell;
+	glm::ivec3 mGridDims;
+	float mCellSize;
+
+	void BuildGrid();
+	glm::ivec3 CellOf(const glm::vec3& p) const;
+	template <typename Visit> void ForEachNeighbor(int i, Visit visit) const;
+
+	void ComputeDensityPressure(int begin, int end);
+	void ComputeForces(int begin, int end);
+	void Integrate(int begin, int end);
+	void Run(void (SphCpu::*pass)(int, int));
+};
@@ -0,0 +1,101 @@
+#include "StrokeCache.h"
+
+#include <algorithm>
+#include <cmath>
+
+// angle between two unit vectors, robust near 0
+static float angle_between(const glm::vec3& a, const glm::vec3& b)
+{
+	return 2.0f * std::atan2(glm::length(a - b), glm::length(a + b));
+}
+
+bool StrokeCache::NeedStrokes(const StrokeCacheKey& inputs, const glm::mat4& V)
+{
+	const char* reason = NULL;
+	if (!mEnabled)
+	{
+		reason = "cache off";
+	}
+	else if (!mStrokesValid)
+	{
+		reason = "invalidated";
+	}
+	else if (inputs != mStrokeKey)
+	{
+		reason = "sources or settings changed";
+	}
+	else if (V != mStrokeV)
+	{
+		// rows of the view rotation: camera right and backward in world space
+		const glm::vec3 right0(mStrokeV[0][0], mStrokeV[1][0], mStrokeV[2][0]);
+		const glm::vec3 right1(V[0][0], V[1][0], V[2][0]);
+		const glm::vec3 back0(mStrokeV[0][2], mStrokeV[1][2], mStrokeV[2][2]);
+		const glm::vec3 back1(V[0][2], V[1][2], V[2][2]);
+		const glm::vec3 eye0 = glm::vec3(glm::inverse(mStrokeV)[3]);
+		const glm::vec3 eye1 = glm::vec3(glm::inverse(V)[3]);
+		if (std::max(angle_between(right0, right1), angle_between(back0, back1)) > STROKE_CACHE_MAX_TURN)
+		{
+			reason = "camera turned";
+		}
+		else if (glm::length(eye1 - eye0) > STROKE_CACHE_MAX_MOVE * glm::length(eye0))
+		{
+			reason = "camera moved";
+		}
+		else
+		{
+			mReprojected++;
+		}
+	}
+
+	if (reason == NULL)
+	{
+		return false;
+	}
+	mRegenerateReason = reason;
+	mStrokeKey = inputs;
+	mStrokeV = V;
+	mStrokesValid = mEnabled;
+	mGenerations++;
+	mRegenerated++;
+	return true;
+}
+
+StrokeCacheAction StrokeCache::LayerAction(const StrokeCacheKey& inputs)
+{
+	const bool still = inputs == mLastLayerKey;
+	mLastLayerKey = inputs;
+	if (!mEnabled)
+	{
+		mLayerValid = false;
+		return STROKE_CACHE_DIRECT;
+	}
+	if (mLayerValid && inputs == mLayerKey)
+	{
+		mResolved++;
+		return STROKE_CACHE_RESOLVE;
+	}
+	if (still)
+	{
+		// unchanged since the last frame, so likely to stay: worth building the layer
+		mLayerKey = inputs;
+		mLayerValid = true;
+		mLayerDraws++;
+		return STROKE_CACHE_DRAW_LAYER;
+	}
+	mLayerValid = false;
+	return STROKE_CACHE_DIRECT;
+}
+
+void StrokeCache::Invalidate()
+{
+	mStrokesValid = false;
+	mLayerValid = false;
+}
+
+void StrokeCache::ResetCounters()
+{
+	mRegenerated = 0;
+	mReprojected = 0;
+	mLayerDraws = 0;
+	mResolved = 0;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+/*
+Frame to frame cache of the paint pass, at two levels.
+
+Strokes. brush_comp.glsl writes world-space strokes, so they stay valid as long as their sources,
+the model transform and the stroke settings don't change; the camera only decides which strokes
+were culled. While caching, strokes are generated with a guard band around the frustum and some
+slack on back faces (BrushCulling::guard_band), and drawing them under a new camera reprojects
+them without a dispatch. NeedStrokes() asks for a new dispatch once the camera has turned or moved
+further than the guard band covers, or when any other input changed.
+
+Reprojection is not exact: which strokes were kept was decided for the eye they were generated for.
+The back-face test, the minimum pixel size, and the LOD thinning with the growth of its survivors
+all depend on that eye, so under the new camera strokes can be too dense or too sparse, slightly
+the wrong size, or missing on faces that just turned towards it, until the next regeneration. The
+turn and move limits below keep that small.
+
+Layer. With the scene still, the strokes are blended into the paint layer as weights of the
+material colors instead of colors (brush_fs.glsl with paint_layer set). Once shininess is fixed
+everything brush_fs computes is linear in dark, midtone, highlight and outline_color, and so is
+blending, so paint_resolve_fs.glsl rebuilds the painted image from the weights and the current
+colors with one full-screen pass. LayerAction() keeps the layer while its inputs (camera, light,
+G-buffer contents, strokes) stay the same, so tweaking colors on a still scene costs the resolve
+only. A moving scene draws the strokes directly as before: building the layer only pays off
+once it is reused.
+
+Inputs are compared as the raw bytes of a StrokeCacheKey, so every value that reaches the passes
+must be added to it.
+*/
+
+#define STROKE_CACHE_GUARD_BAND 0.15f // fraction of the view added on every side while caching
+#define STROKE_CACHE_MAX_TURN 0.035f // radians the view may turn before regenerating, about 2 degrees
+#define STROKE_CACHE_MAX_MOVE 0.02f // eye movement before regenerating, relative to its distance from the origin
+
+struct StrokeCacheKey
+{
+	std::vector<unsigned char> mBytes;
+
+	template <typename T>
+	void Add(const T& value)
+	{
+		const unsigned char* bytes = (const unsigned char*)&value;
+		mBytes.insert(mBytes.end(), bytes, bytes + sizeof(T));
+	}
+
+	bool operator==(const StrokeCacheKey& other) const { return mBytes == other.mBytes; }
+	bool operator!=(const StrokeCacheKey& other) const { return mBytes != other.mBytes; }
+};
+
+enum StrokeCacheAction
+{
+	STROKE_CACHE_DIRECT, // draw the strokes straight into the scene
+	STROKE_CACHE_DRAW_LAYER, // draw them into the paint layer, then resolve
+	STROKE_CACHE_RESOLVE, // the layer is current, only resolve
+};
+
+struct StrokeCache
+{
+	bool mEnabled;
+
+	StrokeCacheKey mStrokeKey; // inputs of the cached strokes, view matrix aside
+	glm::mat4 mStrokeV; // view the strokes were culled for
+	bool mStrokesValid;
+	unsigned int mGenerations; // dispatches so far, part of the layer inputs
+
+	StrokeCacheKey mLayerKey; // inputs of the paint layer
+	StrokeCacheKey mLastLayerKey; // previous frame's, to tell whether the scene is still
+	bool mLayerValid;
+
+	// frames since the last ResetCounters(), for the GUI
+	unsigned int mRegenerated;
+	unsigned int mReprojected; // drawn from cached strokes under a different camera
+	unsigned int mLayerDraws;
+	unsigned int mResolved; // paint pass was only the resolve
+	const char* mRegenerateReason;
+
+	StrokeCache() : mEnabled(true), mStrokeV(1.0f), mStrokesValid(false), mGenerations(0), mLayerValid(false),
+		mRegenerated(0), mReprojected(0), mLayerDraws(0), mResolved(0), mRegenerateReason("") {}
+
+	// true if brush_comp.glsl has to run this frame, which the cache then takes as done. The
+	// projection belongs in inputs; V may drift within the guard band.
+	bool NeedStrokes(const StrokeCacheKey& inputs, const glm::mat4& V);
+	StrokeCacheAction LayerAction(const StrokeCacheKey& inputs);
+
+	void Invalidate(); // e.g. after the shaders were reloaded
+	void ResetCounters();
+};
@@ -0,0 +1,267 @@
+// Parameter sweep on the CPU solver
+// Runs one small simulation for every combination of the swept constants (the sliders in the
+// Constants Window), all sharing one thread pool, and writes a CSV table scoring each run.
+//
+// usage: NPR-SPH-Sweep [--mass list] [--smoothing list] [--visc list] [--rest-density list]
+//                      [--particles N] [--steps N] [--threads N] [--scene base.txt] [--out sweep.csv]
+// A list is either comma separated values (0.01,0.02,0.05) or an inclusive range first:last:count
+// (1000:5000:9). Constants that are not swept keep the values from --scene, or the app's defaults.
+//
+// Metrics, gathered every step at the cost of one pass over the particles:
+//   density error   mean |rho - rest density| / rest density, averaged over the second half of the run
+//                   when the column should have settled, and its maximum over the same steps
+//   kinetic energy  sum of 0.5 m |v|^2 at the end of the run, and its peak
+//   stable          no NaN or infinite velocities, the usual symptom of a bad parameter set
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "SceneFile.h"
+#include "SphCpu.h"
+#include "ThreadPool.h"
+
+struct SweepRun
+{
+	ConstantsUniform constants;
+	double cost; // relative work estimate used to order the runs
+	double seconds;
+	double mean_density_error;
+	double max_density_error;
+	double kinetic_energy;
+	double peak_kinetic_energy;
+	bool stable;
+};
+
+static double now_seconds()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// "a,b,c" or "first:last:count"
+static bool parse_list(const char* text, std::vector<float>& values)
+{
+	values.clear();
+	float first, last;
+	int count;
+	if (strchr(text, ':') != NULL)
+	{
+		if (sscanf(text, "%f:%f:%d", &first, &last, &count) != 3 || count < 1)
+		{
+			return false;
+		}
+		for (int i = 0; i < count; i++)
+		{
+			values.push_back(count == 1 ? first : first + (last - first) * i / (count - 1));
+		}
+		return true;
+	}
+
+	std::stringstream ss(text);
+	std::string item;
+	while (std::getline(ss, item, ','))
+	{
+		values.push_back((float)atof(item.c_str()));
+	}
+	return !values.empty();
+}
+
+// Steps one simulation and accumulates its metrics. While other runs are still waiting for a
+// worker the run steps single threaded; once none are left it splits its passes over the pool so
+// workers that ran out of runs help finish the stragglers.
+static void run_simulation(SweepRun& run, const BoundaryUniform& boundary, float time_step, int num_particles, int steps,
+	ThreadPool& pool, const std::atomic<int>& runs_waiting)
+{
+	const double start = now_seconds();
+
+	SphCpu sph;
+	sph.mConstants = run.constants;
+	sph.mBoundary = boundary;
+	sph.mTimeStep = time_step;
+	sph.mSearch = NEIGHBOR_UNIFORM_GRID;
+	sph.Init(num_particles);
+
+	run.mean_density_error = 0.0;
+	run.max_density_error = 0.0;
+	run.kinetic_energy = 0.0;
+	run.peak_kinetic_energy = 0.0;
+	run.stable = true;
+	int measured_steps = 0;
+
+	for (int s = 0; s < steps && run.stable; s++)
+	{
+		sph.mPool = runs_waiting.load(std::memory_order_relaxed) > 0 ? nullptr : &pool;
+		sph.Step();
+
+		double density_error = 0.0, kinetic = 0.0;
+		for (size_t i = 0; i < sph.mParticles.size(); i++)
+		{
+			const Particle& p = sph.mParticles[i];
+			density_error += std::fabs(p.extras[0] - run.constants.resting_rho);
+			kinetic += glm::dot(glm::vec3(p.vel), glm::vec3(p.vel));
+		}
+		density_error /= sph.mParticles.size() * (double)run.constants.resting_rho;
+		kinetic *= 0.5 * run.constants.mass;
+
+		if (!std::isfinite(kinetic) || !std::isfinite(density_error))
+		{
+			run.stable = false;
+			break;
+		}
+		run.kinetic_energy = kinetic;
+		run.peak_kinetic_energy = std::max(run.peak_kinetic_energy, kinetic);
+		if (s >= steps / 2)
+		{
+			run.mean_density_error += density_error;
+			run.max_density_error = std::max(run.max_density_error, density_error);
+			measured_steps++;
+		}
+	}
+	run.mean_density_error /= std::max(1, measured_steps);
+	run.seconds = now_seconds() - start;
+}
+
+int main(int argc, char** argv)
+{
+	ConstantsUniform base;
+	BoundaryUniform boundary;
+	float time_step = 1.0f / NUM_PARTICLES;
+	std::vector<float> masses, smoothings, viscosities, rest_densities;
+	int num_particles = 2000;
+	int steps = 200;
+	int threads = 0;
+	const char* out_filename = "sweep.csv";
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool ok = true;
+		if (strcmp(argv[i], "--mass") == 0 && i + 1 < argc) ok = parse_list(argv[++i], masses);
+		else if (strcmp(argv[i], "--smoothing") == 0 && i + 1 < argc) ok = parse_list(argv[++i], smoothings);
+		else if (strcmp(argv[i], "--visc") == 0 && i + 1 < argc) ok = parse_list(argv[++i], viscosities);
+		else if (strcmp(argv[i], "--rest-density") == 0 && i + 1 < argc) ok = parse_list(argv[++i], rest_densities);
+		else if (strcmp(argv[i], "--particles") == 0 && i + 1 < argc) num_particles = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc) steps = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) out_filename = argv[++i];
+		else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc)
+		{
+			SceneFile scene;
+			BindSimulationSettings(scene, &base, &boundary, &time_step);
+			ok = scene.Load(argv[++i], false);
+		}
+		else
+		{
+			fprintf(stderr, "unknown argument %s\n", argv[i]);
+			return 1;
+		}
+		if (!ok)
+		{
+			fprintf(stderr, "bad value for %s\n", argv[i - 1]);
+			return 1;
+		}
+	}
+	if (num_particles <= 0 || steps <= 0)
+	{
+		fprintf(stderr, "--particles and --steps must be positive\n");
+		return 1;
+	}
+
+	if (masses.empty()) masses.push_back(base.mass);
+	if (smoothings.empty()) smoothings.push_back(base.smoothing_coeff);
+	if (viscosities.empty()) viscosities.push_back(base.visc);
+	if (rest_densities.empty()) rest_densities.push_back(base.resting_rho);
+
+	std::vector<SweepRun> runs;
+	for (size_t a = 0; a < masses.size(); a++)
+		for (size_t b = 0; b < smoothings.size(); b++)
+			for (size_t c = 0; c < viscosities.size(); c++)
+				for (size_t d = 0; d < rest_densities.size(); d++)
+				{
+					SweepRun run = SweepRun();
+					run.constants = base;
+					run.constants.mass = masses[a];
+					run.constants.smoothing_coeff = smoothings[b];
+					run.constants.visc = viscosities[c];
+					run.constants.resting_rho = rest_densities[d];
+					// neighbours per particle grow with the volume of the smoothing sphere
+					run.cost = std::pow((double)smoothings[b], 3.0);
+					runs.push_back(run);
+				}
+
+	// longest runs first, so the cheap ones fill the gaps at the end
+	std::vector<int> order(runs.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		order[i] = (int)i;
+	}
+	std::stable_sort(order.begin(), order.end(), [&runs](int a, int b) { return runs[a].cost > runs[b].cost; });
+
+	ThreadPool pool(threads);
+	fprintf(stderr, "%d runs of %d particles x %d steps on %d threads\n", (int)runs.size(), num_particles, steps, pool.NumThreads());
+
+	std::atomic<int> runs_waiting((int)runs.size());
+	std::atomic<int> runs_done(0);
+	const double start = now_seconds();
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		SweepRun* run = &runs[order[i]];
+		pool.Submit([run, &boundary, time_step, num_particles, steps, &pool, &runs_waiting, &runs_done, &runs]()
+		{
+			runs_waiting--;
+			run_simulation(*run, boundary, time_step, num_particles, steps, pool, runs_waiting);
+			const int done = ++runs_done;
+			if (done % 10 == 0 || done == (int)runs.size())
+			{
+				fprintf(stderr, "%d/%d runs done\n", done, (int)runs.size());
+			}
+		});
+	}
+	pool.Wait();
+	const double wall = now_seconds() - start;
+
+	FILE* out = fopen(out_filename, "w");
+	if (out == NULL)
+	{
+		fprintf(stderr, "Could not write %s\n", out_filename);
+		return 1;
+	}
+	fprintf(out, "mass,smoothing,visc,rest_density,seconds,mean_density_error,max_density_error,kinetic_energy,peak_kinetic_energy,stable\n");
+	double run_seconds = 0.0;
+	for (size_t i = 0; i < runs.size(); i++)
+	{
+		const SweepRun& r = runs[i];
+		fprintf(out, "%g,%g,%g,%g,%.4f,%.6g,%.6g,%.6g,%.6g,%d\n", r.constants.mass, r.constants.smoothing_coeff, r.constants.visc, r.constants.resting_rho,
+			r.seconds, r.mean_density_error, r.max_density_error, r.kinetic_energy, r.peak_kinetic_energy, r.stable ? 1 : 0);
+		run_seconds += r.seconds;
+	}
+	fclose(out);
+
+	// best stable runs by density error, the main sign of a well-tuned incompressible fluid
+	std::vector<const SweepRun*> ranked;
+	for (size_t i = 0; i < runs.size(); i++)
+	{
+		if (runs[i].stable)
+		{
+			ranked.push_back(&runs[i]);
+		}
+	}
+	std::sort(ranked.begin(), ranked.end(), [](const SweepRun* a, const SweepRun* b) { return a->mean_density_error < b->mean_density_error; });
+
+	printf("%10s %10s %10s %12s %14s %14s\n", "mass", "smoothing", "visc", "rest_density", "density_error", "kinetic");
+	for (size_t i = 0; i < ranked.size() && i < 10; i++)
+	{
+		const SweepRun& r = *ranked[i];
+		printf("%10g %10g %10g %12g %14.4g %14.4g\n", r.constants.mass, r.constants.smoothing_coeff, r.constants.visc, r.constants.resting_rho, r.mean_density_error, r.kinetic_energy);
+	}
+	// summed run time over wall time and threads: how busy the pool was kept
+	printf("%d runs (%d unstable) in %.2f s, %.0f%% pool utilization, table written to %s\n", (int)runs.size(), (int)(runs.size() - ranked.size()), wall,
+		100.0 * run_seconds / (wall * pool.NumThreads()), out_filename);
+	return 0;
+}
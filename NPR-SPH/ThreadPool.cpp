@@ -0,0 +1,137 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <memory>
+
+ThreadPool::ThreadPool(int num_threads) : mActive(0), mStop(false)
+{
+	if (num_threads <= 0)
+	{
+		num_threads = std::max(1, (int)std::thread::hardware_concurrency());
+	}
+	for (int i = 0; i < num_threads; i++)
+	{
+		mWorkers.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStop = true;
+	}
+	mTaskReady.notify_all();
+	for (size_t i = 0; i < mWorkers.size(); i++)
+	{
+		mWorkers[i].join();
+	}
+}
+
+void ThreadPool::Submit(const std::function<void()>& task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mTasks.push_back(task);
+	}
+	mTaskReady.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	mAllDone.wait(lock, [this] { return mTasks.empty() && mActive == 0; });
+}
+
+void ThreadPool::WorkerLoop()
+{
+	for (;;)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mTaskReady.wait(lock, [this] { return mStop || !mTasks.empty(); });
+			if (mTasks.empty())
+			{
+				return; // stopping and nothing left to do
+			}
+			task = mTasks.front();
+			mTasks.pop_front();
+			mActive++;
+		}
+
+		task();
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mActive--;
+			if (mActive == 0 && mTasks.empty())
+			{
+				mAllDone.notify_all();
+			}
+		}
+	}
+}
+
+// Shared between the caller of ParallelFor() and the helper tasks, which may outlive the call
+struct ParallelForState
+{
+	std::function<void(int, int)> body;
+	int begin, end, grain, num_chunks;
+	std::atomic<int> next_chunk;
+	std::atomic<int> done_chunks;
+	std::mutex mutex;
+	std::condition_variable done;
+
+	// claim and run chunks until none are left
+	void Run()
+	{
+		int finished = 0;
+		for (int c = next_chunk++; c < num_chunks; c = next_chunk++)
+		{
+			const int b = begin + c * grain;
+			body(b, std::min(b + grain, end));
+			finished++;
+		}
+		if (finished > 0 && (done_chunks += finished) == num_chunks)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			done.notify_all();
+		}
+	}
+};
+
+void ThreadPool::ParallelFor(int begin, int end, int grain, const std::function<void(int, int)>& body)
+{
+	if (end <= begin)
+	{
+		return;
+	}
+	grain = std::max(1, grain);
+	const int num_chunks = (end - begin + grain - 1) / grain;
+	if (num_chunks == 1)
+	{
+		body(begin, end);
+		return;
+	}
+
+	std::shared_ptr<ParallelForState> state = std::make_shared<ParallelForState>();
+	state->body = body;
+	state->begin = begin;
+	state->end = end;
+	state->grain = grain;
+	state->num_chunks = num_chunks;
+	state->next_chunk = 0;
+	state->done_chunks = 0;
+
+	const int helpers = std::min(NumThreads(), num_chunks - 1);
+	for (int i = 0; i < helpers; i++)
+	{
+		Submit([state] { state->Run(); });
+	}
+	state->Run();
+
+	// chunks claimed by helpers may still be running
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->done.wait(lock, [&state] { return state->done_chunks.load() == state->num_chunks; });
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+Fixed-size pool of worker threads shared by the CPU simulation tools.
+
+Submit() queues independent tasks, ParallelFor() splits a range into chunks that the calling
+thread and idle workers claim from a shared counter. The caller always works on its own loop,
+so ParallelFor() can be called from inside a pool task without deadlocking.
+*/
+
+class ThreadPool
+{
+public:
+	explicit ThreadPool(int num_threads = 0); // 0: one thread per hardware core
+	~ThreadPool();
+
+	int NumThreads() const { return (int)mWorkers.size(); }
+
+	void Submit(const std::function<void()>& task);
+	void Wait(); // blocks until every submitted task has finished
+
+	// body(begin, end) is called for consecutive chunks of at most grain elements
+	void ParallelFor(int begin, int end, int grain, const std::function<void(int, int)>& body);
+
+private:
+	void WorkerLoop();
+
+	std::vector<std::thread> mWorkers;
+	std::deque<std::function<void()>> mTasks;
+	std::mutex mMutex;
+	std::condition_variable mTaskReady;
+	std::condition_variable mAllDone;
+	int mActive; // tasks currently running
+	bool mStop;
+
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+};
@@ -0,0 +1,669 @@
+#include "Trajectory.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#define fseek64 _fseeki64
+#define ftell64 _ftelli64
+#else
+#define fseek64 fseeko
+#define ftell64 ftello
+#endif
+
+static const char trajectory_magic[8] = { 'N', 'P', 'R', 'S', 'P', 'H', 'T', 'R' };
+static const int max_queued_frames = 64; // back pressure so a slow disk can't eat all memory
+static const int prefetch_frames = 2 * TRAJECTORY_FRAMES_PER_CHUNK; // frames decoded ahead of playback
+
+/**************************************************************/
+/* adaptive binary range coder (LZMA style) */
+
+static const int prob_bits = 11;
+static const int move_bits = 5;
+
+struct RangeEncoder
+{
+	std::vector<uint8_t>& out;
+	uint64_t low = 0;
+	uint32_t range = 0xFFFFFFFFu;
+	uint8_t cache = 0;
+	uint64_t cache_size = 1;
+
+	RangeEncoder(std::vector<uint8_t>& o) : out(o) {}
+
+	void shift_low()
+	{
+		if ((uint32_t)low < 0xFF000000u || (low >> 32) != 0)
+		{
+			uint8_t carry = (uint8_t)(low >> 32);
+			uint8_t temp = cache;
+			do
+			{
+				out.push_back((uint8_t)(temp + carry));
+				temp = 0xFF;
+			} while (--cache_size != 0);
+			cache = (uint8_t)(low >> 24);
+		}
+		cache_size++;
+		low = (low & 0x00FFFFFFu) << 8;
+	}
+
+	void encode_bit(uint16_t& prob, int bit)
+	{
+		uint32_t bound = (range >> prob_bits) * prob;
+		if (bit == 0)
+		{
+			range = bound;
+			prob += ((1 << prob_bits) - prob) >> move_bits;
+		}
+		else
+		{
+			low += bound;
+			range -= bound;
+			prob -= prob >> move_bits;
+		}
+		while (range < (1u << 24))
+		{
+			range <<= 8;
+			shift_low();
+		}
+	}
+
+	void flush()
+	{
+		for (int i = 0; i < 5; i++)
+		{
+			shift_low();
+		}
+	}
+};
+
+struct RangeDecoder
+{
+	const uint8_t* in;
+	const uint8_t* end;
+	uint32_t range = 0xFFFFFFFFu;
+	uint32_t code = 0;
+
+	RangeDecoder(const uint8_t* begin, const uint8_t* e) : in(begin), end(e)
+	{
+		for (int i = 0; i < 5; i++)
+		{
+			code = (code << 8) | next_byte();
+		}
+	}
+
+	uint8_t next_byte()
+	{
+		return in < end ? *in++ : 0;
+	}
+
+	int decode_bit(uint16_t& prob)
+	{
+		uint32_t bound = (range >> prob_bits) * prob;
+		int bit;
+		if (code < bound)
+		{
+			range = bound;
+			prob += ((1 << prob_bits) - prob) >> move_bits;
+			bit = 0;
+		}
+		else
+		{
+			code -= bound;
+			range -= bound;
+			prob -= prob >> move_bits;
+			bit = 1;
+		}
+		while (range < (1u << 24))
+		{
+			range <<= 8;
+			code = (code << 8) | next_byte();
+		}
+		return bit;
+	}
+};
+
+// Byte models indexed by frame kind (key/delta), axis and position of the byte within its varint
+struct ByteModels
+{
+	uint16_t probs[2][3][3][256];
+
+	ByteModels()
+	{
+		uint16_t* p = &probs[0][0][0][0];
+		std::fill(p, p + sizeof(probs) / sizeof(uint16_t), (uint16_t)(1 << (prob_bits - 1)));
+	}
+
+	void encode(RangeEncoder& rc, int kind, int axis, int pos, uint8_t byte)
+	{
+		uint16_t* tree = probs[kind][axis][std::min(pos, 2)];
+		unsigned int m = 1;
+		for (int b = 7; b >= 0; b--)
+		{
+			int bit = (byte >> b) & 1;
+			rc.encode_bit(tree[m], bit);
+			m = (m << 1) | bit;
+		}
+	}
+
+	uint8_t decode(RangeDecoder& rc, int kind, int axis, int pos)
+	{
+		uint16_t* tree = probs[kind][axis][std::min(pos, 2)];
+		unsigned int m = 1;
+		while (m < 256)
+		{
+			m = (m << 1) | rc.decode_bit(tree[m]);
+		}
+		return (uint8_t)(m - 256);
+	}
+};
+
+/**************************************************************/
+/* chunk coding */
+
+typedef std::vector<uint16_t> QuantizedFrame; // 3 values per particle
+
+// Prediction for a value: neighbor particle in key frames, linear extrapolation over the previous two frames otherwise
+static int predict(const std::vector<QuantizedFrame>& frames, int f, int i)
+{
+	if (f == 0)
+	{
+		return i >= 3 ? frames[0][i - 3] : 0;
+	}
+	if (f == 1)
+	{
+		return frames[0][i];
+	}
+	int p = 2 * frames[f - 1][i] - frames[f - 2][i];
+	return std::max(0, std::min(p, (1 << TRAJECTORY_QUANT_BITS) - 1));
+}
+
+static void encode_chunk(const std::vector<QuantizedFrame>& frames, std::vector<uint8_t>& out)
+{
+	RangeEncoder rc(out);
+	ByteModels* models = new ByteModels();
+	for (int f = 0; f < (int)frames.size(); f++)
+	{
+		const int kind = f == 0 ? 0 : 1;
+		for (int i = 0; i < (int)frames[f].size(); i++)
+		{
+			int delta = (int)frames[f][i] - predict(frames, f, i);
+			uint32_t z = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31); // zigzag
+			int pos = 0;
+			do
+			{
+				uint8_t byte = z & 0x7F;
+				z >>= 7;
+				if (z != 0) byte |= 0x80;
+				models->encode(rc, kind, i % 3, pos++, byte);
+			} while (z != 0);
+		}
+	}
+	rc.flush();
+	delete models;
+}
+
+static void decode_chunk(const std::vector<uint8_t>& in, int num_frames, int num_values, std::vector<QuantizedFrame>& frames)
+{
+	RangeDecoder rc(in.data(), in.data() + in.size());
+	ByteModels* models = new ByteModels();
+	frames.assign(num_frames, QuantizedFrame(num_values));
+	for (int f = 0; f < num_frames; f++)
+	{
+		const int kind = f == 0 ? 0 : 1;
+		for (int i = 0; i < num_values; i++)
+		{
+			uint32_t z = 0;
+			int pos = 0;
+			uint8_t byte;
+			do
+			{
+				byte = models->decode(rc, kind, i % 3, pos);
+				z |= (uint32_t)(byte & 0x7F) << (7 * pos);
+				pos++;
+			} while ((byte & 0x80) != 0 && pos < 5);
+			int delta = (int)(z >> 1) ^ -(int)(z & 1);
+			frames[f][i] = (uint16_t)(predict(frames, f, i) + delta);
+		}
+	}
+	delete models;
+}
+
+/**************************************************************/
+/* writer */
+
+static std::thread writer_thread;
+static std::mutex queue_mutex;
+static std::condition_variable queue_cv;
+static std::condition_variable space_cv;
+static std::deque<std::vector<glm::vec4>> frame_queue;
+static bool stop_requested = false;
+static bool recording = false;
+
+static FILE* traj_file = NULL;
+static std::string traj_filename;
+static bool write_failed = false; // a chunk could not be written, e.g. the disk is full; later ones are dropped
+static TrajectoryHeader traj_header;
+static std::vector<TrajectoryChunkEntry> traj_index;
+
+static std::atomic<uint32_t> frames_written(0);
+static std::atomic<uint64_t> bytes_written(0);
+
+static void quantize(const std::vector<glm::vec4>& positions, QuantizedFrame& q)
+{
+	const float max_q = (float)((1 << TRAJECTORY_QUANT_BITS) - 1);
+	q.resize(3 * positions.size());
+	for (size_t p = 0; p < positions.size(); p++)
+	{
+		for (int a = 0; a < 3; a++)
+		{
+			float t = (positions[p][a] - traj_header.lower[a]) / (traj_header.upper[a] - traj_header.lower[a]);
+			t = std::max(0.0f, std::min(t, 1.0f));
+			q[3 * p + a] = (uint16_t)(t * max_q + 0.5f);
+		}
+	}
+}
+
+static void write_chunk(std::vector<QuantizedFrame>& frames)
+{
+	if (frames.empty() || write_failed)
+	{
+		frames.clear();
+		return;
+	}
+
+	PROFILE_SCOPE("write_chunk");
+	std::vector<uint8_t> payload;
+	encode_chunk(frames, payload);
+
+	TrajectoryChunkEntry entry;
+	entry.offset = (uint64_t)ftell64(traj_file);
+	entry.first_frame = traj_header.num_frames;
+	entry.num_frames = (uint32_t)frames.size();
+
+	uint32_t chunk_header[2] = { (uint32_t)payload.size(), entry.num_frames };
+	bool ok = fwrite(chunk_header, sizeof(chunk_header), 1, traj_file) == 1;
+	ok = ok && (payload.empty() || fwrite(payload.data(), payload.size(), 1, traj_file) == 1);
+	if (!ok)
+	{
+		// the index written at the end only lists the chunks before this one
+		fprintf(stderr, "Error while writing trajectory %s, frames from %u on are lost\n", traj_filename.c_str(), entry.first_frame);
+		write_failed = true;
+		frames.clear();
+		return;
+	}
+	traj_index.push_back(entry);
+
+	traj_header.num_frames += entry.num_frames;
+	traj_header.num_chunks++;
+	frames_written.store(traj_header.num_frames);
+	bytes_written += sizeof(chunk_header) + payload.size();
+	frames.clear();
+}
+
+static void writer_loop()
+{
+	ProfilerSetThreadName("trajectory writer");
+	std::vector<QuantizedFrame> chunk;
+	for (;;)
+	{
+		std::vector<glm::vec4> positions;
+		{
+			std::unique_lock<std::mutex> lock(queue_mutex);
+			queue_cv.wait(lock, [] { return !frame_queue.empty() || stop_requested; });
+			if (frame_queue.empty())
+			{
+				break; // stop requested and everything has been drained
+			}
+			positions = std::move(frame_queue.front());
+			frame_queue.pop_front();
+		}
+		space_cv.notify_one();
+
+		PROFILE_SCOPE("quantize");
+		chunk.push_back(QuantizedFrame());
+		quantize(positions, chunk.back());
+		if (chunk.size() == TRAJECTORY_FRAMES_PER_CHUNK)
+		{
+			write_chunk(chunk);
+		}
+	}
+	write_chunk(chunk);
+
+	// frame index at the end, then patch the header to point at it
+	traj_header.index_offset = (uint64_t)ftell64(traj_file);
+	bool ok = traj_index.empty() || fwrite(traj_index.data(), sizeof(TrajectoryChunkEntry), traj_index.size(), traj_file) == traj_index.size();
+	ok = ok && fseek64(traj_file, 0, SEEK_SET) == 0;
+	ok = ok && fwrite(&traj_header, sizeof(traj_header), 1, traj_file) == 1;
+	ok = (fclose(traj_file) == 0) && ok;
+	traj_file = NULL;
+	if (!ok)
+	{
+		fprintf(stderr, "Error while writing the index of trajectory %s, it cannot be read back\n", traj_filename.c_str());
+		write_failed = true;
+	}
+}
+
+bool start_trajectory(const std::string& filename, int num_particles, const BoundaryUniform& box)
+{
+	if (recording)
+	{
+		return false;
+	}
+
+	traj_file = fopen(filename.c_str(), "wb");
+	if (traj_file == NULL)
+	{
+		fprintf(stderr, "Could not open trajectory file %s\n", filename.c_str());
+		return false;
+	}
+
+	memset(&traj_header, 0, sizeof(traj_header));
+	memcpy(traj_header.magic, trajectory_magic, sizeof(traj_header.magic));
+	traj_header.version = TRAJECTORY_VERSION;
+	traj_header.num_particles = num_particles;
+	traj_header.frames_per_chunk = TRAJECTORY_FRAMES_PER_CHUNK;
+	traj_header.quant_bits = TRAJECTORY_QUANT_BITS;
+	for (int a = 0; a < 3; a++)
+	{
+		traj_header.lower[a] = box.lower[a];
+		traj_header.upper[a] = box.upper[a];
+	}
+	if (fwrite(&traj_header, sizeof(traj_header), 1, traj_file) != 1) // placeholder, rewritten by finish_trajectory()
+	{
+		fprintf(stderr, "Error while writing trajectory %s\n", filename.c_str());
+		fclose(traj_file);
+		traj_file = NULL;
+		return false;
+	}
+
+	traj_filename = filename;
+	write_failed = false;
+	traj_index.clear();
+	frames_written.store(0);
+	bytes_written.store(sizeof(traj_header));
+	stop_requested = false;
+	recording = true;
+	writer_thread = std::thread(writer_loop);
+	return true;
+}
+
+void push_trajectory_frame(const Particle* particles, int num_particles)
+{
+	if (!recording || num_particles != (int)traj_header.num_particles)
+	{
+		return;
+	}
+
+	std::vector<glm::vec4> positions(num_particles);
+	for (int i = 0; i < num_particles; i++)
+	{
+		positions[i] = particles[i].pos;
+	}
+
+	std::unique_lock<std::mutex> lock(queue_mutex);
+	space_cv.wait(lock, [] { return (int)frame_queue.size() < max_queued_frames; });
+	frame_queue.push_back(std::move(positions));
+	lock.unlock();
+	queue_cv.notify_one();
+}
+
+void finish_trajectory()
+{
+	if (!recording)
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		stop_requested = true;
+	}
+	queue_cv.notify_one();
+	writer_thread.join();
+	recording = false;
+
+	uint32_t frames;
+	uint64_t raw, compressed;
+	trajectory_stats(&frames, &raw, &compressed);
+	if (write_failed)
+	{
+		fprintf(stderr, "Trajectory %s is incomplete: %u frames written\n", traj_filename.c_str(), frames);
+		return;
+	}
+	printf("Trajectory: %u frames, %llu bytes (%.1fx smaller than raw particles)\n",
+		frames, (unsigned long long)compressed, compressed > 0 ? (double)raw / compressed : 0.0);
+}
+
+bool trajectory_recording()
+{
+	return recording;
+}
+
+void trajectory_stats(uint32_t* frames, uint64_t* raw_bytes, uint64_t* compressed_bytes)
+{
+	*frames = frames_written.load();
+	*raw_bytes = (uint64_t)*frames * traj_header.num_particles * sizeof(Particle);
+	*compressed_bytes = bytes_written.load();
+}
+
+/**************************************************************/
+/* reader */
+
+bool TrajectoryReader::Open(const std::string& filename)
+{
+	Close();
+
+	mFile = fopen(filename.c_str(), "rb");
+	if (mFile == NULL)
+	{
+		fprintf(stderr, "Couldn't open trajectory %s\n", filename.c_str());
+		return false;
+	}
+
+	if (fread(&mHeader, sizeof(mHeader), 1, mFile) != 1 ||
+		memcmp(mHeader.magic, trajectory_magic, sizeof(mHeader.magic)) != 0 ||
+		mHeader.version != TRAJECTORY_VERSION || mHeader.quant_bits != TRAJECTORY_QUANT_BITS)
+	{
+		fprintf(stderr, "%s is not a supported trajectory file\n", filename.c_str());
+		Close();
+		return false;
+	}
+	if (mHeader.index_offset == 0)
+	{
+		fprintf(stderr, "%s was not finished, the frame index is missing\n", filename.c_str());
+		Close();
+		return false;
+	}
+
+	mIndex.resize(mHeader.num_chunks);
+	fseek64(mFile, mHeader.index_offset, SEEK_SET);
+	if (!mIndex.empty() && fread(mIndex.data(), sizeof(TrajectoryChunkEntry), mIndex.size(), mFile) != mIndex.size())
+	{
+		fprintf(stderr, "%s has a truncated frame index\n", filename.c_str());
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void TrajectoryReader::Close()
+{
+	if (mFile != NULL)
+	{
+		fclose(mFile);
+		mFile = NULL;
+	}
+	mIndex.clear();
+	mCachedChunk = -1;
+	mCachedFrames.clear();
+}
+
+bool TrajectoryReader::ReadFrame(int frame, std::vector<glm::vec4>& positions)
+{
+	if (mFile == NULL || frame < 0 || frame >= (int)mHeader.num_frames)
+	{
+		return false;
+	}
+
+	const int chunk = frame / mHeader.frames_per_chunk;
+	if (chunk != mCachedChunk)
+	{
+		const TrajectoryChunkEntry& entry = mIndex[chunk];
+		uint32_t chunk_header[2];
+		fseek64(mFile, entry.offset, SEEK_SET);
+		if (fread(chunk_header, sizeof(chunk_header), 1, mFile) != 1)
+		{
+			return false;
+		}
+		std::vector<uint8_t> payload(chunk_header[0]);
+		if (!payload.empty() && fread(payload.data(), payload.size(), 1, mFile) != 1)
+		{
+			return false;
+		}
+
+		std::vector<QuantizedFrame> frames;
+		decode_chunk(payload, chunk_header[1], 3 * mHeader.num_particles, frames);
+
+		// dequantize the whole chunk, neighboring frames are usually requested next
+		const float max_q = (float)((1 << TRAJECTORY_QUANT_BITS) - 1);
+		mCachedFrames.assign(frames.size(), std::vector<glm::vec4>(mHeader.num_particles));
+		for (size_t f = 0; f < frames.size(); f++)
+		{
+			for (uint32_t p = 0; p < mHeader.num_particles; p++)
+			{
+				glm::vec4& pos = mCachedFrames[f][p];
+				for (int a = 0; a < 3; a++)
+				{
+					pos[a] = mHeader.lower[a] + frames[f][3 * p + a] / max_q * (mHeader.upper[a] - mHeader.lower[a]);
+				}
+				pos.w = 1.0f;
+			}
+		}
+		mCachedChunk = chunk;
+	}
+
+	positions = mCachedFrames[frame - chunk * mHeader.frames_per_chunk];
+	return true;
+}
+
+/**************************************************************/
+/* player */
+
+bool TrajectoryPlayer::Open(const std::string& filename)
+{
+	Close();
+
+	if (!mReader.Open(filename))
+	{
+		return false;
+	}
+	mNumFrames = mReader.NumFrames();
+	mNumParticles = (int)mReader.mHeader.num_particles;
+	mTarget = 0;
+	mDirection = 1;
+	mStop = false;
+	mThread = std::thread(&TrajectoryPlayer::ReaderLoop, this);
+	return true;
+}
+
+void TrajectoryPlayer::Close()
+{
+	if (mThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mStop = true;
+		}
+		mWake.notify_one();
+		mThread.join();
+	}
+	mReader.Close();
+	mFrames.clear();
+	mNumFrames = 0;
+	mNumParticles = 0;
+}
+
+void TrajectoryPlayer::Seek(int frame, int direction)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (frame == mTarget && direction == mDirection)
+		{
+			return;
+		}
+		mTarget = frame;
+		mDirection = direction < 0 ? -1 : 1;
+	}
+	mWake.notify_one();
+}
+
+bool TrajectoryPlayer::GetFrame(int frame, std::vector<glm::vec4>& positions)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	std::map<int, std::vector<glm::vec4>>::iterator it = mFrames.find(frame);
+	if (it == mFrames.end())
+	{
+		return false;
+	}
+	positions = it->second;
+	return true;
+}
+
+void TrajectoryPlayer::ReaderLoop()
+{
+	ProfilerSetThreadName("trajectory reader");
+	std::vector<glm::vec4> positions;
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (!mStop)
+	{
+		// drop frames that fell out of the window
+		const int lo = mDirection > 0 ? mTarget : mTarget - prefetch_frames;
+		const int hi = mDirection > 0 ? mTarget + prefetch_frames : mTarget;
+		for (std::map<int, std::vector<glm::vec4>>::iterator it = mFrames.begin(); it != mFrames.end();)
+		{
+			it = (it->first < lo || it->first > hi) ? mFrames.erase(it) : ++it;
+		}
+
+		// nearest missing frame in playback direction
+		int next = -1;
+		for (int i = 0; i <= prefetch_frames; i++)
+		{
+			int f = mTarget + i * mDirection;
+			if (f >= 0 && f < mNumFrames && mFrames.find(f) == mFrames.end())
+			{
+				next = f;
+				break;
+			}
+		}
+
+		if (next < 0)
+		{
+			mWake.wait(lock); // window is full, sleep until the player moves
+			continue;
+		}
+
+		// decode without holding the lock so GetFrame() never waits on disk
+		lock.unlock();
+		bool ok;
+		{
+			PROFILE_SCOPE("ReadFrame");
+			ok = mReader.ReadFrame(next, positions);
+		}
+		lock.lock();
+		if (!ok)
+		{
+			fprintf(stderr, "Failed to read trajectory frame %d\n", next);
+			mWake.wait(lock);
+			continue;
+		}
+		mFrames[next] = positions;
+	}
+}
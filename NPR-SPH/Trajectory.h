@@ -0,0 +1,122 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Simulation.h"
+
+/*
+Compressed particle trajectories for offline rendering.
+
+Positions are quantized to 16 bits per axis relative to the simulation domain box, delta coded
+and entropy coded with an adaptive range coder. Frames are grouped into chunks that can be
+decoded independently: the first frame of a chunk is delta coded between neighboring particles,
+the remaining frames against the same particle in the previous frame.
+
+File layout (version 1):
+	TrajectoryHeader
+	chunk 0, chunk 1, ...  each: uint32 compressed size, uint32 frame count, payload
+	TrajectoryChunkEntry[num_chunks]  at index_offset, lets readers seek to any frame
+*/
+
+#define TRAJECTORY_VERSION 1
+#define TRAJECTORY_FRAMES_PER_CHUNK 32
+#define TRAJECTORY_QUANT_BITS 16
+
+struct TrajectoryHeader
+{
+	char magic[8]; // "NPRSPHTR"
+	uint32_t version;
+	uint32_t num_particles;
+	uint32_t frames_per_chunk;
+	uint32_t quant_bits;
+	float lower[3]; // domain box used for quantization
+	float upper[3];
+	uint32_t num_frames;
+	uint32_t num_chunks;
+	uint64_t index_offset; // 0 while the file is still being written
+};
+
+struct TrajectoryChunkEntry
+{
+	uint64_t offset; // file offset of the chunk
+	uint32_t first_frame;
+	uint32_t num_frames;
+};
+
+// Writer: frames are handed to a background thread that quantizes, compresses and writes them.
+bool start_trajectory(const std::string& filename, int num_particles, const BoundaryUniform& box);
+void push_trajectory_frame(const Particle* particles, int num_particles); // copies the positions
+void finish_trajectory(); // flushes the last chunk and writes the frame index
+bool trajectory_recording();
+void trajectory_stats(uint32_t* frames, uint64_t* raw_bytes, uint64_t* compressed_bytes);
+
+// Reader: random access to any frame through the chunk index.
+struct TrajectoryReader
+{
+	TrajectoryHeader mHeader;
+	std::vector<TrajectoryChunkEntry> mIndex;
+	FILE* mFile;
+
+	TrajectoryReader() : mFile(NULL), mCachedChunk(-1) {}
+	~TrajectoryReader() { Close(); }
+
+	bool Open(const std::string& filename);
+	void Close();
+	int NumFrames() const { return mFile != NULL ? (int)mHeader.num_frames : 0; }
+
+	// Decodes frame into positions (w = 1). Frames of the most recently decoded chunk are cached.
+	bool ReadFrame(int frame, std::vector<glm::vec4>& positions);
+
+private:
+	int mCachedChunk;
+	std::vector<std::vector<glm::vec4>> mCachedFrames;
+
+	TrajectoryReader(const TrajectoryReader&);
+	TrajectoryReader& operator=(const TrajectoryReader&);
+};
+
+// Player: a reader thread decodes frames ahead of the playback position so the render loop never waits on disk.
+struct TrajectoryPlayer
+{
+	TrajectoryPlayer() : mNumFrames(0), mNumParticles(0), mTarget(0), mDirection(1), mStop(false) {}
+	~TrajectoryPlayer() { Close(); }
+
+	bool Open(const std::string& filename);
+	void Close();
+	bool IsOpen() const { return mThread.joinable(); }
+	int NumFrames() const { return mNumFrames; }
+	int NumParticles() const { return mNumParticles; }
+
+	// Moves the prefetch window. direction is +1 for forward and -1 for reverse playback.
+	void Seek(int frame, int direction);
+
+	// Non-blocking: returns false if the frame hasn't been decoded yet.
+	bool GetFrame(int frame, std::vector<glm::vec4>& positions);
+
+private:
+	void ReaderLoop();
+
+	TrajectoryReader mReader;
+	int mNumFrames;
+	int mNumParticles;
+
+	std::thread mThread;
+	std::mutex mMutex;
+	std::condition_variable mWake;
+	std::map<int, std::vector<glm::vec4>> mFrames; // decoded frames inside the prefetch window
+	int mTarget;
+	int mDirection;
+	bool mStop;
+
+	TrajectoryPlayer(const TrajectoryPlayer&);
+	TrajectoryPlayer& operator=(const TrajectoryPlayer&);
+};
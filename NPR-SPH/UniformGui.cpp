@@ -508,7 +508,7 @@ std::string ArrayElementName(const std::string& name, int index)
    return element_name;
 }
 
-inline bool ends_with(const std::string const & value, const std::string const & ending)
+inline bool ends_with(const std::string & value, const std::string & ending)
 {
     if (ending.size() > value.size()) return false;
     return std::equal(ending.rbegin(), ending.rend(), value.rbegin());
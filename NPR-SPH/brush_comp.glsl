@@ -0,0 +1,288 @@
+#version 440
+
+// Brush stroke generation: one stroke per mesh seed or particle, written to the stroke buffer
+// that brush_vs expands into quads. The number of strokes goes into the instance count of the
+// indirect draw command, so strokes can be skipped here without the CPU knowing how many are left.
+//
+// The strokes that are kept stay in source order, so they blend the same way from one dispatch to
+// the next. BrushStrokes::Generate() runs three passes, set by compact_pass: 0 counts the strokes
+// every work group keeps, 1 turns the counts into the offset each group writes at (a prefix sum in
+// a single work group), and 2 builds the strokes again and writes them there.
+//
+// With culling on, strokes outside the view frustum, on back faces or narrower than cull_pixels are
+// skipped. Strokes narrower than lod_pixels are thinned: a stroke survives with probability
+// (width / lod_pixels)^2, decided by a hash of its source index so the same strokes survive from
+// frame to frame, and the survivors grow to lod_pixels to cover for the ones left out.
+// guard_band widens the frustum and keeps slightly back-facing strokes, so strokes cached by
+// StrokeCache stay complete while the camera moves a little.
+
+#define WORK_GROUP_SIZE 256
+
+layout (local_size_x = WORK_GROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+
+layout(location = 0) uniform mat4 M;
+layout(location = 3) uniform int mode; // 0: mesh, 1: particles
+layout(location = 4) uniform float mesh_d;
+layout(location = 5) uniform float mesh_range;
+layout(location = 6) uniform float scale;
+layout(location = 13) uniform int source_count; // mesh seeds or particles
+layout(location = 14) uniform int source_stride; // floats from one source to the next
+layout(location = 12) uniform ivec2 viewport; // pixels the strokes are drawn to
+layout(location = 15) uniform bool culling;
+layout(location = 16) uniform float cull_pixels; // strokes narrower than this are skipped
+layout(location = 17) uniform float lod_pixels; // strokes narrower than this are thinned
+layout(location = 22) uniform float guard_band; // fraction of the view added on every side
+layout(location = 27) uniform int compact_pass;
+
+// repeated code in brush_vs
+layout(std140, binding = 0) uniform SceneUniforms
+{
+   mat4 P; // camera projection * view matrix
+   mat4 V;
+   vec4 eye_w; // world-space eye position 
+   vec4 light_w; // world-space light position
+};
+
+layout(std140, binding = 3) uniform MaterialUniforms
+{
+   vec4 dark; // ambient material color
+   vec4 midtone; // diffuse material color
+   vec4 highlight; // specular material color
+   vec4 outline_color;
+   float shininess;
+   float brush_scale;
+};
+
+// sources, read as plain floats so the same code takes the StrokeSeeds of a mesh
+// (position, s, normal, t), the Particle structs of the simulation and the vec4s of a replayed trajectory
+layout(std430, binding = 1) readonly buffer SOURCES { float sources[]; };
+
+struct Stroke
+{
+    vec4 center; // xyz: world-space center, w: depth compared against fbo_tex
+    vec4 axis_u; // xyz: half the width along the stroke, w: opacity at the faded end
+    vec4 axis_w; // xyz: half the height across the stroke, w: opacity at the opaque end
+    vec4 normal; // xyz: world-space normal
+    vec2 seed; // texture coordinate the color noise in brush_fs is hashed from
+};
+
+layout(std430, binding = 5) writeonly buffer STROKES { Stroke strokes[]; };
+
+// DrawArraysIndirectCommand, instance_count is written by compact_pass 1
+layout(std430, binding = 6) buffer DRAW_COMMAND
+{
+    uint vertex_count; // 4, one triangle strip per stroke
+    uint instance_count;
+    uint first_vertex;
+    uint base_instance;
+};
+
+// BrushStats, cleared by the CPU before the dispatch, counted by compact_pass 0 and read back a few
+// frames later
+layout(std430, binding = 7) buffer STATS
+{
+    uint total; // sources, written by the CPU
+    uint frustum_culled;
+    uint backface_culled;
+    uint small_culled;
+    uint thinned;
+    uint drawn_fill; // fill_unit pixels covered by the drawn strokes, counting overlaps
+    uint saved_fill; // fill_unit pixels the back-facing and small strokes would have covered
+};
+
+// strokes kept by each work group after compact_pass 0, the first stroke it writes after pass 1
+layout(std430, binding = 8) buffer GROUPS { uint groups[]; };
+
+// BRUSH_FILL_UNIT, so the fill counters don't wrap at 4G pixels
+const float fill_unit = 256.0;
+
+// why make_stroke() left a stroke out
+const int KEPT = 0;
+const int FRUSTUM_CULLED = 1;
+const int BACKFACE_CULLED = 2;
+const int SMALL_CULLED = 3;
+const int THINNED = 4;
+const int NO_SOURCE = 5; // invocations past the last source
+
+// rectangular brushes
+const float brush_w = 0.03;
+const float brush_h = 0.02;
+
+// values to calculate variations alpha
+const float opaque_min = 0.3; // min opacity for opaque area
+const float opaque_max = 0.8; // max opacity for opaque area
+const float trans_min = 0.0; // min opacity for transparent area
+const float trans_max = 0.3; // max opacity for transparent area
+
+// uniform in [0, 1), from an integer hash so it only depends on the source index
+float hash(uint x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return float(x >> 8) / 16777216.0;
+}
+
+shared uint sums[WORK_GROUP_SIZE];
+
+// Inclusive prefix sum of value over the work group, sums[WORK_GROUP_SIZE - 1] holds the total
+// afterwards. Every invocation of the group has to call it.
+uint group_prefix_sum(uint value)
+{
+    uint local = gl_LocalInvocationID.x;
+    sums[local] = value;
+    barrier();
+    for (uint offset = 1u; offset < WORK_GROUP_SIZE; offset *= 2u) {
+        uint add = (local >= offset) ? sums[local - offset] : 0u;
+        barrier();
+        sums[local] += add;
+        barrier();
+    }
+    return sums[local];
+}
+
+// compact_pass 1, a single work group: the kept strokes of every group become the offset the group
+// writes at, and their total the instance count
+void scan_groups()
+{
+    uint group_count = (uint(source_count) + WORK_GROUP_SIZE - 1u) / WORK_GROUP_SIZE;
+    uint total = 0u;
+    for (uint first = 0u; first < group_count; first += WORK_GROUP_SIZE) {
+        uint g = first + gl_LocalInvocationID.x;
+        uint kept = (g < group_count) ? groups[g] : 0u;
+        uint sum = group_prefix_sum(kept);
+        if (g < group_count) {
+            groups[g] = total + sum - kept;
+        }
+        total += sums[WORK_GROUP_SIZE - 1];
+        barrier(); // everyone has read the total before the next chunk overwrites sums
+    }
+    if (gl_LocalInvocationID.x == 0u) {
+        instance_count = total;
+    }
+}
+
+// The stroke of source id, and whether it is drawn: KEPT or the reason it was left out. fill is
+// the pixels it covers on screen, or would have covered.
+int make_stroke(int id, out Stroke stroke, out float fill)
+{
+    // what brush_vs passed to the geometry shader
+    vec3 pos;
+    vec3 nw;
+    vec2 tex_coord;
+    float depth;
+    int p = id * source_stride;
+    if (mode == 0) {
+        // mesh, a seed sampled on its surface
+        pos = vec3(sources[p], sources[p + 1], sources[p + 2]);
+        nw = vec3(M * vec4(sources[p + 4], sources[p + 5], sources[p + 6], 0.0)); // world-space normal vector
+        tex_coord = vec2(sources[p + 3], sources[p + 7]);
+        // its just the edge of the model, we are looking at the z depth within the model (model space)
+        depth = (pos.z + mesh_d) / mesh_range;
+    } else {
+        // simulate
+        pos = vec3(sources[p], sources[p + 1], sources[p + 2]);
+        nw = vec3(1.0, 0.0, 0.0);
+        tex_coord = vec2(1.0, 0.0);
+        depth = 1.0;
+    }
+    vec3 pw = vec3(M * vec4(pos, 1.0)); // world-space vertex position
+
+    // random from noise function
+    float noise = fract(sin(dot(tex_coord, vec2(12.9898,78.233))) * 43758.5453)+0.001;
+
+    // calculating the two cotangents u and w 
+    vec3 world_up = vec3(M*vec4(0,1,0,0));
+    vec3 u = normalize(cross(world_up, normalize(nw))); 
+    vec3 w = cross(normalize(nw), u);
+
+    // get stroke's width and height
+    float width = brush_w * scale * brush_scale;
+    float height = brush_h * scale * brush_scale;
+
+    stroke.center = vec4(pw, depth);
+    // more transparent on one end (like when paint fades towards the end of the stroke), -0.01 to blur the edge
+    stroke.axis_u = vec4((width / 2) * u, trans_min + (trans_max - trans_min) * noise - 0.01);
+    // more opaque on the other
+    stroke.axis_w = vec4((height / 2) * w, opaque_min + (opaque_max - opaque_min) * noise - 0.01);
+    stroke.normal = vec4(nw, 0.0);
+    stroke.seed = tex_coord;
+
+    vec3 pv = vec3(V * vec4(pw, 1.0)); // view-space center
+    // pixels per world unit at the stroke's distance, and the quad's footprint on screen
+    float pixels_per_unit = (pv.z < 0.0) ? 0.5 * P[1][1] * float(viewport.y) / -pv.z : 0.0;
+    float width_px = width * pixels_per_unit;
+    float facing = (mode == 0) ? dot(normalize(nw), normalize(eye_w.xyz - pw)) : 1.0; // particles have no normal
+    fill = min(width_px * height * pixels_per_unit * abs(facing), float(viewport.x * viewport.y));
+
+    if (culling) {
+        // frustum, one plane at a time against the quad's bounding sphere: x and y through the
+        // projection, z against the near plane
+        float radius = (width + height) / 2;
+        float near = P[3][2] / (P[2][2] - 1.0);
+        float widen = 1.0 + guard_band;
+        vec2 side = abs(pv.xy) * vec2(P[0][0], P[1][1]) + widen * pv.z; // > 0 outside the side planes
+        vec2 side_scale = sqrt(vec2(P[0][0], P[1][1]) * vec2(P[0][0], P[1][1]) + widen * widen);
+        if (any(greaterThan(side, radius * side_scale)) || pv.z > radius - near) {
+            return FRUSTUM_CULLED;
+        }
+        if (facing < -0.5 * guard_band) {
+            return BACKFACE_CULLED;
+        }
+        if (width_px < cull_pixels) {
+            return SMALL_CULLED;
+        }
+        float keep = min(1.0, (width_px / lod_pixels) * (width_px / lod_pixels));
+        if (hash(uint(id)) >= keep) {
+            return THINNED;
+        }
+        // survivors grow by the strokes around them that were left out
+        stroke.axis_u.xyz *= inversesqrt(keep);
+        stroke.axis_w.xyz *= inversesqrt(keep);
+        fill /= keep;
+    }
+    return KEPT;
+}
+
+void main(void)
+{
+    if (compact_pass == 1) {
+        scan_groups();
+        return;
+    }
+
+    // invocations past the last source still take part in the prefix sum
+    int id = int(gl_GlobalInvocationID.x);
+    Stroke stroke;
+    float fill = 0.0;
+    int result = (id < source_count) ? make_stroke(id, stroke, fill) : NO_SOURCE;
+    uint rank = group_prefix_sum(result == KEPT ? 1u : 0u); // kept strokes up to this one
+
+    if (compact_pass == 0) {
+        if (gl_LocalInvocationID.x == WORK_GROUP_SIZE - 1) {
+            groups[gl_WorkGroupID.x] = rank;
+        }
+        if (result == NO_SOURCE) {
+            return;
+        }
+        // distant strokes cover a fraction of a unit, so the counters round up or down at random
+        uint units = uint(fill / fill_unit + hash(uint(id) ^ 0x9e3779b9u));
+        if (result == KEPT) {
+            atomicAdd(drawn_fill, units);
+        } else if (result == FRUSTUM_CULLED) {
+            atomicAdd(frustum_culled, 1u);
+        } else if (result == BACKFACE_CULLED) {
+            atomicAdd(backface_culled, 1u);
+            atomicAdd(saved_fill, units);
+        } else if (result == SMALL_CULLED) {
+            atomicAdd(small_culled, 1u);
+            atomicAdd(saved_fill, units);
+        } else {
+            atomicAdd(thinned, 1u); // saves the stroke, not its fill: the survivors cover for it
+        }
+    } else if (result == KEPT) {
+        strokes[groups[gl_WorkGroupID.x] + rank - 1u] = stroke;
+    }
+}
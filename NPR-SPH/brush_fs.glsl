@@ -2,8 +2,15 @@
 #define PI 3.1415926538
 
 layout(binding = 0) uniform sampler2D fbo_tex; 
+layout(binding = 4) uniform sampler2D edge_tex; // 1 on outlines, from edge_comp
 
 layout(location = 3) uniform int mode;
+// false: blend the color into the scene. true: blend the weights of the material colors into the
+// three paint layer targets, which paint_resolve_fs turns into the color (see StrokeCache.h)
+layout(location = 21) uniform bool paint_layer;
+// with paint_layer: accumulate the layer for weighted blended order-independent transparency
+// instead of blending it over
+layout(location = 24) uniform bool weighted_blend;
 
 layout(std140, binding = 0) uniform SceneUniforms
 {
@@ -32,48 +39,66 @@ in VertexData
    float color;
 } inData; //block is named 'inData'
 
-out vec4 fragcolor; //the output color for this fragment    
-
-// sobel filter
-mat3 sx = mat3( 
-    1.0, 2.0, 1.0, 
-    0.0, 0.0, 0.0, 
-   -1.0, -2.0, -1.0 
-);
-mat3 sy = mat3( 
-    1.0, 0.0, -1.0, 
-    2.0, 0.0, -2.0, 
-    1.0, 0.0, -1.0 
-);
-
-vec4 outline();
-vec4 celshading();
+layout(location = 0) out vec4 fragcolor; //the output color for this fragment, or paint layer 0
+layout(location = 1) out vec4 layer1;
+layout(location = 2) out vec4 layer2;
+
+vec3 celshading();
 vec3 desaturate(vec3 color, float amount);
-vec4 phong();
+vec3 phong();
 
 void main(void)
 {   
-    // mixing celshading and phong to get blended look
-    fragcolor = mix(celshading(), phong(), 0.5);
+    // if the depth is different then its a different object and can discard
+    if (abs(inData.depth - texelFetch(fbo_tex, ivec2(gl_FragCoord), 0).g) > 0.01) {
+        discard;
+    }
+
+    // mixing celshading and phong to get blended look, as weights of dark, midtone and highlight
+    vec3 tones = mix(celshading(), phong(), 0.5);
 
     // random color variation from noise function
     // 0.02 to lower the range, adding subtle variation
     float noise = (fract(sin(dot(inData.tex_coord, vec2(12.9898,78.233))) * 43758.5453)*0.02);
-    fragcolor += noise;
 
-    vec3 fill = outline().rgb;
-    vec3 outlines = vec3(1.0) - fill; // inverse of fill
+    // outlines with varying thickness (thicker when close to the viewer), found once per pixel by edge_comp
+    float fill = 1.0 - texelFetch(edge_tex, ivec2(gl_FragCoord), 0).r;
+    float outlines = 1.0 - fill; // inverse of fill
     // lighter outline and colors at the back
-    vec3 line_color = desaturate(outline_color.rgb, clamp(pow(length(vec3(eye_w) - inData.pw)/15.0, 4), 0.0, 0.8)) * outlines;
-    vec3 desat_fill = desaturate(fragcolor.rgb, clamp(pow(length(vec3(eye_w) - inData.pw)/15.0, 4), 0.0, 0.8)) * fill;
-    fragcolor = vec4(line_color + desat_fill, 1.0);
+    float amount = clamp(pow(length(vec3(eye_w) - inData.pw)/15.0, 4), 0.0, 0.8);
 
     // keeping strokes inside the object
-    fragcolor.a = texelFetch(fbo_tex, ivec2(gl_FragCoord), 0).b * inData.color;
-    // if the depth is different then its a different object and can discard
-    if (abs(inData.depth - texelFetch(fbo_tex, ivec2(gl_FragCoord), 0).g) > 0.01) {
-        discard;
+    float alpha = texelFetch(fbo_tex, ivec2(gl_FragCoord), 0).b * inData.color;
+
+    if (!paint_layer) {
+        vec3 color = tones.x * dark.rgb + tones.y * midtone.rgb + tones.z * highlight.rgb + noise;
+        vec3 line_color = desaturate(outline_color.rgb, amount) * outlines;
+        vec3 desat_fill = desaturate(color, amount) * fill;
+        fragcolor = vec4(line_color + desat_fill, alpha);
+        return;
     }
+
+    // the same sum split by color: desaturate() is mix(color, gray, amount) with gray the sum of
+    // the channels, so every color c adds (1 - amount) c plus amount times its sum. The noise
+    // keeps the fill from being exactly black, the one case desaturate() treats differently.
+    // Premultiplied, the alpha channels accumulate coverage.
+    vec3 own = tones * fill * (1.0 - amount);
+    vec3 gray = tones * fill * amount;
+    float noise_gray = noise * fill * (1.0 + 2.0 * amount); // noise is gray already: adds 3 * amount * noise
+
+    // Weighted blended OIT (McGuire and Bavoil 2013) adds up the colors weighted by alpha and a
+    // falloff with distance, and the alpha of layer1 multiplies up 1 - alpha (the blend state is
+    // set by draw_brush_strokes() in Main.cpp). Sums and products don't depend on the order the
+    // strokes arrive in. The falloff is their equation 7 with its clamp bounds, all scaled by 1/100,
+    // which keeps the sums of many overlapping strokes within half float range.
+    float weight = alpha;
+    if (weighted_blend) {
+        float d = length(vec3(eye_w) - inData.pw);
+        weight *= clamp(0.1 / (1e-5 + pow(d / 5.0, 2.0) + pow(d / 200.0, 6.0)), 1e-4, 30.0);
+    }
+    fragcolor = weight * vec4(own, 1.0);
+    layer1 = vec4(weight * vec3(outlines * (1.0 - amount), gray.xy), alpha);
+    layer2 = weight * vec4(gray.z, outlines * amount, noise_gray, 1.0);
 }
 
 vec3 desaturate(vec3 color, float amount)
@@ -86,8 +111,8 @@ vec3 desaturate(vec3 color, float amount)
     return vec3(mix(color, gray, amount));
 }
 
-// repeated code in toon_fs
-vec4 celshading() {
+// repeated code in toon_fs, as weights of dark, midtone and highlight
+vec3 celshading() {
     // Compute Cook-Torrance Lighting
     const float eps = 1e-8; // small value to avoid division by 0
 
@@ -108,56 +133,24 @@ vec4 celshading() {
     vec3 r = normalize(reflect(-lw, nw));
     float nl = dot(nw, lw);
 
+    vec3 tone;
     if (nl < 0) {
         // ambient 
-        fragcolor = dark;
+        tone = vec3(1.0, 0.0, 0.0);
     } else {
         // if (specular >=0) : diffuse
-        fragcolor = midtone;
+        tone = vec3(0.0, 1.0, 0.0);
     }
 
     if (pow(dot(r, vw), shininess) > 0.95) {
-        fragcolor = highlight;
-    }
-
-    return fragcolor;
-}
-
-vec4 outline() {
-    // add outlines with varying thickness (thicker when close to the viewer)
-    mat3 I;
-
-    // get thickness
-    float d = 1.0 - clamp(pow(length(vec3(eye_w) - inData.pw)/4, 1), 0.0, 1.0); 
-    int linethickness = 5 + int(floor(d * 10));
-
-    for (int i=0; i< linethickness; i++) {
-        for (int j=0; j<linethickness; j++) {
-            // finding outline from contours (depth)
-            I[i][j] = texelFetch(fbo_tex, ivec2(gl_FragCoord) + ivec2(i-1 ,j-1), 0).g; 
-            // finding outline from colors (BW image)
-            // I[i][j] = texelFetch(fbo_tex, ivec2(gl_FragCoord) + ivec2(i-1 ,j-1), 0).g; 
-        }
-    }
-    
-    // applying convolution filter to get gradient in x and y
-    float gx = dot(sx[0], I[0]) + dot(sx[1], I[1]) + dot(sx[2], I[2]); 
-    float gy = dot(sy[0], I[0]) + dot(sy[1], I[1]) + dot(sy[2], I[2]);
-    // turn edge orientation to flat line (length of gradient)
-    float g = sqrt(pow(gx, 2.0) + pow(gy, 2.0)); // with light outline
-
-    // threshold (otherwise will get contour)
-    if (g > 0.1) {
-        g = 1.0;
-    } else {
-        g = 0.0;
+        tone = vec3(0.0, 0.0, 1.0);
     }
 
-    return vec4(1.0 - vec3(g, g, g), 1.0);
+    return tone;
 }
 
-// repeated code in toon_fs.glsl
-vec4 phong() {
+// repeated code in toon_fs.glsl, as weights of dark, midtone and highlight
+vec3 phong() {
      // Compute per-fragment Phong lighting	
 
       const float eps = 1e-8; // small value to avoid division by 0
@@ -166,12 +159,12 @@ vec4 phong() {
 
       vec3 nw = normalize(inData.nw); // world-space unit normal vector
       vec3 lw = normalize(light_w.xyz - inData.pw.xyz);	// world-space unit light vector
-      vec4 diffuse_term = atten*midtone*max(0.0, dot(nw, lw));
+      float diffuse_term = atten*max(0.0, dot(nw, lw));
 
       vec3 vw = normalize(eye_w.xyz - inData.pw.xyz); // world-space unit view vector
       vec3 rw = reflect(-lw, nw); // world-space unit reflection vector
 
-      vec4 specular_term = highlight*pow(max(0.0, dot(rw, vw)), shininess);
+      float specular_term = pow(max(0.0, dot(rw, vw)), shininess);
 
-      return dark + diffuse_term + specular_term;
+      return vec3(1.0, diffuse_term, specular_term);
 }
\ No newline at end of file
@@ -1,11 +1,6 @@
 #version 440   
 
-layout(location = 0) uniform mat4 M;
-layout(location = 4) uniform float mesh_d;
-layout(location = 5) uniform float mesh_range;
-layout(location = 3) uniform int mode;
-layout(location = 7) uniform float sim_rad;
-
+// Expands the strokes written by brush_comp into quads, one instance per stroke
 
 layout(std140, binding = 0) uniform SceneUniforms
 {
@@ -15,10 +10,32 @@ layout(std140, binding = 0) uniform SceneUniforms
    vec4 light_w; // world-space light position
 };
 
-in vec3 pos_attrib; // this variable holds the position of mesh vertices
-in vec3 normal_attrib;  
-in vec2 tex_coord_attrib;
+// repeated code in brush_comp
+struct Stroke
+{
+    vec4 center; // xyz: world-space center, w: depth compared against fbo_tex
+    vec4 axis_u; // xyz: half the width along the stroke, w: opacity at the faded end
+    vec4 axis_w; // xyz: half the height across the stroke, w: opacity at the opaque end
+    vec4 normal; // xyz: world-space normal
+    vec2 seed; // texture coordinate the color noise in brush_fs is hashed from
+};
+
+layout(std430, binding = 5) readonly buffer STROKES { Stroke strokes[]; };
+
+// which stroke an instance draws: 0 in the order brush_comp wrote them, 1 back to front and
+// 2 front to back through the order BrushStrokes::Sort() left in ORDER
+layout(location = 23) uniform int stroke_order;
+layout(location = 26) uniform int slots; // strokes the last sort ordered, those past it keep their place
 
+layout(std430, binding = 6) readonly buffer DRAW_COMMAND
+{
+    uint vertex_count;
+    uint instance_count;
+    uint first;
+    uint base_instance;
+};
+
+layout(std430, binding = 9) readonly buffer ORDER { uvec2 order[]; }; // (key, stroke index)
 
 out VertexData
 {
@@ -26,28 +43,31 @@ out VertexData
    vec3 nw; // world-space normal vector
    float depth;
    vec2 tex_coord;
-} outData;
+   float color;
+} outData; 
 
 void main(void)
 {
-	gl_Position = M*vec4(pos_attrib, 1.0); // transform vertices and send result into pipeline
-	outData.pw = vec3(M * vec4(pos_attrib, 1.0)); // world-space vertex position
-	outData.nw = vec3(M* vec4(normal_attrib, 0.0));	// world-space normal vector
-    outData.tex_coord = tex_coord_attrib;
-	// its just the edge of the model, we are looking at the z depth within the model (model space)
-	outData.depth = ((pos_attrib.z + mesh_d) / mesh_range);
-	
-	if (mode == 0) {
-		// mesh
-		outData.nw = vec3(M*vec4(normal_attrib, 0.0));	// world-space normal normal vector
-		outData.tex_coord = tex_coord_attrib;
-	} else {
-		// simulate
-		outData.nw = vec3(1.0,0.0,0.0);	// world-space normal normal vector
-		outData.tex_coord = vec2(1.0,0.0) ;
-		// its just the edge of the model, we are looking at the z depth within the model (model space)
-		outData.depth = 1.0f;
-		gl_PointSize = sim_rad;
-	} 
-
-}
\ No newline at end of file
+	uint index = uint(gl_InstanceID);
+	if (stroke_order == 2) {
+		index = instance_count - 1u - index;
+	}
+	if (stroke_order != 0 && index < uint(slots)) {
+		index = order[index].y;
+	}
+	Stroke stroke = strokes[index];
+
+	// triangle strip corners: the faded end at +u, the opaque end at -u
+	float side_u = (gl_VertexID < 2) ? 1.0 : -1.0;
+	float side_w = ((gl_VertexID & 1) == 0) ? 1.0 : -1.0;
+	float n_offset = 0.0001; // normal offset
+	vec3 corner = stroke.center.xyz + n_offset * stroke.normal.xyz + side_u * stroke.axis_u.xyz + side_w * stroke.axis_w.xyz;
+
+	gl_Position = P*V*vec4(corner, 1.0);
+	// every corner carries the stroke's center, as the geometry shader did
+	outData.pw = stroke.center.xyz;
+	outData.nw = stroke.normal.xyz;
+	outData.depth = stroke.center.w;
+	outData.tex_coord = stroke.seed;
+	outData.color = (gl_VertexID < 2) ? stroke.axis_u.w : stroke.axis_w.w;
+}
@@ -0,0 +1,75 @@
+#version 440
+
+// Outline composite: a single full-screen pass over the G-buffer written by toon_fs, impostor_fs
+// or fluid_fs, so the geometry is rasterized only once per frame
+
+layout(binding = 0) uniform sampler2D fbo_tex; // bw value, depth, alpha
+layout(binding = 2) uniform sampler2D fbo_color; // shaded color
+layout(binding = 3) uniform sampler2D fbo_depth; // depth buffer of the geometry pass
+
+layout(std140, binding = 3 ) uniform MaterialUniforms
+{
+   vec4 dark;	//ambient material color
+   vec4 midtone;	//diffuse material color
+   vec4 highlight;	//specular material color
+   vec4 outline_color;
+   float shininess;
+};
+
+out vec4 fragcolor; //the output color for this fragment    
+
+// sobel filters
+mat3 sx = mat3( 
+    1.0, 2.0, 1.0, 
+    0.0, 0.0, 0.0, 
+   -1.0, -2.0, -1.0 
+);
+mat3 sy = mat3( 
+    1.0, 0.0, -1.0, 
+    2.0, 0.0, -2.0, 
+    1.0, 0.0, -1.0 
+);
+
+vec4 outline();
+
+void main(void)
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    if (texelFetch(fbo_tex, pixel, 0).b == 0.0) discard; // background keeps the clear color
+
+    // the brush strokes are depth tested against the geometry
+    gl_FragDepth = texelFetch(fbo_depth, pixel, 0).r;
+
+    vec3 fill = outline().rgb;
+    vec3 outlines = vec3(1.0) - fill; // inverse of fill
+    fragcolor = vec4((outline_color.rgb * outlines) + (texelFetch(fbo_color, pixel, 0).rgb * fill), 1.0);
+}
+
+vec4 outline() {
+    // add outlines with consistent thickness using Sobel
+    mat3 I;
+
+    for (int i=0; i< 3; i++) {
+        for (int j=0; j<3; j++) {
+            // finding outline from contours (depth)
+            I[i][j] = texelFetch(fbo_tex, ivec2(gl_FragCoord) + ivec2(i-1 ,j-1), 0).g; 
+            // finding outline from colors (BW image)
+            // I[i][j] = texelFetch(fbo_tex, ivec2(gl_FragCoord) + ivec2(i-1 ,j-1), 0).r; 
+        }
+    }
+    
+    // applying convolution filter to get gradient in x and y
+    float gx = dot(sx[0], I[0]) + dot(sx[1], I[1]) + dot(sx[2], I[2]); 
+    float gy = dot(sy[0], I[0]) + dot(sy[1], I[1]) + dot(sy[2], I[2]);
+    // turn edge orientation to flat line (length of gradient)
+    float g = sqrt(pow(gx, 2.0) + pow(gy, 2.0)); // with light outline
+
+    // 0.1 threshold (otherwise will get contour)
+    if (g > 0.1) {
+        g = 1.0;
+    } else {
+        g = 0.0;
+    }
+
+    return vec4(1.0 - vec3(g, g, g), 1.0);
+}
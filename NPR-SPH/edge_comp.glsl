@@ -0,0 +1,125 @@
+#version 440
+
+// Edge map for the paint pass, built once per frame so brush_fs reads its outline with one fetch
+// instead of running a Sobel filter for every stroke fragment. Outlines are thicker closer to the
+// eye; their width comes from a jump flood, so any thickness costs the same few passes:
+//   jump == 0: Sobel on the G-buffer depth. Edge pixels become seeds and store their outline radius.
+//   jump > 0: one jump flood pass. Every pixel keeps whichever seed, of its own and those jump
+//             pixels away, has its outline nearest, i.e. the smallest distance minus radius.
+//             Run with jumps halving down to 1, then 1 once more to fix the few pixels it misses.
+//   jump < 0: resolve: coverage of the nearest seed's outline, 1 inside and 0 off the lines.
+
+layout (local_size_x = 16, local_size_y = 16, local_size_z = 1) in;
+
+layout(binding = 0) uniform sampler2D fbo_tex; // bw value, depth, alpha
+layout(binding = 3) uniform sampler2D fbo_depth; // depth buffer of the geometry pass
+
+layout(r16f, binding = 0) uniform image2D radii; // outline radius + 1 of edge pixels, 0 elsewhere
+layout(rg16i, binding = 1) readonly uniform iimage2D src_seeds; // nearest seed, -1 if none yet
+layout(rg16i, binding = 2) writeonly uniform iimage2D dst_seeds;
+layout(r16f, binding = 3) writeonly uniform image2D edges; // result brush_fs reads
+
+layout(location = 12) uniform ivec2 viewport; // the textures are larger than what is drawn
+layout(location = 18) uniform int jump;
+layout(location = 19) uniform float outline_radius; // pixels, for edges right at the eye
+
+// repeated code in fluid_smooth_comp
+layout(std140, binding = 0) uniform SceneUniforms
+{
+   mat4 P;	//camera projection * view matrix
+   mat4 V;
+   vec4 eye_w;	//world-space eye position
+   vec4 light_w; //world-space light position
+};
+
+// sobel filters
+mat3 sx = mat3(
+    1.0, 2.0, 1.0,
+    0.0, 0.0, 0.0,
+   -1.0, -2.0, -1.0
+);
+mat3 sy = mat3(
+    1.0, 0.0, -1.0,
+    2.0, 0.0, -2.0,
+    1.0, 0.0, -1.0
+);
+
+// distance from the eye to what the depth buffer holds at pixel
+float eye_distance(ivec2 pixel, float depth)
+{
+    vec3 ndc = 2.0 * vec3((vec2(pixel) + 0.5) / vec2(viewport), depth) - 1.0;
+    float z = -P[3][2] / (ndc.z + P[2][2]); // view space, negative in front of the eye
+    return length(vec3(ndc.x * -z / P[0][0], ndc.y * -z / P[1][1], z));
+}
+
+// 1 + outline radius if pixel is on an edge, else 0
+float detect(ivec2 pixel)
+{
+    mat3 I;
+    float nearest = 1.0;
+    for (int i=0; i< 3; i++) {
+        for (int j=0; j<3; j++) {
+            ivec2 q = clamp(pixel + ivec2(i-1 ,j-1), ivec2(0), viewport - 1);
+            // finding outline from contours (depth)
+            I[i][j] = texelFetch(fbo_tex, q, 0).g;
+            nearest = min(nearest, texelFetch(fbo_depth, q, 0).r);
+        }
+    }
+
+    // applying convolution filter to get gradient in x and y
+    float gx = dot(sx[0], I[0]) + dot(sx[1], I[1]) + dot(sx[2], I[2]);
+    float gy = dot(sy[0], I[0]) + dot(sy[1], I[1]) + dot(sy[2], I[2]);
+    // turn edge orientation to flat line (length of gradient)
+    float g = sqrt(pow(gx, 2.0) + pow(gy, 2.0));
+
+    // 0.1 threshold (otherwise will get contour)
+    if (g <= 0.1) return 0.0;
+
+    // thicker when close to the viewer, from the nearest side of the edge
+    float d = 1.0 - clamp(eye_distance(pixel, nearest) / 4.0, 0.0, 1.0);
+    return 1.0 + d * outline_radius;
+}
+
+// how far p is outside the outline around seed, negative inside
+float outside(ivec2 p, ivec2 seed)
+{
+    return distance(vec2(p), vec2(seed)) - (imageLoad(radii, seed).r - 1.0);
+}
+
+void main(void)
+{
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(p, viewport))) return;
+
+    if (jump == 0) {
+        float r = detect(p);
+        imageStore(radii, p, vec4(r));
+        imageStore(dst_seeds, p, ivec4(r > 0.0 ? p : ivec2(-1), 0, 0));
+        return;
+    }
+
+    if (jump < 0) {
+        ivec2 seed = imageLoad(src_seeds, p).xy;
+        // 1 out to the radius, fading over the next pixel; a radius of 0 keeps just the edge pixel
+        float coverage = (seed.x < 0) ? 0.0 : clamp(1.0 - outside(p, seed), 0.0, 1.0);
+        imageStore(edges, p, vec4(coverage));
+        return;
+    }
+
+    ivec2 best = imageLoad(src_seeds, p).xy;
+    float best_outside = (best.x < 0) ? 1e20 : outside(p, best);
+    for (int j = -1; j <= 1; j++) {
+        for (int i = -1; i <= 1; i++) {
+            ivec2 q = p + jump * ivec2(i, j);
+            if ((i == 0 && j == 0) || any(lessThan(q, ivec2(0))) || any(greaterThanEqual(q, viewport))) continue;
+            ivec2 seed = imageLoad(src_seeds, q).xy;
+            if (seed.x < 0) continue;
+            float o = outside(p, seed);
+            if (o < best_outside) {
+                best = seed;
+                best_outside = o;
+            }
+        }
+    }
+    imageStore(dst_seeds, p, ivec4(best, 0, 0));
+}
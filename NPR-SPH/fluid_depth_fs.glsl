@@ -0,0 +1,37 @@
+#version 440
+
+// First pass of the fluid surface: the nearest sphere's linear view depth per pixel, from the
+// quads of impostor_vs
+
+layout(std140, binding = 0) uniform SceneUniforms
+{
+   mat4 P;	//camera projection * view matrix
+   mat4 V;
+   vec4 eye_w;	//world-space eye position
+   vec4 light_w; //world-space light position
+};
+
+in VertexData
+{
+   vec3 pv; // view-space position on the quad
+   flat vec3 center_v; // view-space sphere center
+   flat float radius_v; // sphere radius after M
+} inData;
+
+out float view_depth; // distance in front of the eye, 0 where there is no fluid
+
+layout(depth_greater) out float gl_FragDepth;
+
+void main(void)
+{
+    // repeated code in impostor_fs
+    vec3 dir = normalize(inData.pv);
+    float b = dot(dir, inData.center_v);
+    float disc = b * b - dot(inData.center_v, inData.center_v) + inData.radius_v * inData.radius_v;
+    if (disc < 0.0) discard;
+    vec3 hit_v = (b - sqrt(disc)) * dir;
+
+    vec4 clip = P * vec4(hit_v, 1.0);
+    gl_FragDepth = 0.5 * (clip.z / clip.w) + 0.5;
+    view_depth = -hit_v.z;
+}
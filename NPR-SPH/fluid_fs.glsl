@@ -0,0 +1,124 @@
+#version 440
+#define PI 3.1415926538
+
+// Fluid surface: shades the smoothed depth from fluid_smooth_comp as a single surface, one
+// fragment per pixel however many particles overlap there
+
+layout(binding = 1) uniform sampler2D fluid_depth; // smoothed linear view depth, 0 where there is no fluid
+
+layout(location = 1) uniform int style;
+layout(location = 11) uniform float filter_radius; // world-space smoothing radius, also the scale of the depth edges
+layout(location = 12) uniform ivec2 viewport; // fluid_depth is larger than what is drawn
+
+layout(std140, binding = 0) uniform SceneUniforms
+{
+   mat4 P;	//camera projection * view matrix
+   mat4 V;
+   vec4 eye_w;	//world-space eye position
+   vec4 light_w; //world-space light position
+};
+
+layout(std140, binding = 3 ) uniform MaterialUniforms
+{
+   vec4 dark;	//ambient material color
+   vec4 midtone;	//diffuse material color
+   vec4 highlight;	//specular material color
+   vec4 outline_color;
+   float shininess;
+};
+
+// G-buffer like toon_fs
+layout(location = 0) out vec4 gbuffer; // bw value, depth, alpha, -
+layout(location = 1) out vec4 fragcolor; // shaded color, outlined by composite_fs
+
+vec4 celshading(vec3 nw, vec3 pw);
+vec4 phong(vec3 nw, vec3 pw);
+
+// view-space position of the surface at a pixel
+vec3 view_position(ivec2 pixel, float depth) {
+    vec2 ndc = 2.0 * (vec2(pixel) + 0.5) / vec2(viewport) - 1.0;
+    return vec3(ndc.x / P[0][0], ndc.y / P[1][1], -1.0) * depth;
+}
+
+void main(void)
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(fluid_depth, pixel, 0).r;
+    if (depth <= 0.0) discard;
+
+    // normal from the neighbour with the smaller depth step on each axis, so silhouettes don't bend it
+    vec3 pv = view_position(pixel, depth);
+    vec3 ddx = view_position(pixel + ivec2(1, 0), texelFetch(fluid_depth, pixel + ivec2(1, 0), 0).r) - pv;
+    vec3 ddx2 = pv - view_position(pixel - ivec2(1, 0), texelFetch(fluid_depth, pixel - ivec2(1, 0), 0).r);
+    if (abs(ddx2.z) < abs(ddx.z)) ddx = ddx2;
+    vec3 ddy = view_position(pixel + ivec2(0, 1), texelFetch(fluid_depth, pixel + ivec2(0, 1), 0).r) - pv;
+    vec3 ddy2 = pv - view_position(pixel - ivec2(0, 1), texelFetch(fluid_depth, pixel - ivec2(0, 1), 0).r);
+    if (abs(ddy2.z) < abs(ddy.z)) ddy = ddy2;
+    vec3 nv = normalize(cross(ddx, ddy));
+
+    vec4 clip = P * vec4(pv, 1.0);
+    gl_FragDepth = 0.5 * (clip.z / clip.w) + 0.5; // brush strokes are depth tested against the surface
+
+    mat3 view_to_world = transpose(mat3(V));
+    vec3 nw = view_to_world * nv;
+    vec3 pw = view_to_world * (pv - V[3].xyz);
+
+    // style
+    if (style == 0) {
+        // cell shading
+        fragcolor = celshading(nw, pw);
+    } else {
+        // paint 
+        fragcolor = mix(celshading(nw, pw), phong(nw, pw), 0.5);
+    }
+
+    // black and white for clear outline
+    vec3 lum = vec3(0.299, 0.587, 0.114);
+    // composite_fs outlines a Sobel response above 0.1, which a step of height h reaches at h = 0.025:
+    // scaled like this, a sheet of fluid more than one smoothing radius in front of another gets outlined
+    gbuffer = vec4(dot(fragcolor.rgb, lum), depth * 0.025 / filter_radius, 1.0, 1.0);
+}
+
+// repeated code in impostor_fs
+vec4 celshading(vec3 nw, vec3 pw) {
+    vec3 lw = normalize(light_w.xyz - pw); // world-space unit light vector
+    vec3 vw = normalize(eye_w.xyz - pw);	// world-space unit view vector
+
+    // reflect
+    vec3 r = normalize(reflect(-lw, nw));
+    float nl = dot(nw, lw);
+
+    vec4 color;
+    if (nl < 0) {
+        // ambient 
+        color = dark;
+    } else {
+        // if (specular >=0) : diffuse
+        color = midtone;
+    }
+
+    if (pow(dot(r, vw), shininess) > 0.95) {
+        color = highlight;
+    }
+
+    return color;
+}
+
+// repeated code in impostor_fs
+vec4 phong(vec3 nw, vec3 pw) {
+     // Compute per-fragment Phong lighting	
+
+      const float eps = 1e-8; // small value to avoid division by 0
+      float d = distance(light_w.xyz, pw);
+      float atten = 1.0/(d*d+eps); // d-squared attenuation
+
+      vec3 lw = normalize(light_w.xyz - pw);	// world-space unit light vector
+      vec4 diffuse_term = atten*midtone*max(0.0, dot(nw, lw));
+
+      vec3 vw = normalize(eye_w.xyz - pw); // world-space unit view vector
+      vec3 rw = reflect(-lw, nw); // world-space unit reflection vector
+
+      vec4 specular_term = highlight*pow(max(0.0, dot(rw, vw)), shininess);
+
+      return dark + diffuse_term + specular_term;
+}
@@ -0,0 +1,58 @@
+#version 440
+
+// One direction of the separable bilateral filter over the fluid depth. Run once along x and
+// once along y. Samples are weighted by distance and by depth difference, so the spheres merge into
+// one surface while a separate layer of fluid in front or behind is not blurred into it.
+
+layout (local_size_x = 16, local_size_y = 16, local_size_z = 1) in;
+
+layout(r32f, binding = 0) readonly uniform image2D src_depth;
+layout(r32f, binding = 1) writeonly uniform image2D dst_depth;
+
+layout(location = 10) uniform ivec2 direction; // (1, 0) or (0, 1)
+layout(location = 11) uniform float filter_radius; // world-space filter radius
+layout(location = 12) uniform ivec2 viewport; // the textures are larger than what is drawn
+
+layout(std140, binding = 0) uniform SceneUniforms
+{
+   mat4 P;	//camera projection * view matrix
+   mat4 V;
+   vec4 eye_w;	//world-space eye position
+   vec4 light_w; //world-space light position
+};
+
+#define MAX_RADIUS_PX 16 // bounds the cost per pixel when the fluid is close to the eye
+
+void main(void)
+{
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(p, viewport))) return;
+
+    float depth = imageLoad(src_depth, p).r;
+    if (depth <= 0.0) {
+        // no fluid: the surface never grows past the particles
+        imageStore(dst_depth, p, vec4(0.0));
+        return;
+    }
+
+    // the world-space radius covers fewer pixels further away
+    float radius_px = filter_radius * P[1][1] * 0.5 * float(viewport.y) / depth;
+    int radius = min(int(ceil(radius_px)), MAX_RADIUS_PX);
+    float sigma_s = max(radius_px, 1.0) / 2.0;
+    float sigma_r = filter_radius; // depth differences beyond this belong to another layer
+
+    float sum = 0.0;
+    float weights = 0.0;
+    for (int i = -radius; i <= radius; i++) {
+        ivec2 q = clamp(p + i * direction, ivec2(0), viewport - 1);
+        float d = imageLoad(src_depth, q).r;
+        if (d <= 0.0) continue;
+
+        float ds = float(i) / sigma_s;
+        float dr = (d - depth) / sigma_r;
+        float w = exp(-0.5 * (ds * ds + dr * dr));
+        sum += w * d;
+        weights += w;
+    }
+    imageStore(dst_depth, p, vec4(sum / weights));
+}
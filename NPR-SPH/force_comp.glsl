@@ -1,7 +1,6 @@
 #version 440
 
 #define WORK_GROUP_SIZE 1024
-#define NUM_PARTICLES 10000
 #define PARTICLE_RADIUS 0.005f
 
 // For calculations
@@ -35,7 +34,8 @@ const vec3 G = vec3(0.0f, -9806.65f, 0.0f); // Gravity force
 void main()
 {
     uint i = gl_GlobalInvocationID.x;
-    if(i >= NUM_PARTICLES) return;
+    uint num_particles = particles.length(); // sized by the SSBO, so any particle count works
+    if(i >= num_particles) return;
 
     const float smoothing_length = smoothing_coeff * PARTICLE_RADIUS; // Smoothing length for neighbourhood
 	const float spiky = -45.0f / (PI * pow(smoothing_length, 6)); // Spiky kernal
@@ -45,7 +45,7 @@ void main()
     vec3 pres_force = vec3(0.0f);
     vec3 visc_force = vec3(0.0f);
     
-    for (uint j = 0; j < NUM_PARTICLES; j++)
+    for (uint j = 0; j < num_particles; j++)
     {
         if (i == j)
         {
@@ -0,0 +1,10 @@
+#version 440
+
+// Full-screen triangle for the fluid surface and the outline composite, drawn with
+// glDrawArrays(GL_TRIANGLES, 0, 3) and no vertex attributes
+
+void main(void)
+{
+	vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2); // (0,0), (2,0), (0,2)
+	gl_Position = vec4(2.0 * corner - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,113 @@
+#version 440
+#define PI 3.1415926538
+
+layout(location = 1) uniform int style;
+
+layout(std140, binding = 0) uniform SceneUniforms
+{
+   mat4 P;	//camera projection * view matrix
+   mat4 V;
+   vec4 eye_w;	//world-space eye position
+   vec4 light_w; //world-space light position
+};
+
+layout(std140, binding = 3 ) uniform MaterialUniforms
+{
+   vec4 dark;	//ambient material color
+   vec4 midtone;	//diffuse material color
+   vec4 highlight;	//specular material color
+   vec4 outline_color;
+   float shininess;
+};
+
+in VertexData
+{
+   vec3 pv; // view-space position on the quad
+   flat vec3 center_v; // view-space sphere center
+   flat float radius_v; // sphere radius after M
+} inData;
+
+// G-buffer like toon_fs
+layout(location = 0) out vec4 gbuffer; // bw value, depth, alpha, -
+layout(location = 1) out vec4 fragcolor; // shaded color, outlined by composite_fs
+
+// the sphere is never in front of the quad, so early depth testing against the quad stays valid
+layout(depth_greater) out float gl_FragDepth;
+
+vec4 celshading(vec3 nw, vec3 pw);
+vec4 phong(vec3 nw, vec3 pw);
+
+void main(void)
+{
+    // ray from the eye through this fragment against the sphere, in view space
+    vec3 dir = normalize(inData.pv);
+    float b = dot(dir, inData.center_v);
+    float disc = b * b - dot(inData.center_v, inData.center_v) + inData.radius_v * inData.radius_v;
+    if (disc < 0.0) discard; // outside the silhouette
+    vec3 hit_v = (b - sqrt(disc)) * dir;
+
+    vec4 clip = P * vec4(hit_v, 1.0);
+    gl_FragDepth = 0.5 * (clip.z / clip.w) + 0.5;
+
+    // V is rigid: its inverse is the transposed rotation applied after removing the translation
+    mat3 view_to_world = transpose(mat3(V));
+    vec3 nw = view_to_world * ((hit_v - inData.center_v) / inData.radius_v);
+    vec3 pw = view_to_world * (hit_v - V[3].xyz);
+
+    // style
+    if (style == 0) {
+        // cell shading
+        fragcolor = celshading(nw, pw);
+    } else {
+        // paint 
+        fragcolor = mix(celshading(nw, pw), phong(nw, pw), 0.5);
+    }
+
+    // black and white for clear outline
+    vec3 lum = vec3(0.299, 0.587, 0.114);
+    gbuffer = vec4(dot(fragcolor.rgb, lum), 1.0, 1.0, 1.0);
+}
+
+// repeated code in toon_fs, with the normal from the ray hit instead of gl_PointCoord
+vec4 celshading(vec3 nw, vec3 pw) {
+    vec3 lw = normalize(light_w.xyz - pw); // world-space unit light vector
+    vec3 vw = normalize(eye_w.xyz - pw);	// world-space unit view vector
+
+    // reflect
+    vec3 r = normalize(reflect(-lw, nw));
+    float nl = dot(nw, lw);
+
+    vec4 color;
+    if (nl < 0) {
+        // ambient 
+        color = dark;
+    } else {
+        // if (specular >=0) : diffuse
+        color = midtone;
+    }
+
+    if (pow(dot(r, vw), shininess) > 0.95) {
+        color = highlight;
+    }
+
+    return color;
+}
+
+// repeated code in toon_fs
+vec4 phong(vec3 nw, vec3 pw) {
+     // Compute per-fragment Phong lighting	
+
+      const float eps = 1e-8; // small value to avoid division by 0
+      float d = distance(light_w.xyz, pw);
+      float atten = 1.0/(d*d+eps); // d-squared attenuation
+
+      vec3 lw = normalize(light_w.xyz - pw);	// world-space unit light vector
+      vec4 diffuse_term = atten*midtone*max(0.0, dot(nw, lw));
+
+      vec3 vw = normalize(eye_w.xyz - pw); // world-space unit view vector
+      vec3 rw = reflect(-lw, nw); // world-space unit reflection vector
+
+      vec4 specular_term = highlight*pow(max(0.0, dot(rw, vw)), shininess);
+
+      return dark + diffuse_term + specular_term;
+}
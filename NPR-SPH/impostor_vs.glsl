@@ -0,0 +1,46 @@
+#version 440   
+
+layout(location = 0) uniform mat4 M;
+layout(location = 9) uniform float particle_radius; // model-space sphere radius
+
+layout(std140, binding = 0) uniform SceneUniforms
+{
+   mat4 P;	// camera projection * view matrix
+   mat4 V;
+   vec4 eye_w;	// world-space eye position
+   vec4 light_w; // world-space light position
+};
+
+in vec3 pos_attrib; // particle position, advanced once per instance
+
+out VertexData
+{
+   vec3 pv; // view-space position on the quad
+   flat vec3 center_v; // view-space sphere center
+   flat float radius_v; // sphere radius after M
+} outData;
+
+// triangle strip corners
+const vec2 corners[4] = vec2[](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(-1.0, 1.0), vec2(1.0, 1.0));
+
+void main(void)
+{
+	vec3 center_v = vec3(V * M * vec4(pos_attrib, 1.0));
+	float radius = particle_radius * length(M[0].xyz); // M only rotates and scales uniformly
+
+	// Quad facing the eye on the sphere's front tangent plane. The silhouette seen from the eye is
+	// smaller than the radius there, so the quad covers it, and every point of the sphere lies
+	// behind the plane, which makes the depth_greater layout in impostor_fs valid.
+	vec3 to_eye = -normalize(center_v);
+	vec3 up = abs(to_eye.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0);
+	vec3 right = normalize(cross(up, to_eye));
+	up = cross(to_eye, right);
+
+	vec2 corner = corners[gl_VertexID];
+	vec3 pv = center_v + radius * to_eye + radius * (corner.x * right + corner.y * up);
+
+	gl_Position = P * vec4(pv, 1.0);
+	outData.pv = pv;
+	outData.center_v = center_v;
+	outData.radius_v = radius;
+}
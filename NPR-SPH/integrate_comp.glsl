@@ -1,7 +1,6 @@
 #version 440
 
 #define WORK_GROUP_SIZE 1024
-#define NUM_PARTICLES 10000
 #define PARTICLE_RADIUS 0.005f
 
 // For calculations
@@ -10,6 +9,7 @@
 layout (local_size_x = WORK_GROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
 
 layout(location = 0) uniform mat4 M;
+layout(location = 8) uniform float dt; // Time step
 
 struct Particle
 {
@@ -30,12 +30,11 @@ layout(std140, binding = 2) uniform BoundaryUniform
     vec4 lower; // Lower bounds of particle area
 };
 
-const float dt = 1.0f / NUM_PARTICLES; // Time step
-
 void main()
 {
     uint i = gl_GlobalInvocationID.x;
-    if(i >= NUM_PARTICLES) return;
+    uint num_particles = particles.length(); // sized by the SSBO, so any particle count works
+    if(i >= num_particles) return;
 
     // Integrate all components
     vec3 acceleration = particles[i].force.xyz / particles[i].extras[0];
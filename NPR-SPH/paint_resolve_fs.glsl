@@ -0,0 +1,51 @@
+#version 440
+
+// Brush strokes from the cached paint layer: brush_fs with paint_layer set blended the weight of
+// every material color instead of the colors, so here they are multiplied back in with the current
+// material. Drawn over the composite with premultiplied blending (GL_ONE, GL_ONE_MINUS_SRC_ALPHA).
+
+layout(binding = 6) uniform sampler2D layer0; // premultiplied dark, midtone, highlight weights, coverage
+layout(binding = 7) uniform sampler2D layer1; // outline weight, dark and midtone gray weights, coverage
+layout(binding = 8) uniform sampler2D layer2; // highlight and outline gray weights, gray noise
+
+// the layer holds weighted sums for weighted blended OIT: the alpha of layer0 is the sum of the
+// weights and that of layer1 the product of 1 - alpha, the part of the composite left showing
+layout(location = 24) uniform bool weighted_blend;
+
+layout(std140, binding = 3) uniform MaterialUniforms
+{
+   vec4 dark; // ambient material color
+   vec4 midtone; // diffuse material color
+   vec4 highlight; // specular material color
+   vec4 outline_color;
+   float shininess;
+   float brush_scale;
+};
+
+out vec4 fragcolor;
+
+// gray desaturate() in brush_fs mixes towards
+float gray(vec3 color)
+{
+    return (color == vec3(0.0)) ? 0.7 : dot(vec3(1.0), color);
+}
+
+void main(void)
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec4 l0 = texelFetch(layer0, pixel, 0);
+    vec4 l1 = texelFetch(layer1, pixel, 0);
+    vec4 l2 = texelFetch(layer2, pixel, 0);
+
+    vec3 color = l0.x * dark.rgb + l0.y * midtone.rgb + l0.z * highlight.rgb + l1.x * outline_color.rgb;
+    // the fill colors always carry noise in brush_fs, so only the outline can be black
+    float grays = l1.y * dot(vec3(1.0), dark.rgb) + l1.z * dot(vec3(1.0), midtone.rgb) + l2.x * dot(vec3(1.0), highlight.rgb)
+        + l2.y * gray(outline_color.rgb) + l2.z;
+    if (weighted_blend) {
+        // the weighted average of the stroke colors, with the coverage of all of them
+        float coverage = 1.0 - l1.a;
+        fragcolor = vec4((color + grays) * coverage / max(l0.a, 1e-5), coverage);
+        return;
+    }
+    fragcolor = vec4(color + grays, l0.a);
+}
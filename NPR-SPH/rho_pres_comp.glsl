@@ -1,7 +1,6 @@
 #version 440
 
 #define WORK_GROUP_SIZE 1024
-#define NUM_PARTICLES 10000
 #define PARTICLE_RADIUS 0.005f
 
 // For calculations
@@ -35,7 +34,8 @@ const float GAS_CONST = 2000.0f; // const for equation of state
 void main()
 {
     uint i = gl_GlobalInvocationID.x;
-    if(i >= NUM_PARTICLES) return;
+    uint num_particles = particles.length(); // sized by the SSBO, so any particle count works
+    if(i >= num_particles) return;
     
     const float smoothing_length = smoothing_coeff * PARTICLE_RADIUS; // Smoothing length for neighbourhood
 
@@ -43,7 +43,7 @@ void main()
     float rho = 0.0f;
 
     // Iterate through all particles
-    for (uint j = 0; j < NUM_PARTICLES; j++)
+    for (uint j = 0; j < num_particles; j++)
     {
         vec3 delta = particles[i].pos.xyz - particles[j].pos.xyz; // Get vector between current particle and particle in vicinity
         float r = length(delta); // Get length of the vector
@@ -0,0 +1,72 @@
+#version 440
+
+// Back to front order of the brush strokes, for the sorted reference the other blend modes are
+// measured against (see BrushStrokes::Sort). order[] holds (key, stroke index) pairs in a power of
+// two number of slots. The key is the distance from the eye to the stroke center as float bits plus
+// one: positive floats sort like their bits, and the slots past the instance count get key 0 so
+// they end up last. step.x == 0 fills the slots, every other dispatch is one compare and exchange
+// step of a bitonic sort into descending keys, merging sequences of step.x slots at distance step.y.
+
+#define WORK_GROUP_SIZE 256
+
+layout (local_size_x = WORK_GROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+
+layout(location = 25) uniform ivec2 step;
+layout(location = 26) uniform int slots;
+
+layout(std140, binding = 0) uniform SceneUniforms
+{
+   mat4 P; // camera projection * view matrix
+   mat4 V;
+   vec4 eye_w; // world-space eye position
+   vec4 light_w; // world-space light position
+};
+
+// repeated code in brush_comp and brush_vs
+struct Stroke
+{
+    vec4 center; // xyz: world-space center, w: depth compared against fbo_tex
+    vec4 axis_u; // xyz: half the width along the stroke, w: opacity at the faded end
+    vec4 axis_w; // xyz: half the height across the stroke, w: opacity at the opaque end
+    vec4 normal; // xyz: world-space normal
+    vec2 seed; // texture coordinate the color noise in brush_fs is hashed from
+};
+
+layout(std430, binding = 5) readonly buffer STROKES { Stroke strokes[]; };
+
+layout(std430, binding = 6) readonly buffer DRAW_COMMAND
+{
+    uint vertex_count;
+    uint instance_count; // strokes brush_comp wrote
+    uint first;
+    uint base_instance;
+};
+
+layout(std430, binding = 9) buffer ORDER { uvec2 order[]; };
+
+void main(void)
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= uint(slots)) {
+        return;
+    }
+
+    if (step.x == 0) {
+        uint key = (i < instance_count) ? floatBitsToUint(distance(eye_w.xyz, strokes[i].center.xyz)) + 1u : 0u;
+        order[i] = uvec2(key, i);
+        return;
+    }
+
+    // each pair is handled by its lower slot
+    uint partner = i ^ uint(step.y);
+    if (partner <= i) {
+        return;
+    }
+    uvec2 a = order[i];
+    uvec2 b = order[partner];
+    bool descending = (i & uint(step.x)) == 0u;
+    if (descending ? a.x < b.x : a.x > b.x) {
+        order[i] = b;
+        order[partner] = a;
+    }
+}
@@ -1,10 +1,7 @@
 #version 440
 #define PI 3.1415926538
 
-layout(binding = 0) uniform sampler2D fbo_tex; 
-
 layout(location = 1) uniform int style;
-layout(location = 2) uniform int pass;
 layout(location = 3) uniform int mode;
 layout(location = 6) uniform float scale;
 
@@ -33,26 +30,15 @@ in VertexData
    vec2 tex_coord;
 } inData; //block is named 'inData'
 
-out vec4 fragcolor; //the output color for this fragment    
+// G-buffer, one geometry pass for composite_fs and the brush strokes
+layout(location = 0) out vec4 gbuffer; // bw value, depth, alpha, -
+layout(location = 1) out vec4 fragcolor; // shaded color, outlined by composite_fs
 
 // Constant light colors
 vec4 La = vec4(vec3(0.85f), 1.0f); // Ambient light color
 vec4 Ld = vec4(vec3(0.5f), 1.0f); // Diffuse light color
 vec4 Ls = vec4(1.0f); // Specular light color
 
-// sobel filters
-mat3 sx = mat3( 
-    1.0, 2.0, 1.0, 
-    0.0, 0.0, 0.0, 
-   -1.0, -2.0, -1.0 
-);
-mat3 sy = mat3( 
-    1.0, 0.0, -1.0, 
-    2.0, 0.0, -2.0, 
-    1.0, 0.0, -1.0 
-);
-
-vec4 outline();
 vec4 celshading();
 vec4 phong();
 
@@ -67,23 +53,9 @@ void main(void)
         fragcolor = mix(celshading(), phong(), 0.5);
     }
 
-    // output
-    if (pass == 0) {
-        // outputs to texture
-
-        // black and white for clear outline
-        vec3 lum = vec3(0.299, 0.587, 0.114);
-        // bw value, depth, alpha, -
-        fragcolor = vec4(dot(fragcolor.rgb, lum), inData.depth, 1.0, 1.0);
-
-    } else if (pass == 1) {
-        // outputs to screen
-
-        vec3 fill = outline().rgb;
-        vec3 outlines = vec3(1.0) - fill; // inverse of fill
-        fragcolor = vec4((outline_color.rgb * outlines) + (fragcolor.rgb * fill), 1.0);
-    }
-
+    // black and white for clear outline
+    vec3 lum = vec3(0.299, 0.587, 0.114);
+    gbuffer = vec4(dot(fragcolor.rgb, lum), inData.depth, 1.0, 1.0);
 }
 
 // repeated code in brush_fs
@@ -123,35 +95,6 @@ vec4 celshading() {
     return fragcolor;
 }
 
-vec4 outline() {
-    // add outlines with consistent thickness using Sobel
-    mat3 I;
-
-    for (int i=0; i< 3; i++) {
-        for (int j=0; j<3; j++) {
-            // finding outline from contours (depth)
-            I[i][j] = texelFetch(fbo_tex, ivec2(gl_FragCoord) + ivec2(i-1 ,j-1), 0).g; 
-            // finding outline from colors (BW image)
-            // I[i][j] = texelFetch(fbo_tex, ivec2(gl_FragCoord) + ivec2(i-1 ,j-1), 0).g; 
-        }
-    }
-    
-    // applying convolution filter to get gradient in x and y
-    float gx = dot(sx[0], I[0]) + dot(sx[1], I[1]) + dot(sx[2], I[2]); 
-    float gy = dot(sy[0], I[0]) + dot(sy[1], I[1]) + dot(sy[2], I[2]);
-    // turn edge orientation to flat line (length of gradient)
-    float g = sqrt(pow(gx, 2.0) + pow(gy, 2.0)); // with light outline
-
-    // 0.1 threshold (otherwise will get contour)
-    if (g > 0.1) {
-        g = 1.0;
-    } else {
-        g = 0.0;
-    }
-
-    return vec4(1.0 - vec3(g, g, g), 1.0);
-}
-
 // repeated code in brush_fs.glsl
 vec4 phong() {
      // Compute per-fragment Phong lighting	
@@ -0,0 +1,50 @@
+#version 440
+
+// Upscale of the internal render target to the window, for dynamic resolution. Bilinear between
+// the four nearest texels, with each texel weighted down by how far its luminance is from the
+// nearest one, so outlines and stroke edges stay sharp instead of smearing into their surroundings
+// while smooth shading is still interpolated. At scale 1 every pixel lands on a texel center and
+// the image is copied unchanged.
+
+layout(binding = 5) uniform sampler2D scene_color; // composite and brush strokes
+
+layout(location = 12) uniform ivec2 viewport; // pixels drawn into scene_color
+layout(location = 20) uniform ivec2 window; // pixels of the target
+
+out vec4 fragcolor;
+
+const float luminance_sigma = 0.1;
+
+float luminance(vec3 color)
+{
+    return dot(color, vec3(0.299, 0.587, 0.114));
+}
+
+void main(void)
+{
+    // position in scene_color texels, 0 at the center of the first one
+    vec2 src = gl_FragCoord.xy * vec2(viewport) / vec2(window) - 0.5;
+    ivec2 base = ivec2(floor(src));
+    vec2 f = src - vec2(base);
+
+    vec3 colors[4];
+    float weights[4];
+    for (int i = 0; i < 4; i++) {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        colors[i] = texelFetch(scene_color, clamp(base + offset, ivec2(0), viewport - 1), 0).rgb;
+        weights[i] = mix(1.0 - f.x, f.x, float(offset.x)) * mix(1.0 - f.y, f.y, float(offset.y));
+    }
+
+    // the nearest texel guides the others
+    int nearest = int(f.x >= 0.5) + 2 * int(f.y >= 0.5);
+    float guide = luminance(colors[nearest]);
+    vec3 sum = vec3(0.0);
+    float weight_sum = 0.0;
+    for (int i = 0; i < 4; i++) {
+        float difference = (luminance(colors[i]) - guide) / luminance_sigma;
+        float w = weights[i] * exp(-0.5 * difference * difference);
+        sum += w * colors[i];
+        weight_sum += w;
+    }
+    fragcolor = vec4(sum / weight_sum, 1.0);
+}